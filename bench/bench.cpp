@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <renderer.hpp>
+
+// every scene is rebuilt from the same seed, so two builds render the same frames
+constexpr uint32_t SEED = 42;
+constexpr float TICK_SECONDS = 1.0f / 60;
+constexpr uint32_t WARMUP_FRAMES = 60;
+constexpr uint32_t MEASURED_FRAMES = 600;
+
+struct FrameSamples {
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;
+};
+
+struct SceneResult {
+    std::string name;
+    uint32_t count;
+    FrameSamples samples;
+};
+
+// Fills the renderer's scene, the objects it returns stay added until the scene ends
+using SceneBuilder = std::function<std::vector<std::unique_ptr<volchara::Object>>(volchara::Renderer&, std::mt19937&)>;
+// Runs before every frame, e.g. to add and remove objects
+using SceneStep = std::function<void(volchara::Renderer&, std::mt19937&, std::vector<std::unique_ptr<volchara::Object>>&)>;
+
+glm::vec3 randomPosition(std::mt19937& rnd) {
+    std::uniform_real_distribution<float> dis(-10.0f, 10.0f);
+    return {dis(rnd), dis(rnd) * 0.25f, dis(rnd) - 12.0f};
+}
+
+std::unique_ptr<volchara::Object> makeBox(volchara::Renderer& renderer, std::mt19937& rnd) {
+    glm::vec3 center = randomPosition(rnd);
+    auto box = std::make_unique<volchara::Box>(volchara::Box::fromWorldCoordinates(renderer, {
+        .center = {center.x, center.y, center.z},
+        .sizes = {0.5f, 0.5f, 0.5f},
+        .frontOrientationPlane = {{-1, 1, 0}, {1, 1, 0}, {1, -1, 0}},
+    }));
+    renderer.addObject(box.get());
+    return box;
+}
+
+std::unique_ptr<volchara::Object> makeCat(volchara::Renderer& renderer, std::mt19937& rnd) {
+    std::uniform_int_distribution<> colorDis(1, 14);
+    auto cat = std::make_unique<volchara::Object>(volchara::GLTFModel::fromFile(renderer, renderer.getResourceDir() / "models/CatModel.glb"));
+    cat->replaceTextures(renderer.getResourceDir() / std::format("textures/Cat_color_{}.png", colorDis(rnd)));
+    cat->transform.setTranslation(randomPosition(rnd));
+    renderer.addObject(cat.get());
+    return cat;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[rank];
+}
+
+std::string percentilesJson(const std::vector<double>& values) {
+    return std::format("{{\"p50\": {:.4f}, \"p90\": {:.4f}, \"p99\": {:.4f}, \"max\": {:.4f}}}",
+        percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99), percentile(values, 1.0));
+}
+
+SceneResult runScene(std::string name, uint32_t count, SceneBuilder build, SceneStep step = nullptr) {
+    std::cerr << "bench: " << name << " (" << count << ")" << std::endl;
+    volchara::RendererSettings settings = volchara::RendererSettings::uncapped();
+    settings.headless = true;
+    volchara::Renderer renderer(settings);
+    std::mt19937 rnd(SEED);
+    renderer.camera.transform.position.up(2, true);
+    renderer.setAmbientLight({{0, 0, 0}, {1, 1, 1}, 0.2f});
+    std::vector<std::unique_ptr<volchara::Object>> objects = build(renderer, rnd);
+
+    SceneResult result{.name = name, .count = count};
+    for (uint32_t frame = 0; frame < WARMUP_FRAMES + MEASURED_FRAMES; frame++) {
+        if (step) step(renderer, rnd, objects);
+        auto start = std::chrono::steady_clock::now();
+        renderer.renderFrame(TICK_SECONDS);
+        std::chrono::duration<double, std::milli> cpuTime = std::chrono::steady_clock::now() - start;
+        if (frame < WARMUP_FRAMES) continue;
+        result.samples.cpuMs.push_back(cpuTime.count());
+        // GPU time of the last frame whose timestamps came back
+        result.samples.gpuMs.push_back(renderer.getStats().gpuFrameMs);
+    }
+
+    for (auto& obj : objects) {
+        renderer.delObject(obj.get());
+    }
+    objects.clear();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    std::vector<SceneResult> results;
+
+    results.push_back(runScene("boxes", 10000, [](volchara::Renderer& renderer, std::mt19937& rnd) {
+        std::vector<std::unique_ptr<volchara::Object>> objects;
+        for (uint32_t i = 0; i < 10000; i++) {
+            objects.push_back(makeBox(renderer, rnd));
+        }
+        return objects;
+    }));
+
+    results.push_back(runScene("cats", 500, [](volchara::Renderer& renderer, std::mt19937& rnd) {
+        for (int i = 1; i < 15; i++) {
+            renderer.preloadTexture(renderer.getResourceDir() / std::format("textures/Cat_color_{}.png", i));
+        }
+        renderer.preloadModel(renderer.getResourceDir() / "models/CatModel.glb");
+        std::vector<std::unique_ptr<volchara::Object>> objects;
+        for (uint32_t i = 0; i < 500; i++) {
+            objects.push_back(makeCat(renderer, rnd));
+        }
+        return objects;
+    }));
+
+    results.push_back(runScene("lights", 1000, [](volchara::Renderer& renderer, std::mt19937& rnd) {
+        std::uniform_real_distribution<float> colorDis(0.2f, 1.0f);
+        std::uniform_real_distribution<float> brightnessDis(1.0f, 5.0f);
+        std::vector<std::unique_ptr<volchara::Object>> objects;
+        for (uint32_t i = 0; i < 1000; i++) {
+            objects.push_back(makeBox(renderer, rnd));
+        }
+        for (uint32_t i = 0; i < 1000; i++) {
+            glm::vec3 position = randomPosition(rnd);
+            volchara::DirectionalLight light = renderer.objDirectionalLightFromWorldCoordinates({
+                .position = {position.x, position.y + 1, position.z},
+                .color = {colorDis(rnd), colorDis(rnd), colorDis(rnd)},
+                .brightness = brightnessDis(rnd),
+            });
+            renderer.addLight(&light);
+        }
+        return objects;
+    }));
+
+    results.push_back(runScene("churn", 2000, [](volchara::Renderer& renderer, std::mt19937& rnd) {
+        std::vector<std::unique_ptr<volchara::Object>> objects;
+        for (uint32_t i = 0; i < 2000; i++) {
+            objects.push_back(makeBox(renderer, rnd));
+        }
+        return objects;
+    }, [](volchara::Renderer& renderer, std::mt19937& rnd, std::vector<std::unique_ptr<volchara::Object>>& objects) {
+        // replaces a few percent of the scene every frame
+        for (uint32_t i = 0; i < 50; i++) {
+            std::uniform_int_distribution<size_t> indexDis(0, objects.size() - 1);
+            size_t index = indexDis(rnd);
+            renderer.delObject(objects[index].get());
+            objects[index] = makeBox(renderer, rnd);
+        }
+    }));
+
+    std::ostringstream json;
+    json << "{\n  \"tickSeconds\": " << TICK_SECONDS << ",\n  \"frames\": " << MEASURED_FRAMES << ",\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SceneResult& result = results[i];
+        json << "    {\"name\": \"" << result.name << "\", \"count\": " << result.count
+             << ", \"cpuMs\": " << percentilesJson(result.samples.cpuMs)
+             << ", \"gpuMs\": " << percentilesJson(result.samples.gpuMs) << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    if (argc > 1) {
+        std::ofstream out(argv[1]);
+        out << json.str();
+    } else {
+        std::cout << json.str();
+    }
+    return 0;
+}
@@ -1,23 +1,62 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
 #include <vulkan/vulkan_raii.hpp>
 
 namespace volchara {
+    // Timeline semaphore value signaled once an upload batch has finished on the GPU
+    using UploadTicket = uint64_t;
+
     class DeviceBufferCopyHandler {
+        struct Batch {
+            vk::raii::CommandBuffer cmdBuf = nullptr;
+            UploadTicket ticket = 0;
+            std::vector<std::function<void()>> onComplete;
+        };
+
         vk::raii::Device* device = nullptr;
         vk::raii::Queue queue = nullptr;
+        std::mutex* queueMutex = nullptr;
         vk::raii::CommandPool commandPool = nullptr;
-        // vk::raii::Fence fence = nullptr;
+        vk::raii::Semaphore timeline = nullptr;
+        std::vector<uint32_t> families;
+        Batch recording;
+        bool recordingOpen = false;
+        std::vector<Batch> inFlight;
+        UploadTicket submitted = 0;
+
+        void beginBatch();
+        void collect();
 
         public:
-            DeviceBufferCopyHandler(vk::raii::Device& dev, uint32_t queueFamilyIndex);
-            void submit(vk::Buffer& from, vk::Buffer& to, uint32_t size);
-            void submit(vk::Buffer& from, vk::Image& to, vk::Extent3D extent);
+            // Submits lock queueMutex, without a transfer family the queue is the renderer's graphics queue
+            DeviceBufferCopyHandler(vk::raii::Device& dev, uint32_t graphicsFamilyIndex, uint32_t transferFamilyIndex, std::mutex& queueMutex);
+            // Copies are recorded into the current batch and executed on flush()
+            void submit(vk::Buffer from, vk::DeviceSize srcOffset, vk::Buffer to, vk::DeviceSize dstOffset, vk::DeviceSize size);
+            void submit(vk::Buffer from, vk::DeviceSize srcOffset, vk::Image to, vk::Extent3D extent);
+            // Every level is moved to transfer dst first, the image is left in finalLayout afterwards
+            void submit(vk::Buffer from, vk::Image to, const std::vector<vk::BufferImageCopy>& regions, uint32_t mipLevels, vk::ImageLayout finalLayout);
+            // Orders copies recorded before it against the ones after, for copies that read or overwrite earlier results
+            void barrier();
+            // Runs release once the current batch is complete (e.g. to free its staging memory)
+            void deferUntilComplete(std::function<void()> release);
+            UploadTicket flush();
+            UploadTicket pendingTicket() const;
+            bool isComplete(UploadTicket ticket);
+            void wait(UploadTicket ticket);
+            void waitIdle();
+            vk::Semaphore timelineSemaphore() const;
+            const std::vector<uint32_t>& queueFamilies() const;
             DeviceBufferCopyHandler(nullptr_t) {}
             ~DeviceBufferCopyHandler() {}
             DeviceBufferCopyHandler(DeviceBufferCopyHandler&) = delete;
             DeviceBufferCopyHandler& operator=(DeviceBufferCopyHandler&) = delete;
             DeviceBufferCopyHandler(DeviceBufferCopyHandler&& other);
             const DeviceBufferCopyHandler& operator=(DeviceBufferCopyHandler&& other);
+            static void swap(DeviceBufferCopyHandler& lhs, DeviceBufferCopyHandler& rhs);
     };
-}
\ No newline at end of file
+}
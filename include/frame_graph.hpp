@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace volchara {
+    using FrameGraphResource = uint32_t;
+    using FrameGraphPass = uint32_t;
+
+    // How a pass touches a resource, barriers between passes are built from it
+    struct FrameGraphUsage {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        // images only, eUndefined when the pass doesn't need the previous contents in any layout
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        // layout the pass leaves the image in, for render passes transitioning their attachments themselves
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+    };
+
+    // Passes of one frame in recording order, declared every frame
+    // Passes none of the outputs depend on are dropped, the rest are recorded with the barriers their usages need
+    class FrameGraph {
+        private:
+        struct Resource {
+            vk::Image image = nullptr;
+            vk::ImageAspectFlags aspect;
+            vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+            // the last write and the reads that have seen it since
+            vk::PipelineStageFlags writeStages;
+            vk::AccessFlags writeAccess;
+            vk::PipelineStageFlags readStages;
+            vk::AccessFlags readAccess;
+            bool output = false;
+            vk::ImageLayout outputLayout = vk::ImageLayout::eUndefined;
+        };
+        struct Access {
+            FrameGraphResource resource = 0;
+            FrameGraphUsage usage;
+            bool write = false;
+        };
+        struct Pass {
+            std::function<void()> record;
+            std::vector<Access> accesses;
+            bool sideEffects = false;
+            bool culled = false;
+        };
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        uint32_t culledPasses = 0;
+        void cull();
+        void recordBarriers(vk::raii::CommandBuffer& commandBuffer, const Pass& pass);
+        public:
+        void reset();
+        FrameGraphResource importBuffer();
+        // readyStages are the stages a semaphore wait before the frame is chained to, e.g. color output for a swapchain image
+        FrameGraphResource importImage(vk::Image image, vk::ImageAspectFlags aspect, vk::ImageLayout layout, vk::PipelineStageFlags readyStages = {});
+        // Keeps every pass writing the resource, an image is left in the layout once the frame is recorded
+        void markOutput(FrameGraphResource resource, vk::ImageLayout layout = vk::ImageLayout::eUndefined);
+        // Passes with side effects are never dropped, e.g. work the graph doesn't see the results of
+        FrameGraphPass addPass(std::function<void()> record, bool sideEffects = false);
+        void read(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage);
+        void write(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage);
+        // Culls, then records the remaining passes in order
+        void execute(vk::raii::CommandBuffer& commandBuffer);
+        uint32_t culledPassCount() const;
+    };
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+
+namespace volchara {
+    // Holds frames to a fixed rate without spinning the main loop, a cap of 0 lets every frame through
+    class FramePacer {
+        private:
+        std::chrono::steady_clock::duration interval{0};
+        std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+        #if defined(_WIN32)
+        void* timer = nullptr;
+        #endif
+        void sleepUntil(std::chrono::steady_clock::time_point deadline);
+        public:
+        FramePacer();
+        ~FramePacer();
+        FramePacer(FramePacer&) = delete;
+        FramePacer& operator=(FramePacer&) = delete;
+        void setFrameCap(float framesPerSecond);
+        // Blocks until the next frame is due, sleeps through most of the wait and spins only the last stretch
+        void wait();
+    };
+}
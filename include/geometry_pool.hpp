@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <device_buffer_copy_handler.hpp>
+#include <objects.hpp>
+#include <raii_wrappers.hpp>
+
+namespace volchara {
+    class FreeList {
+        private:
+        // offset -> count of free elements, neighbours are always merged
+        std::map<uint32_t, uint32_t> ranges;
+        uint32_t capacity = 0;
+        public:
+        FreeList() {}
+        FreeList(uint32_t size);
+        std::optional<uint32_t> allocate(uint32_t count);
+        void release(uint32_t offset, uint32_t count);
+        void grow(uint32_t newCapacity);
+        uint32_t size() const;
+    };
+
+    class GeometryPool {
+        private:
+        RAIIAllocator* allocator = nullptr;
+        DeviceBufferCopyHandler* copyHandler = nullptr;
+        std::function<void()> waitForFrames;
+        VertexFormat format = VertexFormat::eFull;
+        RAIIvmaBuffer vertexBuffer = nullptr;
+        RAIIvmaBuffer indexBuffer = nullptr;
+        FreeList freeVertices;
+        FreeList freeIndices;
+        RAIIvmaBuffer createBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size);
+        void grow(RAIIvmaBuffer& buffer, FreeList& freeList, vk::BufferUsageFlags usage, vk::DeviceSize elementSize, uint32_t minCount);
+        public:
+        // waitForFrames is called before the buffers are replaced, frames in flight may still read them
+        GeometryPool(RAIIAllocator& fromAllocator, DeviceBufferCopyHandler& handler, std::function<void()> waitForFrames, VertexFormat vertexFormat, uint32_t vertexCount, uint32_t indexCount);
+        GeometryPool(nullptr_t) {}
+        ~GeometryPool() {}
+        GeometryPool(GeometryPool&) = delete;
+        GeometryPool& operator=(GeometryPool&) = delete;
+        GeometryPool(GeometryPool&& other);
+        const GeometryPool& operator=(GeometryPool&& other);
+        // Uploads only the given mesh, the rest of the pool stays untouched, compact vertices are packed against bounds
+        GeometryRange allocate(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, glm::vec4 bounds);
+        // The range must not be read by any frame in flight anymore
+        void release(GeometryRange range);
+        vk::Buffer vertices() const;
+        vk::Buffer indices() const;
+        static void swap(GeometryPool& lhs, GeometryPool& rhs);
+    };
+}
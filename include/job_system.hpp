@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace volchara {
+    // Fixed pool of worker threads running one batch of tasks at a time and background tasks in between
+    class JobSystem {
+        private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable batchDone;
+        // only valid while run() is waiting for the batch
+        const std::function<void(uint32_t, uint32_t)>* job = nullptr;
+        uint32_t taskCount = 0;
+        uint32_t nextTask = 0;
+        uint32_t finishedTasks = 0;
+        std::deque<std::function<void()>> background;
+        bool stopping = false;
+        void workerLoop(uint32_t worker);
+        bool runNextTask(uint32_t worker);
+        public:
+        JobSystem(uint32_t workerCount);
+        ~JobSystem();
+        JobSystem(JobSystem&) = delete;
+        JobSystem& operator=(JobSystem&) = delete;
+        // Worker slots including the calling thread, slot index is the second job argument
+        uint32_t threadCount() const;
+        // Calls job(task, slot) for every task on the workers and the calling thread, returns once all are done
+        void run(uint32_t tasks, const std::function<void(uint32_t, uint32_t)>& job);
+        // Runs task on some worker later, batches from run() are picked up first
+        void enqueue(std::function<void()> task);
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace volchara {
+    // Read-only view of a whole file mapped into memory, bytes stay valid while the object lives
+    class MappedFile {
+        private:
+        const unsigned char* mapped = nullptr;
+        size_t length = 0;
+        #if defined(_WIN32)
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+        #else
+        int fileDescriptor = -1;
+        #endif
+        public:
+        static MappedFile fromPath(const std::filesystem::path& path);
+        MappedFile(nullptr_t) {}
+        ~MappedFile();
+        MappedFile(MappedFile&) = delete;
+        MappedFile& operator=(MappedFile&) = delete;
+        MappedFile(MappedFile&& other);
+        const MappedFile& operator=(MappedFile&& other);
+        std::span<const unsigned char> bytes() const;
+        static void swap(MappedFile& lhs, MappedFile& rhs);
+    };
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <mapped_file.hpp>
+#include <objects.hpp>
+
+namespace volchara {
+    // Bumped whenever a section's layout or meaning changes, older bakes are treated as stale
+    constexpr uint32_t VMESH_VERSION = 4;
+
+    // Sections of a .vmesh file, plain data read in place from the mapping
+    struct VMeshSection {
+        uint64_t offset = 0;
+        uint64_t count = 0;
+    };
+
+    struct VMeshHeader {
+        std::array<char, 4> magic{'V', 'M', 'S', 'H'};
+        uint32_t version = VMESH_VERSION;
+        // the vertices are stored as the renderer's Vertex, a build with another layout can't read them
+        uint32_t vertexSize = sizeof(Vertex);
+        uint32_t pad = 0;
+        // size and modification time of the model the file was baked from
+        uint64_t sourceSize = 0;
+        int64_t sourceTime = 0;
+        VMeshSection nodes;
+        VMeshSection childNodes;
+        VMeshSection rootNodes;
+        VMeshSection meshes;
+        VMeshSection vertices;
+        VMeshSection indices;
+        VMeshSection materials;
+        VMeshSection textures;
+        VMeshSection bytes;
+    };
+
+    struct VMeshNode {
+        std::array<float, 3> translation{0, 0, 0};
+        // w, x, y, z
+        std::array<float, 4> rotation{1, 0, 0, 0};
+        std::array<float, 3> scale{1, 1, 1};
+        int32_t mesh = -1;
+        int32_t material = -1;
+        // children are childNodes[firstChild, firstChild + childCount)
+        uint32_t firstChild = 0;
+        uint32_t childCount = 0;
+    };
+
+    // Vertices and indices of a mesh, indices count from its first vertex, LOD ranges from its first index
+    struct VMeshMesh {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t lodCount = 0;
+        std::array<MeshLod, MAX_MESH_LODS> lods{};
+    };
+
+    // -1 when the material has no such texture
+    struct VMeshMaterial {
+        int32_t baseColorTexture = -1;
+        int32_t normalTexture = -1;
+        int32_t emissiveTexture = -1;
+        float alphaCutoff = 0.0;
+        uint32_t transparent = 0;
+    };
+
+    // Slice of the bytes section, a path relative to the model for external images, the encoded image otherwise
+    struct VMeshTexture {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t external = 0;
+        uint32_t pad = 0;
+    };
+
+    // Model in its final vertex layout, either mapped from a .vmesh bake or baked in memory from a GLTF file
+    class ModelData {
+        private:
+        MappedFile file = nullptr;
+        std::vector<unsigned char> baked;
+        bool bakeable = true;
+        std::span<const unsigned char> bytes() const;
+        const VMeshHeader& header() const;
+        template <typename T>
+        std::span<const T> section(const VMeshSection& range) const;
+        public:
+        ModelData() {}
+        ModelData(ModelData&) = delete;
+        ModelData& operator=(ModelData&) = delete;
+        static std::filesystem::path bakePath(const std::filesystem::path& source);
+        // Maps the bake while it matches the source, otherwise parses the GLTF and writes the bake for the next start
+        // GLTF files with external buffers are never baked, they are parsed on every load
+        static std::shared_ptr<ModelData> load(const std::filesystem::path& source);
+        static std::shared_ptr<ModelData> fromGLTF(const std::filesystem::path& source);
+        // nullptr when the bake is unreadable or older than the source
+        static std::shared_ptr<ModelData> fromVMesh(const std::filesystem::path& bake, const std::filesystem::path& source);
+        // False when the file couldn't be written, e.g. in a read-only resource directory
+        bool write(const std::filesystem::path& bake) const;
+        std::span<const VMeshNode> nodes() const;
+        std::span<const uint32_t> childNodes() const;
+        std::span<const uint32_t> rootNodes() const;
+        std::span<const VMeshMesh> meshes() const;
+        std::span<const Vertex> vertices() const;
+        std::span<const uint32_t> indices() const;
+        std::span<const VMeshMaterial> materials() const;
+        std::span<const VMeshTexture> textures() const;
+        std::span<const unsigned char> textureBytes(const VMeshTexture& texture) const;
+    };
+}
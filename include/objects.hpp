@@ -3,6 +3,8 @@
 #include <array>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <set>
 
@@ -10,10 +12,12 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
-#include <tiny_gltf.h>
+
+#include <scene_registry.hpp>
 
 namespace volchara {
     class Renderer;
+    class ModelData;
 
     struct InitDataPlane {
         std::array<float, 3> topLeft;
@@ -36,6 +40,7 @@ namespace volchara {
     struct UniformBufferObject {
         glm::mat4 view;
         glm::mat4 proj;
+        glm::mat4 invViewProj;
     };
 
     struct AmbientLightUniformBufferObject {
@@ -63,6 +68,29 @@ namespace volchara {
         uint32_t debugFlags = 0;
     };
 
+    struct alignas(16) GPUInstance {
+        glm::mat4 model;
+        // mat3 with std430 column padding
+        glm::mat3x4 normalMatrix{1};
+        glm::vec4 bounds;
+        // object-space error of every LOD, the first one is exact
+        glm::vec4 lodErrors{0};
+        uint32_t textureIndex = 0;
+        uint32_t normalIndex = 0;
+        uint32_t emissiveIndex = 0;
+        float alphaCutoff = 0.0;
+        // draw of the first LOD, the coarser ones follow it
+        uint32_t drawIndex = 0;
+        uint32_t lodCount = 1;
+    };
+
+    struct CullPushConstants {
+        uint32_t instanceCount = 0;
+        uint32_t frustumCulling = 0;
+        // screen pixels per unit of error at distance one, 0 keeps every instance at the first LOD
+        float lodScale = 0;
+    };
+
     struct alignas(16) GPULight {
         glm::vec4 position;
         glm::vec4 color;
@@ -74,9 +102,10 @@ namespace volchara {
         glm::vec3 pad;
     };
 
-    struct alignas(16) GPULightsBuffer {
-        GPULightHeader header;
-        GPULight lights[32];
+    enum class VertexFormat {
+        eFull,
+        // Vertex packed into a CompactVertex, read by base_compact.vert
+        eCompact,
     };
 
     struct Vertex {
@@ -86,18 +115,73 @@ namespace volchara {
         glm::vec2 texCoord;
 
         bool operator==(const Vertex& other) const;
-        static vk::VertexInputBindingDescription getBindingDescription();
-        static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions();
+        static uint32_t stride(VertexFormat format = VertexFormat::eFull);
+        static vk::VertexInputBindingDescription getBindingDescription(VertexFormat format = VertexFormat::eFull);
+        static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions(VertexFormat format = VertexFormat::eFull);
+    };
+
+    // Quantized vertex without color, no shader reads it
+    struct CompactVertex {
+        // snorm, xyz relative to the mesh bounding sphere, w is 1 when the vertex has a normal
+        std::array<int16_t, 4> pos;
+        // snorm, octahedral encoding of the normal
+        std::array<int16_t, 2> normal;
+        // half floats, texture coordinates may repeat outside of 0..1
+        std::array<uint16_t, 2> texCoord;
+
+        static CompactVertex fromVertex(const Vertex& v, glm::vec4 bounds);
+    };
+
+    // LODs per mesh, the full mesh included
+    constexpr uint32_t MAX_MESH_LODS = 4;
+
+    // Slice of a mesh's indices drawn at one level of detail
+    struct MeshLod {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        // furthest the simplified surface strays from the full one, in object units
+        float error = 0;
+    };
+
+    // Place of a mesh inside the shared geometry buffers, used as firstIndex/vertexOffset of its draw
+    struct GeometryRange {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    // Geometry shared by every object made from the same source, uploaded once while any of them is added
+    struct Mesh {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::optional<GeometryRange> geometry;
+        uint32_t residentObjects = 0;
+        // object-space bounding sphere, xyz - center, w - radius
+        glm::vec4 bounds{0, 0, 0, 0};
+        // ranges of indices, empty when the indices are drawn whole
+        std::vector<MeshLod> lods;
+
+        void computeBounds();
+        // Reorders the indices for the vertex cache and appends simplified copies, each about half the previous
+        void buildLods();
+        uint32_t lodCount() const;
+        MeshLod lod(uint32_t level) const;
     };
 
     class Object;
 
     class Transform {
-        public:
-        Object* parent = nullptr;
+        private:
         glm::vec3 translation{0,0,0};
         glm::vec3 scaling{1,1,1};
         glm::quat rotationQuat{0,0,0,1};
+        // world matrix of the last rebuild, valid while not dirty and the owner kept its parent
+        glm::mat4 worldMatrix{1};
+        Object* worldParent = nullptr;
+        bool dirty = true;
+        public:
+        Object* parent = nullptr;
 
         class Position {
             public:
@@ -132,7 +216,16 @@ namespace volchara {
             rotation = Rotation(this);
         }
 
-        glm::mat4 modelMatrix();
+        const glm::vec3& getTranslation() const;
+        const glm::vec3& getScaling() const;
+        const glm::quat& getRotation() const;
+        void setTranslation(glm::vec3 newTranslation);
+        void setScaling(glm::vec3 newScaling);
+        void setRotation(glm::quat newRotation);
+        // Marks this transform and every child as needing a rebuild
+        void invalidate();
+        // Rebuilt from the parent's world matrix only when something up the chain changed
+        const glm::mat4& modelMatrix();
     };
 
     class CameraTransform : public Transform {
@@ -140,41 +233,63 @@ namespace volchara {
             glm::mat4 modelMatrix();
     };
 
+    // Shared by every callback of a simulation tick, pressedKeys is only valid during the callback
     struct FrameCallbackData {
         float passedSeconds;
-        std::set<int> pressedKeys;
+        const std::set<int>& pressedKeys;
         glm::vec2 cursorOffset;
     };
 
     class Object {
+    private:
+        // read into the scene's batches, changed through replaceMesh and the setters
+        std::shared_ptr<Mesh> mesh;
+        float alphaCutoff = 0.0;
+        bool transparent = false;
+        // each non-zero index holds a reference on its renderer texture, changed through setTextures
+        uint32_t textureIndex = 0;
+        uint32_t normalIndex = 0;
+        uint32_t emissiveIndex = 0;
     public:
         Object* parent = nullptr;
         std::vector<Object*> children;
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
+        // set while the object holds a reference to its mesh geometry in the renderer
+        bool resident = false;
+        // entry of the object in the renderer's scene, nullptr while it is not added
+        SceneRegistry* scene = nullptr;
+        uint32_t sceneIndex = 0;
         std::vector<std::function<void(Object*, FrameCallbackData)>> frameCallbacks{};
         Transform transform = Transform(this);
-        Renderer* renderer;
-        uint32_t textureIndex = 0;
-        uint32_t normalIndex = 0;
-        uint32_t emissiveIndex = 0;
-        float alphaCutoff = 0.0;
-        bool transparent = false;
+        Renderer* renderer = nullptr;
 
         Object(Renderer &renderer, std::vector<Vertex> initVertices, std::vector<uint32_t> initIndices = {}, glm::vec3 translation = {0, 0, 0}, glm::vec3 scaling = {1, 1, 1}, glm::quat rotation = {1,0,0,0});
-        virtual ~Object() = default;  // for RTTI and callback polymorphism
+        virtual ~Object();  // for RTTI and callback polymorphism
         Object(Object& other) = delete;
         Object(Object&& other);
         void runFrameCallbacks(FrameCallbackData cbData);
+        // Reparenting through these keeps the renderer's scene in sync
+        void addChild(Object* child);
+        void removeChild(Object* child);
         void setColor(std::array<float, 3> color);
         void replaceTextures(const std::filesystem::path path);
+        void setTextures(uint32_t newTextureIndex, uint32_t newNormalIndex, uint32_t newEmissiveIndex);
+        uint32_t getTextureIndex() const;
+        uint32_t getNormalIndex() const;
+        uint32_t getEmissiveIndex() const;
         void generateIndices(std::vector<Vertex> fromVertices);
+        const std::shared_ptr<Mesh>& getMesh() const;
+        // Swaps geometry without touching the old mesh, its other users keep it
+        void replaceMesh(std::shared_ptr<Mesh> newMesh);
+        float getAlphaCutoff() const;
+        bool isTransparent() const;
+        void setAlphaCutoff(float newAlphaCutoff);
+        void setTransparent(bool newTransparent);
     };
 
     class Camera : public Object {
         public:
             Camera(Renderer& renderer) : Object(renderer, {}) {
-                transform.rotationQuat = glm::toQuat(glm::lookAt(glm::vec3{0, 0, 1}, {0, 0, 0}, {0, 1, 0}));
+                transform.setRotation(glm::toQuat(glm::lookAt(glm::vec3{0, 0, 1}, {0, 0, 0}, {0, 1, 0})));
             }
     };
 
@@ -186,7 +301,7 @@ namespace volchara {
 
     class GLTFModel : public Object {
         private:
-            static Object* traverseNode(Renderer &renderer, tinygltf::Model& model, int nodeId, std::map<int, int>& textureMapping);
+            static Object* traverseNode(Renderer &renderer, const ModelData& model, const std::string& modelName, uint32_t nodeId, const std::vector<uint32_t>& textureMapping);
         public:
             static Object fromFile(Renderer& renderer, std::filesystem::path modelPath);
             GLTFModel(Renderer& renderer, std::vector<Vertex> vertices, std::vector<uint32_t> indices = {}, glm::vec3 translation = {0, 0, 0}, glm::vec3 scaling = {1, 1, 1}, glm::quat rotation = {1,0,0,0}) : Object(renderer, vertices, indices, translation, scaling, rotation) {};
@@ -1,11 +1,49 @@
 #pragma once
 
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include <vulkan/vulkan_raii.hpp>
 #include <vk_mem_alloc.hpp>
 
 #include <device_buffer_copy_handler.hpp>
 
 namespace volchara {
+    const vk::DeviceSize STAGING_RING_SIZE = 33554432;
+
+    struct StagingAllocation {
+        vk::Buffer buffer = nullptr;
+        vk::DeviceSize offset = 0;
+    };
+
+    class StagingRing {
+        private:
+        struct Region {
+            vk::DeviceSize begin;
+            vk::DeviceSize end;
+            UploadTicket ticket;
+        };
+        vma::Allocator allocator;
+        DeviceBufferCopyHandler* copyHandler = nullptr;
+        vk::Buffer buf = nullptr;
+        vma::Allocation alloc = nullptr;
+        unsigned char* mapped = nullptr;
+        vk::DeviceSize capacity = 0;
+        std::deque<Region> regions;
+        void reclaim();
+        std::optional<vk::DeviceSize> findSpace(vk::DeviceSize size, vk::DeviceSize alignment);
+        StagingAllocation stageDedicated(const void* data, vk::DeviceSize size);
+        public:
+        StagingRing(vma::Allocator fromAllocator, DeviceBufferCopyHandler& handler, vk::DeviceSize size);
+        ~StagingRing();
+        StagingRing(StagingRing&) = delete;
+        StagingRing& operator=(StagingRing&) = delete;
+        // Copies data into the ring, the space is reused once the upload batch it belongs to completes
+        StagingAllocation stage(const void* data, vk::DeviceSize size, vk::DeviceSize alignment = 16);
+    };
+
     class RAIIvmaBuffer {
         private:
         vk::raii::Device* dev = nullptr;
@@ -14,8 +52,9 @@ namespace volchara {
         vma::Allocation alloc = nullptr;
         bool mappable = false;
         DeviceBufferCopyHandler* copyHandler = nullptr;
+        StagingRing* staging = nullptr;
         public:
-        RAIIvmaBuffer(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::BufferCreateInfo bufferInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler);
+        RAIIvmaBuffer(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::BufferCreateInfo bufferInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler, StagingRing& stagingRing);
         RAIIvmaBuffer(nullptr_t) {}
         ~RAIIvmaBuffer();
         RAIIvmaBuffer(RAIIvmaBuffer&) = delete;
@@ -24,7 +63,7 @@ namespace volchara {
         const RAIIvmaBuffer& operator=(RAIIvmaBuffer&& other);
         operator vk::Buffer() const;
         operator vma::Allocation() const;
-        void copyFrom(void* buffer, uint32_t size);
+        void copyFrom(const void* buffer, uint32_t size, vk::DeviceSize dstOffset = 0);
         vma::AllocationInfo allocInfo();
         static void swap(RAIIvmaBuffer& lhs, RAIIvmaBuffer& rhs);
     };
@@ -38,9 +77,11 @@ namespace volchara {
         vma::Allocation alloc = nullptr;
         bool mappable = false;
         DeviceBufferCopyHandler* copyHandler = nullptr;
+        StagingRing* staging = nullptr;
         vk::Extent3D imageExtent;
+        uint32_t mipLevels = 1;
         public:
-        RAIIvmaImage(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::ImageCreateInfo imageInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler, vk::ImageAspectFlags aspectFlags);
+        RAIIvmaImage(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::ImageCreateInfo imageInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler, StagingRing& stagingRing, vk::ImageAspectFlags aspectFlags);
         RAIIvmaImage(nullptr_t) {}
         ~RAIIvmaImage();
         RAIIvmaImage(RAIIvmaImage&) = delete;
@@ -49,16 +90,27 @@ namespace volchara {
         const RAIIvmaImage& operator=(RAIIvmaImage&& other);
         operator vk::Image() const;
         operator vma::Allocation() const;
-        void copyFrom(void* buffer, uint32_t size);
+        void copyFrom(const void* buffer, uint32_t size);
+        // Region offsets are relative to buffer, levels without a region are left for the caller to fill
+        void copyLevels(const void* buffer, uint32_t size, std::vector<vk::BufferImageCopy> regions, vk::ImageLayout finalLayout);
+        uint32_t levels() const;
+        vk::DeviceSize memorySize();
         const vk::ImageView imageView();
         static void swap(RAIIvmaImage& lhs, RAIIvmaImage& rhs);
     };
 
+    // Summed over the device-local heaps
+    struct MemoryBudget {
+        vk::DeviceSize usage = 0;
+        vk::DeviceSize budget = 0;
+    };
+
     class RAIIAllocator {
         private:
         vma::Allocator vmaAlloc;
         vk::raii::Device* dev = nullptr;
         DeviceBufferCopyHandler* copyHandler = nullptr;
+        std::unique_ptr<StagingRing> staging;
         public:
         RAIIAllocator(vk::raii::Instance& inst, vk::raii::PhysicalDevice& physDev, vk::raii::Device& dev, DeviceBufferCopyHandler& handler);
         RAIIAllocator( nullptr_t ) {}
@@ -70,5 +122,6 @@ namespace volchara {
 
         RAIIvmaBuffer createBuffer(vk::BufferCreateInfo bufferInfo, vma::AllocationCreateInfo allocInfo);
         RAIIvmaImage createImage(vk::ImageCreateInfo imageInfo, vma::AllocationCreateInfo allocInfo, vk::ImageAspectFlags aspectFlags);
+        MemoryBudget deviceLocalBudget();
     };
-}
\ No newline at end of file
+}
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -14,10 +28,20 @@
 
 #include <GLFW/glfw3.h>
 
+#include <tracy/TracyVulkan.hpp>
+
 #include <glm/glm.hpp>
 
+#include <frame_graph.hpp>
+#include <frame_pacer.hpp>
+#include <geometry_pool.hpp>
+#include <job_system.hpp>
+#include <mapped_file.hpp>
+#include <model_data.hpp>
 #include <objects.hpp>
 #include <raii_wrappers.hpp>
+#include <scene_registry.hpp>
+#include <texture_data.hpp>
 
 
 namespace volchara {
@@ -26,10 +50,46 @@ namespace volchara {
 
     const int MAX_FRAMES_IN_FLIGHT = 2;
     const int MAX_FRAMERATE = 60;
+    // frame callbacks run at this rate on the simulation thread, independent of the frame rate
+    const int SIMULATION_TICK_RATE = 60;
+    const int MAX_SIMULATION_CATCHUP_TICKS = 5;
+    const uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+    // draw counts of the color and transparency subpasses, the commands follow them
+    const vk::DeviceSize INDIRECT_COMMANDS_OFFSET = 16;
+    // screen-space error a coarser LOD may show before the cull pass keeps a finer one, in pixels
+    const float LOD_PIXEL_ERROR = 1.0f;
+    // lowest fraction of the swapchain size per axis dynamic resolution renders at
+    const float MIN_RENDER_SCALE = 0.5f;
+    // share of the distance to the budgeted scale covered each frame, single slow frames barely move it
+    const float RENDER_SCALE_RESPONSE = 0.1f;
+    // smaller draw lists are not worth handing to another thread
+    const uint32_t MIN_DRAWS_PER_RECORDING_TASK = 64;
+    // upper bound of the bindless table, drivers reporting millions of descriptors would waste pool memory
+    const uint32_t MAX_BINDLESS_TEXTURES = 16384;
+    // the lights buffer holds a header followed by this many lights before it has to grow
+    const uint32_t INITIAL_LIGHT_CAPACITY = 64;
+    // screen tiles by exponential depth slices, must match the constants of the lighting shaders
+    const uint32_t LIGHT_CLUSTERS_X = 16;
+    const uint32_t LIGHT_CLUSTERS_Y = 9;
+    const uint32_t LIGHT_CLUSTERS_Z = 24;
+    const uint32_t LIGHT_CLUSTER_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+    const uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+    const uint32_t PIPELINE_CACHE_MAGIC = 0x43504C56;  // "VLPC"
+
+    // Written in front of the driver's cache data, a cache from another device or driver is thrown away
+    struct PipelineCachePrefix {
+        uint32_t magic = PIPELINE_CACHE_MAGIC;
+        uint32_t vendorID = 0;
+        uint32_t deviceID = 0;
+        uint32_t driverVersion = 0;
+        std::array<uint8_t, VK_UUID_SIZE> pipelineCacheUUID{};
+        uint64_t dataSize = 0;
+    };
 
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        std::optional<uint32_t> transferFamily;
 
         bool isComplete() {
             return graphicsFamily.has_value() && presentFamily.has_value();
@@ -54,18 +114,144 @@ namespace volchara {
         bool culling = true;
         DebugViewMode viewMode = DebugViewMode::OFF;
         bool lightning = true;
+        bool instancing = true;
+        bool gpuCulling = true;
+        bool lods = true;
+    };
+
+    enum class GBufferFormat {
+        // RGBA16F normals and RGBA8 emissive
+        eFull,
+        // octahedral RG16F normals and R11G11B10F emissive where supported, base.frag and light.frag are specialized for it
+        ePacked,
+    };
+
+    // Specialization constants of base.frag and light.frag
+    struct GBufferSpecialization {
+        vk::Bool32 packedNormals = false;
+    };
+
+    // Frame pacing, can be changed at runtime through Renderer::applySettings
+    struct RendererSettings {
+        // falls back to FIFO when the surface doesn't support it
+        vk::PresentModeKHR presentMode = vk::PresentModeKHR::eMailbox;
+        // frames per second, 0 leaves the rate to the present mode
+        float frameCap = MAX_FRAMERATE;
+        // about a third of the full vertex size, only read when the renderer is created
+        VertexFormat vertexFormat = VertexFormat::eFull;
+        // only read when the renderer is created
+        GBufferFormat gBufferFormat = GBufferFormat::eFull;
+        // no window, frames go to offscreen images and are driven by Renderer::renderFrame, only read when the renderer is created
+        bool headless = false;
+        // renders into a corner of the attachments sized to hold gpuFrameBudgetMs and upscales it to the swapchain, only read when the renderer is created
+        bool dynamicResolution = false;
+        // GPU time per frame the render scale is adjusted to
+        float gpuFrameBudgetMs = 1000.0f / MAX_FRAMERATE;
+
+        // Renders as fast as possible, for measuring frame times
+        static RendererSettings uncapped() {
+            return {.presentMode = vk::PresentModeKHR::eImmediate, .frameCap = 0};
+        }
+    };
+
+    // Timestamps written into every frame's command buffer, each pass spans from the previous one to its own
+    enum FrameTimestamp : uint32_t {
+        FRAME_BEGIN,
+        CULLING_END,
+        COLOR_END,
+        LIGHT_END,
+        TRANSPARENCY_END,
+        FRAME_TIMESTAMP_COUNT,
+    };
+
+    // Figures of the latest frame whose GPU work has finished, times stay 0 without timestamp support
+    struct RendererStats {
+        // mipmap generation, instance culling and light binning before the render pass
+        float cullingMs = 0;
+        float colorMs = 0;
+        float lightMs = 0;
+        float transparencyMs = 0;
+        float gpuFrameMs = 0;
+        // fraction of the swapchain size per axis the frame is rendered at
+        float renderScale = 1;
+        // frame graph passes dropped because nothing read their results
+        uint32_t culledPassCount = 0;
+        uint32_t drawCount = 0;
+        // submitted before GPU culling, an upper bound of what is rasterized
+        uint64_t triangleCount = 0;
+        MemoryBudget deviceMemory;
+    };
+
+    // One LOD of an instance group, every LOD of the group is drawn from its own slice of the visible instances
+    struct InstancedDraw {
+        GeometryRange geometry;
+        uint32_t firstInstance = 0;
+        uint32_t instanceCount = 0;
+        uint32_t lod = 0;
+    };
+
+    // Slice of a subpass draw list recorded into its own secondary command buffer
+    struct RecordingTask {
+        uint32_t subpass = 0;
+        uint32_t firstDraw = 0;
+        uint32_t drawCount = 0;
+    };
+
+    // Texture whose first level is uploaded, the rest of the chain is blitted on the graphics queue
+    struct PendingMipmaps {
+        vk::Image image = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 1;
+    };
+
+    // Encoded texture bytes, file keeps a mapping alive while they are read
+    struct TextureSource {
+        MappedFile file = nullptr;
+        std::span<const unsigned char> bytes;
+    };
+
+    // Texture decoded on a loading thread, waiting for its upload on the main one
+    struct LoadedTexture {
+        uint32_t textureIndex = 0;
+        TextureHash contentHash;
+        // results for a slot that was unloaded and reused meanwhile are dropped
+        uint32_t generation = 0;
+        TextureData data;
+        std::exception_ptr error;
+    };
+
+    // Secondary command buffers of one worker thread for one frame in flight
+    struct RecordingPool {
+        vk::raii::CommandPool pool = nullptr;
+        std::vector<vk::raii::CommandBuffer> buffers;
+        uint32_t usedBuffers = 0;
     };
 
     class Renderer {
         friend class volchara::Object;
         friend class volchara::GLTFModel;
 
-        uint32_t maxTextures = 64;
+        // size of the bindless table, picked from the device limits
+        uint32_t maxTextures = 0;
 
         public:
-            Renderer();
+            Renderer(RendererSettings initSettings = {});
+            ~Renderer();
             void init();
             void run();
+            // Runs one simulation tick of tickSeconds on the calling thread and renders a frame, for headless renderers
+            void renderFrame(float tickSeconds);
+            // A present mode change recreates the swapchain before the next frame
+            void applySettings(RendererSettings newSettings);
+            const RendererSettings& getSettings() const;
+            // Updated while the simulation thread waits, frame callbacks can read it
+            RendererStats getStats() const;
+            // Objects whose world bounds touch the sphere, for frame callbacks, sees the transforms as they are set right now
+            std::vector<Object*> queryRadius(glm::vec3 center, float radius);
+            std::vector<Object*> queryBox(glm::vec3 min, glm::vec3 max);
+            // Closest object whose bounds the ray enters and the distance to them
+            std::optional<std::pair<Object*, float>> raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance = std::numeric_limits<float>::infinity());
             const std::filesystem::path& getResourceDir();
             void addObject(volchara::Object* obj);
             void delObject(volchara::Object* obj);
@@ -75,8 +261,14 @@ namespace volchara {
             Box objBoxFromWorldCoordinates(InitDataBox vertices);
             void setAmbientLight(InitDataLight data);
             DirectionalLight objDirectionalLightFromWorldCoordinates(InitDataLight data);
-            void preloadTexture(std::filesystem::path texturePath);
+            // Loading continues in the background, the texture index samples the fallback until it is resident
+            uint32_t preloadTexture(std::filesystem::path texturePath);
+            // The model is parsed in the background, creating an object from it waits for the parse only
             void preloadModel(std::filesystem::path modelPath);
+            // Evicts the texture right away if no object uses it, otherwise it stays until the last user lets go
+            void unloadTexture(std::filesystem::path texturePath);
+            // Unused textures are evicted while device-local usage is above it, 0 keeps 90% of VMA's heap budget
+            void setTextureBudget(vk::DeviceSize bytes);
 
             static std::vector<unsigned char> readFile(const std::filesystem::path filename, bool asText = false) {
                 std::ifstream file(filename, std::ios::ate | (asText ? 0 : std::ios::binary));
@@ -137,9 +329,12 @@ namespace volchara {
                 return deviceFeatures.features.samplerAnisotropy && deviceFeatures.features.fillModeNonSolid;
             }
             static bool hasRequiredPhysicalDeviceDescriptorFeatures(vk::PhysicalDeviceDescriptorIndexingFeaturesEXT deviceFeatures) {
-                return deviceFeatures.descriptorBindingPartiallyBound && deviceFeatures.descriptorBindingSampledImageUpdateAfterBind && deviceFeatures.descriptorBindingVariableDescriptorCount && deviceFeatures.runtimeDescriptorArray;
+                return deviceFeatures.descriptorBindingPartiallyBound && deviceFeatures.descriptorBindingSampledImageUpdateAfterBind && deviceFeatures.descriptorBindingUpdateUnusedWhilePending && deviceFeatures.descriptorBindingVariableDescriptorCount && deviceFeatures.runtimeDescriptorArray;
+            }
+            static bool hasRequiredPhysicalDeviceTimelineFeatures(vk::PhysicalDeviceTimelineSemaphoreFeatures deviceFeatures) {
+                return deviceFeatures.timelineSemaphore;
             }
-            GLFWwindow* window;
+            GLFWwindow* window = nullptr;
         
             vk::raii::Context context;
             vk::raii::Instance instance = nullptr;
@@ -150,6 +345,8 @@ namespace volchara {
             vk::PhysicalDeviceProperties physicalDeviceProperties;
             vk::raii::Device device = nullptr;
 
+            // held around every submit and present, the queues may be one VkQueue and the simulation thread submits uploads
+            std::mutex queueMutex;
             DeviceBufferCopyHandler deviceBufferCopyHandler = nullptr;
             RAIIAllocator allocator = nullptr;
         
@@ -158,54 +355,158 @@ namespace volchara {
         
             vk::raii::SwapchainKHR swapChain = nullptr;
             std::vector<vk::Image> swapChainImages;
+            // stand in for the swapchain images of a headless renderer, one per frame in flight
+            std::vector<RAIIvmaImage> offscreenImages;
             vk::Format swapChainImageFormat;
             vk::Extent2D swapChainExtent;
+            // the rendered corner of the attachments, the swapchain extent without dynamic resolution
+            vk::Extent2D renderExtent;
+            float renderScale = 1;
+            vk::Filter upscaleFilter = vk::Filter::eLinear;
             std::vector<vk::raii::ImageView> swapChainImageViews;
             std::vector<vk::raii::Framebuffer> swapChainFramebuffers;
+            // what a swapchain generation owns, kept until no frame in flight can still use it
+            struct RetiredSwapChain {
+                vk::raii::SwapchainKHR swapChain = nullptr;
+                std::vector<vk::raii::ImageView> imageViews;
+                std::vector<RAIIvmaImage> attachments;
+                std::vector<vk::raii::Framebuffer> framebuffers;
+                vk::raii::DescriptorPool descriptorPool = nullptr;
+                std::vector<vk::raii::DescriptorSet> descriptorSets;
+            };
         
             vk::raii::RenderPass renderPass = nullptr;
             vk::raii::DescriptorSetLayout descriptorSetLayoutUBO = nullptr;
             vk::raii::DescriptorSetLayout descriptorSetLayoutTextures = nullptr;
             vk::raii::DescriptorSetLayout descriptorSetLayoutSSBO = nullptr;
             vk::raii::DescriptorSetLayout descriptorSetLayoutLightSubpass = nullptr;
+            vk::raii::DescriptorSetLayout descriptorSetLayoutResolveSubpass = nullptr;
+            vk::raii::DescriptorSetLayout descriptorSetLayoutInstances = nullptr;
             vk::raii::PipelineLayout colorPipelineLayout = nullptr;
             vk::raii::PipelineLayout lightPipelineLayout = nullptr;
             vk::raii::PipelineLayout transparencyPipelineLayout = nullptr;
+            vk::raii::PipelineLayout resolvePipelineLayout = nullptr;
+            vk::raii::PipelineCache pipelineCache = nullptr;
             vk::raii::Pipeline colorGraphicsPipeline = nullptr;
             vk::raii::Pipeline lightGraphicsPipeline = nullptr;
             vk::raii::Pipeline transparencyGraphicsPipeline = nullptr;
+            vk::raii::Pipeline resolveGraphicsPipeline = nullptr;
+            vk::raii::PipelineLayout cullPipelineLayout = nullptr;
+            vk::raii::Pipeline cullPipeline = nullptr;
+            vk::raii::PipelineLayout lightCullPipelineLayout = nullptr;
+            vk::raii::Pipeline lightCullPipeline = nullptr;
+            bool supportsDrawIndirectCount = false;
+            bool supportsMultiDrawIndirect = false;
+            bool supportsDrawIndirectFirstInstance = false;
+            // tiled GPUs back transient attachments with on-chip memory only
+            bool supportsLazyAllocation = false;
         
             vk::raii::CommandPool commandPool = nullptr;
             std::vector<vk::raii::CommandBuffer> commandBuffers;
+            // FRAME_TIMESTAMP_COUNT queries per frame in flight
+            vk::raii::QueryPool timestampQueryPool = nullptr;
+            bool supportsTimestamps = false;
+            uint64_t timestampMask = 0;
+            std::array<bool, MAX_FRAMES_IN_FLIGHT> timestampsWritten{};
+            TracyVkCtx tracyContext = nullptr;
+            RendererStats stats;
+            std::unique_ptr<JobSystem> recordingJobs;
+            // frame in flight * thread count + thread slot
+            std::vector<RecordingPool> recordingPools;
+            std::vector<RecordingTask> recordingTasks;
+            std::vector<vk::CommandBuffer> recordedBuffers;
+            // declared again by every recorded frame
+            FrameGraph frameGraph;
         
             std::vector<vk::raii::Semaphore> imageAvailableSemaphores;
             std::vector<vk::raii::Semaphore> renderFinishedSemaphores;
             std::vector<vk::raii::Fence> inFlightFences;
             uint32_t currentFrame = 0;
-            std::chrono::time_point<std::chrono::steady_clock> lastFrameTime = std::chrono::steady_clock::now();
+            // guards everything frame callbacks may touch, held by a simulation tick or by a frame up to its submit
+            std::mutex simulationMutex;
+            std::thread simulationThread;
+            std::atomic<bool> simulationRunning = false;
+            std::set<int> simulationKeys;
+            glm::vec2 simulationCursorOffset{0, 0};
+            // world matrices after the last two ticks, frames are drawn between them
+            std::array<std::vector<glm::mat4>, 2> tickWorlds;
+            std::array<glm::mat4, 2> tickCameras{glm::mat4{1}, glm::mat4{1}};
+            std::array<uint64_t, 2> tickLayouts{0, 0};
+            uint32_t currentTick = 0;
+            std::chrono::time_point<std::chrono::steady_clock> lastTickTime = std::chrono::steady_clock::now();
+            RendererSettings settings;
+            FramePacer framePacer;
         
-            RAIIvmaBuffer stagingBuffer = nullptr;
-            RAIIvmaBuffer vertexBuffer = nullptr;
-            RAIIvmaBuffer indexBuffer = nullptr;
+            GeometryPool geometryPool = nullptr;
+            // frames handed to the queue so far, counted under simulationMutex right at the submit
+            uint64_t submittedFrames = 0;
+            // the frame last submitted from each slot, and the newest one whose fence has been waited on
+            std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> slotFrames{};
+            uint64_t completedFrames = 0;
+            // tagged with the last submitted frame when queued, released once that frame has completed
+            std::deque<std::pair<uint64_t, std::function<void()>>> deletionQueue;
+            // swapchain recreation queues from outside simulationMutex
+            std::mutex deletionMutex;
             RAIIvmaBuffer ssboBuffer = nullptr;
+            uint32_t lightCapacity = 0;
+            // per-cluster light counts followed by their index lists, written by the light cull pass
+            std::vector<RAIIvmaBuffer> lightClusterBuffers;
             std::vector<RAIIvmaBuffer> uniformBuffers;
+            std::vector<RAIIvmaBuffer> instanceBuffers;
+            std::vector<RAIIvmaBuffer> indirectBuffers;
+            std::vector<RAIIvmaBuffer> visibleInstanceBuffers;
+            std::vector<uint32_t> instanceBufferCapacities;
             std::vector<RAIIvmaImage> depthBuffers;
             std::vector<RAIIvmaImage> emissiveBuffers;
             std::vector<RAIIvmaImage> normalBuffers;
             std::vector<RAIIvmaImage> intermediateColorBuffers;
+            // weighted-blended transparency targets, read back by the resolve subpass
+            std::vector<RAIIvmaImage> accumulationBuffers;
+            std::vector<RAIIvmaImage> revealageBuffers;
+            // the pass renders here instead of the swapchain image while dynamic resolution is on
+            std::vector<RAIIvmaImage> sceneColorBuffers;
 
             vk::raii::DescriptorPool descriptorPool = nullptr;
+            // input attachment sets are replaced with the swapchain, their pool goes with them
+            vk::raii::DescriptorPool attachmentDescriptorPool = nullptr;
             std::vector<vk::raii::DescriptorSet> descriptorSetsUBO;
             std::vector<vk::raii::DescriptorSet> descriptorSetsTextures;
             std::vector<vk::raii::DescriptorSet> descriptorSetsSSBO;
+            // one per swapchain image, like the attachments they read
             std::vector<vk::raii::DescriptorSet> descriptorSetsLightSubpass;
+            std::vector<vk::raii::DescriptorSet> descriptorSetsResolveSubpass;
+            std::vector<vk::raii::DescriptorSet> descriptorSetsInstances;
 
             PushConstants pushConstants;
 
             vk::raii::Sampler textureSampler = nullptr;
-            std::vector<RAIIvmaImage> textures;
+            // slots with identical contents share one image
+            std::vector<std::shared_ptr<RAIIvmaImage>> textures;
+            // false while the texture is still loading, its objects sample texture 0 meanwhile
+            std::vector<uint8_t> textureResident;
+            std::vector<uint32_t> textureGenerations;
+            std::vector<uint32_t> freeTextureSlots;
+            // objects holding the slot, at zero it moves to unusedTextures in least recently released order
+            std::vector<uint32_t> textureRefs;
+            std::deque<uint32_t> unusedTextures;
+            std::vector<std::string> textureKeys;
+            std::vector<TextureHash> textureHashes;
+            std::unordered_map<TextureHash, uint32_t, TextureHashHasher> textureHashToId;
+            vk::DeviceSize textureBudget = 0;
+            vk::DeviceSize evictingBytes = 0;
+            uint64_t textureResidencyVersion = 0;
+            uint64_t batchedTextureVersion = 0;
+            std::vector<PendingMipmaps> pendingMipmaps;
+            // keyed by the normalized path, or model and image index for embedded images
             std::map<std::string, int> textureNameToId;
-            std::map<std::string, tinygltf::Model> modelCache;
+            std::map<std::string, std::shared_ptr<ModelData>> modelCache;
+            std::map<std::string, std::shared_future<std::shared_ptr<ModelData>>> pendingModels;
+            std::mutex loadedTexturesMutex;
+            std::vector<LoadedTexture> loadedTextures;
+            // declared after everything its tasks write to, so it is joined first
+            std::unique_ptr<JobSystem> loadingJobs;
+            // "model:mesh index" -> mesh shared by every instance of that node
+            std::map<std::string, std::shared_ptr<Mesh>> meshCache;
         
             std::set<int> pressedKeys;
             glm::vec2 cursorOffset;
@@ -214,7 +515,20 @@ namespace volchara {
             float mouseSensitivity = 1.0f;
         
             std::vector<volchara::Object*> objects {};
-            volchara::GPULightsBuffer lights {};
+            SceneRegistry scene;
+            // draw batches of the scene, rebuilt only when its render data or instancing changes
+            uint64_t batchedSceneVersion = 0;
+            bool batchedInstancing = true;
+            std::vector<uint32_t> batchedEntries;
+            std::vector<GPUInstance> batchedInstances;
+            std::vector<InstancedDraw> opaqueDraws;
+            std::vector<InstancedDraw> transparentDraws;
+            std::vector<vk::DrawIndexedIndirectCommand> drawCommands;
+            // per draw, filled from the spatial index when the cull pass can't drop instances, empty draws everything
+            std::vector<uint8_t> visibleDraws;
+            std::vector<uint32_t> visibleEntries;
+            volchara::GPULightHeader lightsHeader {};
+            std::vector<volchara::GPULight> lights;
         
             bool framebufferResized = false;
         
@@ -243,7 +557,13 @@ namespace volchara {
                 app->framebufferResized = true;
             }
 
-            void putObjectsToBuffer();
+            void putObjectToBuffer(volchara::Object* obj);
+            void removeObjectFromBuffer(volchara::Object* obj);
+            void acquireGeometry(volchara::Object* obj);
+            void releaseGeometry(volchara::Object* obj);
+            void waitForFramesInFlight();
+            void deferUntilFrameComplete(std::function<void()> release);
+            void runDeletionQueue();
             void putLightsToBuffer();
             void initWindow();
             void initVulkan();
@@ -255,6 +575,8 @@ namespace volchara {
             void setupDebugMessenger();
             void createSurface();
             QueueFamilyIndices findQueueFamilies(vk::raii::PhysicalDevice device);
+            std::vector<const char*> requiredDeviceExtensions();
+            void createOffscreenImages();
             bool checkDeviceExtensionSupport(vk::raii::PhysicalDevice device);
             SwapChainSupportDetails querySwapChainSupport(vk::raii::PhysicalDevice device);
             bool isDeviceSuitable(vk::raii::PhysicalDevice device);
@@ -266,22 +588,65 @@ namespace volchara {
             vk::SurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<vk::SurfaceFormatKHR>& availableFormats);
             vk::PresentModeKHR chooseSwapPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes);
             vk::Extent2D chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities);
-            void createSwapChain();
+            void createSwapChain(vk::SwapchainKHR oldSwapChain = nullptr);
             vk::raii::ImageView createImageView(const vk::Image& image, vk::Format format);
             void createImageViews();
             vk::Format findSupportedFormat(const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features);
+            vk::Format findNormalFormat();
+            vk::Format findEmissiveFormat();
             vk::Format findDepthFormat();
             void createRenderPass();
             void createDescriptorSetLayout();
             vk::raii::ShaderModule createShaderModule(const std::vector<unsigned char>& code);
+            std::filesystem::path pipelineCachePath();
+            PipelineCachePrefix pipelineCachePrefix();
+            void createPipelineCache();
+            void savePipelineCache();
             void createGraphicsPipeline();
             void createCommandPool();
-            void createStagingBuffer(uint32_t size);
-            void createVertexBuffer(uint32_t size);
-            void createIndexBuffer(uint32_t size);
+            void createGeometryPool(uint32_t vertexCount, uint32_t indexCount);
             void createUniformBuffers();
-            void createSSBOBuffer(uint32_t size);
-            RAIIvmaImage createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::ImageAspectFlags aspectFlags = vk::ImageAspectFlagBits::eColor);
+            void createInstanceBuffers();
+            void allocateInstanceBuffers(uint32_t frame, uint32_t capacity);
+            void growInstanceBuffer(uint32_t frame, uint32_t minCapacity);
+            void writeInstanceDescriptor(uint32_t frame);
+            std::vector<InstancedDraw> collectDraws(bool transparent, uint32_t firstDraw);
+            void rebuildBatches();
+            // Brings the scene's entries, matrices and spatial index up to date with the objects
+            void syncScene();
+            void updateBatches();
+            void markVisibleDraws();
+            void startSimulation();
+            void stopSimulation();
+            void simulationLoop();
+            void runSimulationTick(float tickSeconds);
+            bool ticksInterpolatable() const;
+            float tickBlend() const;
+            static glm::mat4 interpolateMatrix(const glm::mat4& from, const glm::mat4& to, float blend);
+            void createTimestampQueries();
+            void writeFrameTimestamp(uint32_t bufferIndex, FrameTimestamp timestamp);
+            void readFrameTimestamps(uint32_t frame);
+            void createCullPipeline();
+            void recordCulling(uint32_t bufferIndex, uint32_t instanceCount, bool indirect);
+            // Viewport, scissor and raster state of the inline fullscreen subpasses
+            void recordFullscreenState(vk::raii::CommandBuffer& commandBuffer);
+            // The render pass with its four subpasses, one graph pass
+            void recordScenePass(uint32_t imageIndex, uint32_t bufferIndex, uint32_t opaqueTasks);
+            // Stretches the rendered corner of the scene color over the whole swapchain image, the graph places its barriers
+            void recordUpscale(uint32_t imageIndex, uint32_t bufferIndex);
+            void recordDraws(vk::raii::CommandBuffer& commandBuffer, uint32_t bufferIndex, const InstancedDraw* draws, uint32_t drawCount, uint32_t firstDraw, uint32_t countIndex, bool indirect);
+            void createRecordingPools();
+            void splitRecordingTasks(uint32_t subpass, uint32_t drawCount, bool splittable);
+            vk::CommandBuffer recordSubpassDraws(const RecordingTask& task, uint32_t slot, uint32_t imageIndex, uint32_t bufferIndex, bool indirect);
+            void createSSBOBuffer(uint32_t capacity);
+            void createLightClusterBuffers();
+            void writeLightsDescriptors();
+            void createLightCullPipeline();
+            void recordLightCulling(uint32_t bufferIndex);
+            RAIIvmaImage createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::ImageAspectFlags aspectFlags = vk::ImageAspectFlagBits::eColor, uint32_t mipLevels = 1);
+            // Swapchain-sized image only read within the render pass, lazily allocated where the device allows
+            RAIIvmaImage createTransientAttachment(vk::Format format, vk::ImageUsageFlags usage, vk::ImageAspectFlags aspectFlags = vk::ImageAspectFlagBits::eColor);
+            void recordMipmapGeneration(uint32_t bufferIndex);
             vk::raii::CommandBuffer beginSingleTimeCommands();
             void endSingleTimeCommands(vk::raii::CommandBuffer& buffer);
             void transitionImageLayout(const vk::Image& image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
@@ -289,17 +654,40 @@ namespace volchara {
             void createEmissiveResources();
             void createNormalResources();
             void createIntermediateColorResources();
+            void createTransparencyResources();
+            void createSceneColorResources();
             void createFramebuffers();
-            uint32_t createTextureImage(std::vector<unsigned char> textureData);
+            uint32_t createTextureImage(std::span<const unsigned char> textureData);
+            void uploadTexture(uint32_t textureIndex, TextureData& texture);
+            void createLoadingJobs();
+            // Reads and decodes on a loading thread, textures are deduplicated by name
+            uint32_t loadTexture(std::filesystem::path texturePath);
+            // textureData must outlive the load, e.g. a buffer of a cached model
+            uint32_t loadTexture(const std::string& name, std::span<const unsigned char> textureData);
+            uint32_t reserveTexture(const std::string& key, std::function<TextureSource()> open);
+            uint32_t allocateTextureSlot();
+            void releaseTexture(uint32_t textureIndex);
+            void retainTexture(uint32_t textureIndex);
+            void releaseTextureReference(uint32_t textureIndex);
+            void evictUnusedTextures();
+            void evictTexture(uint32_t textureIndex);
+            void processLoadedTextures();
+            uint32_t resolveTexture(uint32_t textureIndex) const;
+            const ModelData& loadModel(std::filesystem::path modelPath);
             void createDescriptorPool();
             void createDescriptorSets();
+            void createAttachmentDescriptorSets();
             uint32_t loadTextureToDescriptors(uint32_t textureIndex);
             void createCommandBuffers();
             void createSyncObjects();
             void updateCameraPosition(float passedSeconds);
             void handleDebugModes();
             void recreateSwapChain();
+            // Moves the render scale towards the GPU frame budget from the latest measured frame
+            void updateRenderScale();
             void recordCommandBuffer(uint32_t imageIndex, uint32_t bufferIndex);
+            glm::mat4 frameCamera();
+            glm::mat4 projection() const;
             void updateUniformBuffer(uint32_t imageIndex);
             void drawFrame();
         
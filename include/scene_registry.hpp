@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <spatial_index.hpp>
+
+namespace volchara {
+    class Object;
+    struct Mesh;
+
+    struct SceneMaterial {
+        uint32_t textureIndex = 0;
+        uint32_t normalIndex = 0;
+        uint32_t emissiveIndex = 0;
+        float alphaCutoff = 0.0;
+    };
+
+    // Render data of every object in the scene in flat arrays, parents always come before their children
+    class SceneRegistry {
+        private:
+        std::vector<Object*> handles;
+        std::vector<glm::mat4> worldMatrices;
+        // inverse transpose of each world matrix, kept in step with it
+        std::vector<glm::mat3x4> normalMatrices;
+        // nullptr while the object has no geometry uploaded
+        std::vector<Mesh*> meshes;
+        std::vector<SceneMaterial> sceneMaterials;
+        std::vector<uint8_t> transparentFlags;
+        std::vector<uint8_t> transformDirty;
+        // world-space bounding sphere of each entry, a point at its origin while it has no geometry
+        std::vector<glm::vec4> boundingSpheres;
+        SpatialIndex spatialIndex;
+        bool layoutDirty = true;
+        bool anyTransformDirty = false;
+        uint64_t renderDataVersion = 0;
+        uint64_t layoutVersion = 0;
+        void readRenderData(uint32_t index);
+        void readTransform(uint32_t index);
+        void readBounds(uint32_t index);
+        std::vector<Object*> toObjects(const std::vector<uint32_t>& entries) const;
+        public:
+        SceneRegistry() {}
+        SceneRegistry(SceneRegistry&) = delete;
+        SceneRegistry& operator=(SceneRegistry&) = delete;
+        // Objects reachable from several roots are stored once
+        void rebuild(const std::vector<Object*>& roots);
+        bool needsRebuild() const;
+        // Objects were added, removed or reparented
+        void markLayoutChanged();
+        void markTransformChanged(uint32_t index);
+        // Mesh, material or transparency of the object changed
+        void markRenderDataChanged(uint32_t index);
+        // Copies world matrices of the moved objects only and refits the bounds changed since the last call
+        void updateTransforms();
+        void remove(Object* obj);
+        uint32_t size() const;
+        // Bumped on every change of the data besides world matrices
+        uint64_t version() const;
+        // Bumped on every rebuild, entry indices are only comparable within one generation
+        uint64_t layoutGeneration() const;
+        const std::vector<glm::mat4>& worlds() const;
+        const std::vector<glm::mat3x4>& normals() const;
+        const std::vector<Mesh*>& meshList() const;
+        const std::vector<SceneMaterial>& materials() const;
+        const std::vector<uint8_t>& transparent() const;
+        const std::vector<glm::vec4>& worldBounds() const;
+        // Queries see the bounds of the last rebuild or updateTransforms
+        std::vector<Object*> queryRadius(glm::vec3 center, float radius) const;
+        std::vector<Object*> queryBox(const AABB& box) const;
+        // Entries, not objects, so hot paths can index the flat arrays
+        void queryFrustum(const std::array<glm::vec4, 5>& planes, std::vector<uint32_t>& entries) const;
+        // Closest object whose bounds the ray enters within maxDistance, with the distance to them
+        std::optional<std::pair<Object*, float>> raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) const;
+    };
+}
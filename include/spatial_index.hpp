@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace volchara {
+    struct AABB {
+        glm::vec3 min{0, 0, 0};
+        glm::vec3 max{0, 0, 0};
+
+        static AABB fromSphere(glm::vec4 sphere);
+        bool overlaps(const AABB& other) const;
+    };
+
+    struct RayHit {
+        uint32_t entry = 0;
+        // along the normalized direction, 0 when the origin is inside the bounds
+        float distance = 0;
+    };
+
+    // Bounding volume hierarchy over entry bounds, moved entries are refit in place until the next build
+    class SpatialIndex {
+        private:
+        struct Node {
+            AABB bounds;
+            // leaves hold count entries from first, inner nodes have their children at first and first + 1
+            uint32_t first = 0;
+            uint32_t count = 0;
+            uint32_t parent = 0;
+            bool dirty = false;
+        };
+        std::vector<Node> nodes;
+        std::vector<uint32_t> entries;
+        std::vector<AABB> entryBounds;
+        std::vector<uint32_t> entryLeaves;
+        bool refitPending = false;
+        void buildNode(uint32_t node, uint32_t first, uint32_t count);
+        public:
+        void build(const std::vector<AABB>& bounds);
+        // The new bounds are seen by queries after the next refit
+        void update(uint32_t entry, const AABB& bounds);
+        // Grows the moved entries' ancestors, children always come after their parent
+        void refit();
+        uint32_t size() const;
+        void queryBox(const AABB& box, std::vector<uint32_t>& result) const;
+        void querySphere(glm::vec3 center, float radius, std::vector<uint32_t>& result) const;
+        // Planes point inwards, anything on the negative side of one of them is dropped
+        void queryFrustum(const std::array<glm::vec4, 5>& planes, std::vector<uint32_t>& result) const;
+        std::optional<RayHit> raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) const;
+    };
+}
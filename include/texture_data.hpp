@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace volchara {
+    struct TextureLevel {
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    // Identity of an encoded file, the size is kept next to the hash so only files of one length can ever collide
+    struct TextureHash {
+        size_t size = 0;
+        uint64_t low = 0;
+        uint64_t high = 0;
+        bool operator==(const TextureHash&) const = default;
+    };
+
+    struct TextureHashHasher {
+        size_t operator()(const TextureHash& hash) const {
+            return hash.low;
+        }
+    };
+
+    // Texels ready for upload, levels point into data, level 0 is the largest
+    struct TextureData {
+        vk::Format format = vk::Format::eUndefined;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<unsigned char> data;
+        std::vector<TextureLevel> levels;
+
+        static bool isKtx2(std::span<const unsigned char> fileData);
+        // Payload must be stored without supercompression, Basis textures have to be transcoded offline (e.g. `ktx transcode`)
+        static TextureData fromKtx2(std::span<const unsigned char> fileData);
+        // Decodes PNG/JPG into a single RGBA8 level
+        static TextureData fromImage(std::span<const unsigned char> fileData);
+        // 128-bit hash of the encoded bytes, equal files give equal textures
+        static TextureHash contentHash(std::span<const unsigned char> fileData);
+        // Picks the decoder by the file contents, fileData is only read during the call
+        static TextureData fromMemory(std::span<const unsigned char> fileData);
+    };
+}
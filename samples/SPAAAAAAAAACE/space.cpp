@@ -14,7 +14,7 @@ class Planet : public volchara::Object {
     float speed;
     Planet(volchara::Renderer& renderer, float scale, float speed, float distance, std::filesystem::path texturePath) : volchara::Object(volchara::GLTFModel::fromFile(renderer, renderer.getResourceDir() / "models/sphere.glb")) {
         replaceTextures(texturePath);
-        this->transform.scaling = {scale, scale, scale};
+        this->transform.setScaling({scale, scale, scale});
         this->children[1]->transform.position.right(distance/scale);
         this->speed = speed;
     }
@@ -57,7 +57,7 @@ void bindCamera(std::vector<Planet*> planets, int* currentBound, volchara::Objec
         *currentBound = 8;
     }
     if (*currentBound > -1) {
-        obj->renderer->camera.transform.translation = planets[*currentBound]->children[1]->transform.modelMatrix()[3];
+        obj->renderer->camera.transform.setTranslation(planets[*currentBound]->children[1]->transform.modelMatrix()[3]);
         obj->renderer->camera.transform.position.backward(2);
         obj->renderer->camera.transform.position.up(2);
     }
@@ -74,17 +74,17 @@ void addIfCollides(std::vector<Cat*>* freeCats, volchara::Object* obj, volchara:
                 pile.push_back(ptr);
             }
         }
-        for (Cat* cat : *freeCats) {
-            if (glm::distance(cat->transform.position.world(), pile[i]->transform.position.world()) < 0.25) {
-                cat->transform.translation -= obj->transform.translation;
-                // TODO: better snapping
-                cat->transform.rotationQuat = glm::conjugate(obj->children[0]->transform.rotationQuat);
-                obj->children[0]->children.push_back(cat);
-                cat->parent = obj->children[0];
-                auto catPos = std::find_if(freeCats->begin(), freeCats->end(), [&](Cat* ptr){ return ptr == cat;});
-                freeCats->erase(catPos);
-                break;
-            }
+        // the cached world matrix, the index only returns what is near enough to check
+        for (volchara::Object* near : renderer.queryRadius(pile[i]->transform.modelMatrix()[3], 0.25f)) {
+            Cat* cat = dynamic_cast<Cat*>(near);
+            auto catPos = std::find(freeCats->begin(), freeCats->end(), cat);
+            if (cat == nullptr || catPos == freeCats->end()) continue;
+            cat->transform.setTranslation(cat->transform.getTranslation() - obj->transform.getTranslation());
+            // TODO: better snapping
+            cat->transform.setRotation(glm::conjugate(obj->children[0]->transform.getRotation()));
+            obj->children[0]->addChild(cat);
+            freeCats->erase(catPos);
+            break;
         }
     }
 }
@@ -97,8 +97,7 @@ int main() {
     Cat mainCat = Cat(renderer);
     mainCat.replaceTextures(renderer.getResourceDir() / "textures/Cat_color_1.png");
     volchara::Object anchor = volchara::Object(renderer, {});
-    mainCat.parent = &anchor;
-    anchor.children.push_back(&mainCat);
+    anchor.addChild(&mainCat);
     anchor.frameCallbacks.push_back(moveCat);
     std::vector<Cat*> freeCats;
     auto f1 = std::bind(placeMoreCats, &freeCats, std::placeholders::_1, std::placeholders::_2);
@@ -108,13 +107,11 @@ int main() {
     anchor.frameCallbacks.push_back(f2);
 
     volchara::Object cameraAnchor = volchara::Object(renderer, {});
-    renderer.camera.parent = &cameraAnchor;
-    cameraAnchor.children.push_back(&renderer.camera);
-    cameraAnchor.parent = &anchor;
-    anchor.children.push_back(&cameraAnchor);
+    cameraAnchor.addChild(&renderer.camera);
+    anchor.addChild(&cameraAnchor);
     renderer.camera.transform.position.backward(1.5, true);
     renderer.camera.transform.position.up(1.5, true);
-    renderer.camera.transform.rotationQuat = glm::quatLookAtRH(glm::normalize(glm::vec3{0, -1, -1}), {0, 1, 0});
+    renderer.camera.transform.setRotation(glm::quatLookAtRH(glm::normalize(glm::vec3{0, -1, -1}), {0, 1, 0}));
     renderer.addObject(&anchor);
 
     renderer.setAmbientLight({{0,0,0}, {1, 1, 1}, 1});
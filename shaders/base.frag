@@ -5,6 +5,10 @@ layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragWorldPos;
 layout(location = 3) in vec3 fragNormal;
+layout(location = 4) flat in uint fragTextureId;
+layout(location = 5) flat in uint fragNormalId;
+layout(location = 6) flat in uint fragEmissiveId;
+layout(location = 7) flat in float fragAlphaCutoff;
 
 layout(set = 1, binding = 0) uniform sampler texSampler;
 layout(set = 1, binding = 1) uniform texture2D textures[];
@@ -22,23 +26,41 @@ layout(location = 0) out vec4 outColor;
 layout(location = 1) out vec4 outEmissive;
 layout(location = 2) out vec4 outNormal;
 
+// set by the renderer for RendererSettings::gBufferFormat, must match light.frag
+layout(constant_id = 0) const bool PACKED_NORMALS = false;
+
 const uint DEBUG_COLOR_NORMALS = 1u << 0;
 const uint DEBUG_COLOR_DEPTH = 1u << 1;
 const uint DEBUG_COLOR_WIREFRAME = 1u << 2;
 
+// octahedral mapping into [-1, 1], vertices without normals are marked outside of it
+vec2 encodeNormal(vec3 n) {
+    if (n == vec3(0.0)) {
+        return vec2(2.0);
+    }
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z < 0.0) {
+        return (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n.xy;
+}
+
 void main() {
     vec4 pixelColor;
     if ((pcs.debugFlags & DEBUG_COLOR_WIREFRAME) != 0u) {
         pixelColor = vec4(vec3(0.0, 1.0, 1.0), 1.0);
     }
     else {
-        pixelColor = texture(sampler2D(textures[pcs.textureId], texSampler), fragTexCoord);
+        pixelColor = texture(sampler2D(textures[fragTextureId], texSampler), fragTexCoord);
     }
-    if (pixelColor.a < pcs.alphaCutoff) discard;
+    if (pixelColor.a < fragAlphaCutoff) discard;
     outColor = pixelColor;
-    if (pcs.normalId != 0) {
-        outNormal = texture(sampler2D(textures[pcs.normalId], texSampler), fragTexCoord);
+    if (fragNormalId != 0) {
+        outNormal = texture(sampler2D(textures[fragNormalId], texSampler), fragTexCoord);
     } else {
         outNormal = vec4(fragNormal, 1.0);
     }
+    if (PACKED_NORMALS) {
+        outNormal = vec4(encodeNormal(outNormal.xyz), 0.0, 0.0);
+    }
 }
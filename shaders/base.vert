@@ -3,6 +3,7 @@
 layout(binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
+    mat4 invViewProj;
 } ubo;
 
 layout(push_constant) uniform PushConstants {
@@ -14,6 +15,28 @@ layout(push_constant) uniform PushConstants {
     uint debugFlags;
 } pcs;
 
+struct Instance {
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 bounds;
+    vec4 lodErrors;
+    uint textureId;
+    uint normalId;
+    uint emissiveId;
+    float alphaCutoff;
+    uint drawIndex;
+    uint lodCount;
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer InstancesSSBO {
+    Instance instances[];
+} instanceData;
+
+// instances of every draw that survived culling, filled by cull.comp
+layout(std430, set = 3, binding = 2) readonly buffer VisibleSSBO {
+    uint visible[];
+} visibleData;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec3 inColor;
@@ -23,19 +46,27 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragWorldPos;
 layout(location = 3) out vec3 fragNormal;
+layout(location = 4) flat out uint fragTextureId;
+layout(location = 5) flat out uint fragNormalId;
+layout(location = 6) flat out uint fragEmissiveId;
+layout(location = 7) flat out float fragAlphaCutoff;
 
 
 void main() {
-    vec4 worldPos = pcs.model * vec4(inPosition, 1.0);
+    Instance instance = instanceData.instances[visibleData.visible[gl_InstanceIndex]];
+    vec4 worldPos = instance.model * vec4(inPosition, 1.0);
     gl_Position = ubo.proj * ubo.view * worldPos;
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragTextureId = instance.textureId;
+    fragNormalId = instance.normalId;
+    fragEmissiveId = instance.emissiveId;
+    fragAlphaCutoff = instance.alphaCutoff;
 
     fragWorldPos = worldPos.xyz;
-    mat3 matMult = transpose(inverse(mat3(pcs.model)));
     if (inNormal == vec3(0.0, 0.0, 0.0)) {
         fragNormal = inNormal;
     } else {
-        fragNormal = normalize(matMult * inNormal);
+        fragNormal = normalize(instance.normalMatrix * inNormal);
     }
 }
@@ -0,0 +1,82 @@
+#version 450
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    mat4 invViewProj;
+} ubo;
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    uint textureId;
+    uint normalId;
+    uint emissiveId;
+    float alphaCutoff;
+    uint debugFlags;
+} pcs;
+
+struct Instance {
+    mat4 model;
+    mat3 normalMatrix;
+    vec4 bounds;
+    vec4 lodErrors;
+    uint textureId;
+    uint normalId;
+    uint emissiveId;
+    float alphaCutoff;
+    uint drawIndex;
+    uint lodCount;
+};
+
+layout(std430, set = 3, binding = 0) readonly buffer InstancesSSBO {
+    Instance instances[];
+} instanceData;
+
+// instances of every draw that survived culling, filled by cull.comp
+layout(std430, set = 3, binding = 2) readonly buffer VisibleSSBO {
+    uint visible[];
+} visibleData;
+
+// CompactVertex, see objects.hpp
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 3) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPos;
+layout(location = 3) out vec3 fragNormal;
+layout(location = 4) flat out uint fragTextureId;
+layout(location = 5) flat out uint fragNormalId;
+layout(location = 6) flat out uint fragEmissiveId;
+layout(location = 7) flat out float fragAlphaCutoff;
+
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    Instance instance = instanceData.instances[visibleData.visible[gl_InstanceIndex]];
+    float radius = instance.bounds.w > 0.0 ? instance.bounds.w : 1.0;
+    vec3 position = instance.bounds.xyz + inPosition.xyz * radius;
+    vec4 worldPos = instance.model * vec4(position, 1.0);
+    gl_Position = ubo.proj * ubo.view * worldPos;
+    fragColor = vec3(0.0, 0.0, 0.0);
+    fragTexCoord = inTexCoord;
+    fragTextureId = instance.textureId;
+    fragNormalId = instance.normalId;
+    fragEmissiveId = instance.emissiveId;
+    fragAlphaCutoff = instance.alphaCutoff;
+
+    fragWorldPos = worldPos.xyz;
+    if (inPosition.w == 0.0) {
+        fragNormal = vec3(0.0, 0.0, 0.0);
+    } else {
+        fragNormal = normalize(instance.normalMatrix * octDecode(inNormal));
+    }
+}
@@ -12,6 +12,7 @@ layout(location=0) in vec2 inNDC;
 layout(set=1, binding=0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
+    mat4 invViewProj;
 } ubo;
 
 struct SingleLight {
@@ -30,6 +31,20 @@ layout(set=2, binding=0) buffer LightsSSBO {
     SingleLight lights[];
 } ssbo;
 
+// must match the LIGHT_CLUSTER_* constants of the renderer
+const uint CLUSTERS_X = 16;
+const uint CLUSTERS_Y = 9;
+const uint CLUSTERS_Z = 24;
+const uint CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+const float CLUSTER_NEAR = 0.1;
+const float CLUSTER_FAR = 1000.0;
+
+layout(set=2, binding=1) readonly buffer ClustersSSBO {
+    uint lightCounts[CLUSTER_COUNT];
+    uint lightIndices[];
+} clusters;
+
 layout(push_constant) uniform PushConstants {
     mat4 model;
     uint textureId;
@@ -41,18 +56,42 @@ layout(push_constant) uniform PushConstants {
 
 layout(location = 0) out vec4 outColor;
 
+// set by the renderer for RendererSettings::gBufferFormat, must match base.frag
+layout(constant_id = 0) const bool PACKED_NORMALS = false;
+
 const uint DEBUG_COLOR_NORMALS = 1u << 0;
 const uint DEBUG_COLOR_DEPTH = 1u << 1;
 const uint DEBUG_COLOR_WIREFRAME = 1u << 2;
 const uint DEBUG_COLOR_UNLIT = 1u << 3;
 
 vec3 reconstructFragWorldPos(float depth, vec2 ndc) {
-    mat4 invViewProj = inverse(ubo.proj * ubo.view);
     vec4 clip = vec4(ndc, depth, 1.0);
-    vec4 world = invViewProj * clip;
+    vec4 world = ubo.invViewProj * clip;
     return world.xyz / world.w;
 }
 
+// inverse of encodeNormal in base.frag, the lengths of normal map texels aren't kept
+vec3 decodeNormal(vec2 e) {
+    if (any(greaterThan(abs(e), vec2(1.0)))) {
+        return vec3(0.0);
+    }
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+uint clusterIndex(vec2 ndc, float viewDepth) {
+    uvec2 tile = uvec2(clamp((ndc * 0.5 + 0.5) * vec2(CLUSTERS_X, CLUSTERS_Y), vec2(0.0), vec2(CLUSTERS_X - 1, CLUSTERS_Y - 1)));
+    float slice = 0.0;
+    if (viewDepth >= CLUSTER_NEAR) {
+        slice = 1.0 + floor(log(viewDepth / CLUSTER_NEAR) / log(CLUSTER_FAR / CLUSTER_NEAR) * float(CLUSTERS_Z - 1));
+    }
+    uint z = uint(min(slice, float(CLUSTERS_Z - 1)));
+    return (z * CLUSTERS_Y + tile.y) * CLUSTERS_X + tile.x;
+}
+
 float calcLightIntensity(vec3 lightPos, float lightBrightness, vec3 fragPos, vec3 fragNormal, bool physical) {
     vec3 lightVec = lightPos - fragPos;
     float lightDist = length(lightVec);
@@ -76,7 +115,7 @@ float calcLightIntensity(vec3 lightPos, float lightBrightness, vec3 fragPos, vec
 void main() {
     vec3 inColor = subpassLoad(spColor).xyz;
     vec3 inEmissive = subpassLoad(spEmissive).xyz;
-    vec3 inNormal = subpassLoad(spNormal).xyz;
+    vec3 inNormal = PACKED_NORMALS ? decodeNormal(subpassLoad(spNormal).xy) : subpassLoad(spNormal).xyz;
     float inDepth = subpassLoad(spDepth).x;
     
     if ((pcs.debugFlags & DEBUG_COLOR_NORMALS) != 0u) {
@@ -100,12 +139,16 @@ void main() {
     if (pcs.emissiveId != 0) {
         finalColor = inEmissive;
     } else {
-        for (int i = 0; i < ssbo.header.lightCount; i++) {
-            vec3 lightPos = ssbo.lights[i].position.xyz;
-            float lightBrightness = ssbo.lights[i].color.w;
-            vec3 fragWorldPos = reconstructFragWorldPos(inDepth, inNDC);
+        vec3 fragWorldPos = reconstructFragWorldPos(inDepth, inNDC);
+        // reverse infinite projection, depth is near / view depth
+        uint cluster = clusterIndex(inNDC, ubo.proj[3][2] / inDepth);
+        uint clusterLights = min(clusters.lightCounts[cluster], MAX_LIGHTS_PER_CLUSTER);
+        for (uint i = 0; i < clusterLights; i++) {
+            uint lightId = clusters.lightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+            vec3 lightPos = ssbo.lights[lightId].position.xyz;
+            float lightBrightness = ssbo.lights[lightId].color.w;
             float lightIntensity = calcLightIntensity(lightPos, lightBrightness, fragWorldPos, inNormal, false);
-            finalColor += ssbo.lights[i].color.xyz * lightIntensity * inColor;
+            finalColor += ssbo.lights[lightId].color.xyz * lightIntensity * inColor;
         }
         finalColor += ssbo.header.ambient.xyz * ssbo.header.ambient.w * inColor;
     }
@@ -0,0 +1,21 @@
+#version 450
+
+layout(input_attachment_index=0, set=0, binding=0) uniform subpassInput spAccumulation;
+layout(input_attachment_index=1, set=0, binding=1) uniform subpassInput spRevealage;
+
+layout(location=0) out vec4 outColor;
+
+void main() {
+    float revealage = subpassLoad(spRevealage).r;
+    // no transparent layer covers the pixel
+    if (revealage >= 1.0) {
+        discard;
+    }
+    vec4 accumulation = subpassLoad(spAccumulation);
+    // many bright layers can overflow the half floats, their average is then lost anyway
+    if (isinf(max(max(abs(accumulation.r), abs(accumulation.g)), abs(accumulation.b)))) {
+        accumulation.rgb = vec3(accumulation.a);
+    }
+    vec3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+    outColor = vec4(average, 1.0 - revealage);
+}
@@ -7,10 +7,15 @@ layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragWorldPos;
 layout(location = 3) in vec3 fragNormal;
+layout(location = 4) flat in uint fragTextureId;
+layout(location = 5) flat in uint fragNormalId;
+layout(location = 6) flat in uint fragEmissiveId;
+layout(location = 7) flat in float fragAlphaCutoff;
 
 layout(set=0, binding=0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
+    mat4 invViewProj;
 } ubo;
 
 layout(set = 1, binding = 0) uniform sampler texSampler;
@@ -32,6 +37,20 @@ layout(set=2, binding=0) buffer LightsSSBO {
     SingleLight lights[];
 } ssbo;
 
+// must match the LIGHT_CLUSTER_* constants of the renderer
+const uint CLUSTERS_X = 16;
+const uint CLUSTERS_Y = 9;
+const uint CLUSTERS_Z = 24;
+const uint CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+const float CLUSTER_NEAR = 0.1;
+const float CLUSTER_FAR = 1000.0;
+
+layout(set=2, binding=1) readonly buffer ClustersSSBO {
+    uint lightCounts[CLUSTER_COUNT];
+    uint lightIndices[];
+} clusters;
+
 layout(push_constant) uniform PushConstants {
     mat4 model;
     uint textureId;
@@ -41,13 +60,25 @@ layout(push_constant) uniform PushConstants {
     uint debugFlags;
 } pcs;
 
-layout(location = 0) out vec4 outColor;
+// weighted-blended OIT, resolved over the lit image by resolve.frag
+layout(location = 0) out vec4 outAccumulation;
+layout(location = 1) out float outRevealage;
 
 const uint DEBUG_COLOR_NORMALS = 1u << 0;
 const uint DEBUG_COLOR_DEPTH = 1u << 1;
 const uint DEBUG_COLOR_WIREFRAME = 1u << 2;
 const uint DEBUG_COLOR_UNLIT = 1u << 3;
 
+uint clusterIndex(vec2 ndc, float viewDepth) {
+    uvec2 tile = uvec2(clamp((ndc * 0.5 + 0.5) * vec2(CLUSTERS_X, CLUSTERS_Y), vec2(0.0), vec2(CLUSTERS_X - 1, CLUSTERS_Y - 1)));
+    float slice = 0.0;
+    if (viewDepth >= CLUSTER_NEAR) {
+        slice = 1.0 + floor(log(viewDepth / CLUSTER_NEAR) / log(CLUSTER_FAR / CLUSTER_NEAR) * float(CLUSTERS_Z - 1));
+    }
+    uint z = uint(min(slice, float(CLUSTERS_Z - 1)));
+    return (z * CLUSTERS_Y + tile.y) * CLUSTERS_X + tile.x;
+}
+
 float calcLightIntensity(vec3 lightPos, float lightBrightness, vec3 fragPos, vec3 fragNormal, bool physical) {
     vec3 lightVec = lightPos - fragPos;
     float lightDist = length(lightVec);
@@ -68,45 +99,58 @@ float calcLightIntensity(vec3 lightPos, float lightBrightness, vec3 fragPos, vec
     return lightNormalizedIntensity * lightDistanceIntensity;
 }
 
+// premultiplied color, weighted so that near and opaque layers dominate the average
+void writeLayer(vec4 color) {
+    float viewDepth = -(ubo.view * vec4(fragWorldPos, 1.0)).z;
+    float weight = clamp(0.03 / (1e-5 + pow(viewDepth / 200.0, 4.0)), 1e-2, 3e3) * color.a;
+    outAccumulation = color * weight;
+    outRevealage = color.a;
+}
+
 void main() {
-    vec4 inColorAndAlpha = texture(sampler2D(textures[pcs.textureId], texSampler), fragTexCoord);
+    vec4 inColorAndAlpha = texture(sampler2D(textures[fragTextureId], texSampler), fragTexCoord);
     vec3 inColor = inColorAndAlpha.xyz;
     float inAlpha = inColorAndAlpha.a;
     vec3 inNormal;
-    if (pcs.normalId != 0) {
-        inNormal = texture(sampler2D(textures[pcs.normalId], texSampler), fragTexCoord).xyz;
+    if (fragNormalId != 0) {
+        inNormal = texture(sampler2D(textures[fragNormalId], texSampler), fragTexCoord).xyz;
     } else {
         inNormal = fragNormal;
     }
     
     if ((pcs.debugFlags & DEBUG_COLOR_NORMALS) != 0u) {
-        outColor = vec4(abs(inNormal), 1.0);
+        writeLayer(vec4(abs(inNormal), 1.0));
         return;
     }
     if ((pcs.debugFlags & DEBUG_COLOR_DEPTH) != 0u) {
-        outColor = vec4(vec3(0.0, gl_FragCoord.z, gl_FragCoord.z) * inAlpha, inAlpha);
+        writeLayer(vec4(vec3(0.0, gl_FragCoord.z, gl_FragCoord.z) * inAlpha, inAlpha));
         return;
     }
     if ((pcs.debugFlags & DEBUG_COLOR_WIREFRAME) != 0u) {
-        outColor = vec4(vec3(0.0, 1.0, 1.0), 1.0);
+        writeLayer(vec4(vec3(0.0, 1.0, 1.0), 1.0));
         return;
     }
     if ((pcs.debugFlags & DEBUG_COLOR_UNLIT) != 0u) {
-        outColor = vec4(inColor * inAlpha, inAlpha);
+        writeLayer(vec4(inColor * inAlpha, inAlpha));
         return;
     }
 
     vec3 finalColor = vec3(0.0, 0.0, 0.0);
-    if (pcs.emissiveId != 0) {
-        finalColor = texture(sampler2D(textures[pcs.emissiveId], texSampler), fragTexCoord).xyz;
+    if (fragEmissiveId != 0) {
+        finalColor = texture(sampler2D(textures[fragEmissiveId], texSampler), fragTexCoord).xyz;
     } else {
-        for (int i = 0; i < ssbo.header.lightCount; i++) {
-            vec3 lightPos = ssbo.lights[i].position.xyz;
-            float lightBrightness = ssbo.lights[i].color.w;
+        vec4 viewPos = ubo.view * vec4(fragWorldPos, 1.0);
+        vec2 ndc = vec2(ubo.proj[0][0] * viewPos.x, ubo.proj[1][1] * viewPos.y) / -viewPos.z;
+        uint cluster = clusterIndex(ndc, -viewPos.z);
+        uint clusterLights = min(clusters.lightCounts[cluster], MAX_LIGHTS_PER_CLUSTER);
+        for (uint i = 0; i < clusterLights; i++) {
+            uint lightId = clusters.lightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+            vec3 lightPos = ssbo.lights[lightId].position.xyz;
+            float lightBrightness = ssbo.lights[lightId].color.w;
             float lightIntensity = calcLightIntensity(lightPos, lightBrightness, fragWorldPos, inNormal, false);
-            finalColor += ssbo.lights[i].color.xyz * lightIntensity * inColor;
+            finalColor += ssbo.lights[lightId].color.xyz * lightIntensity * inColor;
         }
         finalColor += ssbo.header.ambient.xyz * ssbo.header.ambient.w * inColor;
     }
-    outColor = vec4(finalColor * inAlpha, inAlpha);
+    writeLayer(vec4(finalColor * inAlpha, inAlpha));
 }
\ No newline at end of file
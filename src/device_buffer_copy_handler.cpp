@@ -1,74 +1,198 @@
+#include <mutex>
+#include <utility>
+
 #include <vulkan/vulkan_raii.hpp>
+#include <tracy/Tracy.hpp>
 
 #include <device_buffer_copy_handler.hpp>
 
 namespace volchara {
-    DeviceBufferCopyHandler::DeviceBufferCopyHandler(vk::raii::Device& dev, uint32_t queueFamilyIndex) {
+    DeviceBufferCopyHandler::DeviceBufferCopyHandler(vk::raii::Device& dev, uint32_t graphicsFamilyIndex, uint32_t transferFamilyIndex, std::mutex& queueMutex) {
         device = &dev;
-        queue = device->getQueue(queueFamilyIndex, 0);
+        queue = device->getQueue(transferFamilyIndex, 0);
+        this->queueMutex = &queueMutex;
         vk::CommandPoolCreateInfo poolInfo{
             .flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-            .queueFamilyIndex = queueFamilyIndex,
+            .queueFamilyIndex = transferFamilyIndex,
         };
         commandPool = device->createCommandPool(poolInfo);
-        // fence = device->createFence({});
+        vk::SemaphoreTypeCreateInfo timelineInfo{
+            .semaphoreType = vk::SemaphoreType::eTimeline,
+            .initialValue = 0,
+        };
+        timeline = device->createSemaphore({.pNext = &timelineInfo});
+        families.push_back(graphicsFamilyIndex);
+        if (transferFamilyIndex != graphicsFamilyIndex) families.push_back(transferFamilyIndex);
     }
-    void DeviceBufferCopyHandler::submit(vk::Buffer& from, vk::Buffer& to, uint32_t size) {
+    void DeviceBufferCopyHandler::beginBatch() {
+        if (recordingOpen) return;
+        collect();
         vk::CommandBufferAllocateInfo bufInfo{
             .commandPool = commandPool,
             .level = vk::CommandBufferLevel::ePrimary,
             .commandBufferCount = 1,
         };
-        vk::raii::CommandBuffer cmdBuf = std::move(device->allocateCommandBuffers(bufInfo).front());
-        cmdBuf.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        recording.cmdBuf = std::move(device->allocateCommandBuffers(bufInfo).front());
+        recording.cmdBuf.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        recordingOpen = true;
+    }
+    void DeviceBufferCopyHandler::collect() {
+        uint64_t completed = timeline.getCounterValue();
+        size_t done = 0;
+        // batches are submitted to one queue with increasing tickets, so they complete in order
+        while (done < inFlight.size() && inFlight[done].ticket <= completed) {
+            for (auto& release : inFlight[done].onComplete) {
+                release();
+            }
+            done++;
+        }
+        inFlight.erase(inFlight.begin(), inFlight.begin() + done);
+    }
+    void DeviceBufferCopyHandler::submit(vk::Buffer from, vk::DeviceSize srcOffset, vk::Buffer to, vk::DeviceSize dstOffset, vk::DeviceSize size) {
+        beginBatch();
         vk::BufferCopy copyCmd{
+            .srcOffset = srcOffset,
+            .dstOffset = dstOffset,
             .size = size,
         };
-        cmdBuf.copyBuffer(from, to, copyCmd);
-        cmdBuf.end();
-        vk::SubmitInfo sub{
-            .commandBufferCount = 1,
-            .pCommandBuffers = &*cmdBuf,
-        };
-        queue.submit(sub);
-        queue.waitIdle();
+        recording.cmdBuf.copyBuffer(from, to, copyCmd);
     }
-    void DeviceBufferCopyHandler::submit(vk::Buffer& from, vk::Image& to, vk::Extent3D extent) {
-        vk::CommandBufferAllocateInfo bufInfo{
-            .commandPool = commandPool,
-            .level = vk::CommandBufferLevel::ePrimary,
-            .commandBufferCount = 1,
-        };
-        vk::raii::CommandBuffer cmdBuf = std::move(device->allocateCommandBuffers(bufInfo).front());
-        cmdBuf.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    void DeviceBufferCopyHandler::submit(vk::Buffer from, vk::DeviceSize srcOffset, vk::Image to, vk::Extent3D extent) {
         vk::BufferImageCopy copyCmd{
-            .imageExtent = extent,
+            .bufferOffset = srcOffset,
             .imageSubresource = {
                 .aspectMask = vk::ImageAspectFlagBits::eColor,
                 .mipLevel = 0,
                 .baseArrayLayer = 0,
                 .layerCount = 1,
             },
+            .imageExtent = extent,
+        };
+        submit(from, to, {copyCmd}, 1, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+    void DeviceBufferCopyHandler::submit(vk::Buffer from, vk::Image to, const std::vector<vk::BufferImageCopy>& regions, uint32_t mipLevels, vk::ImageLayout finalLayout) {
+        beginBatch();
+        vk::ImageSubresourceRange range{
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = mipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        };
+        vk::ImageMemoryBarrier toTransfer{
+            .srcAccessMask = vk::AccessFlagBits::eNone,
+            .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .oldLayout = vk::ImageLayout::eUndefined,
+            .newLayout = vk::ImageLayout::eTransferDstOptimal,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image = to,
+            .subresourceRange = range,
+        };
+        recording.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, toTransfer);
+        recording.cmdBuf.copyBufferToImage(from, to, vk::ImageLayout::eTransferDstOptimal, regions);
+        if (finalLayout == vk::ImageLayout::eTransferDstOptimal) {
+            // the graphics queue continues from here, e.g. blitting the rest of the mip chain
+            return;
+        }
+        // visibility for the shader stages comes from the timeline semaphore wait on the graphics queue
+        vk::ImageMemoryBarrier toShader{
+            .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eNone,
+            .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+            .newLayout = finalLayout,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image = to,
+            .subresourceRange = range,
+        };
+        recording.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, toShader);
+    }
+    void DeviceBufferCopyHandler::barrier() {
+        beginBatch();
+        vk::MemoryBarrier transferBarrier{
+            .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
+        };
+        recording.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, transferBarrier, nullptr, nullptr);
+    }
+    void DeviceBufferCopyHandler::deferUntilComplete(std::function<void()> release) {
+        beginBatch();
+        recording.onComplete.push_back(std::move(release));
+    }
+    UploadTicket DeviceBufferCopyHandler::flush() {
+        ZoneScoped;
+        if (!recordingOpen) {
+            collect();
+            return submitted;
+        }
+        recording.cmdBuf.end();
+        recording.ticket = submitted + 1;
+        vk::TimelineSemaphoreSubmitInfo timelineInfo{
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &recording.ticket,
         };
-        cmdBuf.copyBufferToImage(from, to, vk::ImageLayout::eTransferDstOptimal, copyCmd);
-        cmdBuf.end();
         vk::SubmitInfo sub{
+            .pNext = &timelineInfo,
             .commandBufferCount = 1,
-            .pCommandBuffers = &*cmdBuf,
+            .pCommandBuffers = &*recording.cmdBuf,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &*timeline,
         };
-        queue.submit(sub);
-        queue.waitIdle();
+        {
+            std::lock_guard<std::mutex> queueLock(*queueMutex);
+            queue.submit(sub);
+        }
+        submitted = recording.ticket;
+        inFlight.push_back(std::move(recording));
+        recording = Batch{};
+        recordingOpen = false;
+        collect();
+        return submitted;
+    }
+    UploadTicket DeviceBufferCopyHandler::pendingTicket() const {
+        return submitted + 1;
+    }
+    bool DeviceBufferCopyHandler::isComplete(UploadTicket ticket) {
+        return timeline.getCounterValue() >= ticket;
+    }
+    void DeviceBufferCopyHandler::wait(UploadTicket ticket) {
+        if (ticket > submitted) flush();
+        vk::SemaphoreWaitInfo waitInfo{
+            .semaphoreCount = 1,
+            .pSemaphores = &*timeline,
+            .pValues = &ticket,
+        };
+        (void)device->waitSemaphores(waitInfo, UINT64_MAX);
+        collect();
+    }
+    void DeviceBufferCopyHandler::waitIdle() {
+        wait(flush());
+    }
+    vk::Semaphore DeviceBufferCopyHandler::timelineSemaphore() const {
+        return *timeline;
+    }
+    const std::vector<uint32_t>& DeviceBufferCopyHandler::queueFamilies() const {
+        return families;
     }
     DeviceBufferCopyHandler::DeviceBufferCopyHandler(DeviceBufferCopyHandler&& other) {
-        std::swap(device, other.device);
-        std::swap(queue, other.queue);
-        std::swap(commandPool, other.commandPool);
+        swap(*this, other);
     }
     const DeviceBufferCopyHandler& DeviceBufferCopyHandler::operator=(DeviceBufferCopyHandler&& other) {
         DeviceBufferCopyHandler t(std::move(other));
-        std::swap(device, t.device);
-        std::swap(queue, t.queue);
-        std::swap(commandPool, t.commandPool);
+        swap(*this, t);
         return *this;
     }
-}
\ No newline at end of file
+    void DeviceBufferCopyHandler::swap(DeviceBufferCopyHandler& lhs, DeviceBufferCopyHandler& rhs) {
+        std::swap(lhs.device, rhs.device);
+        std::swap(lhs.queue, rhs.queue);
+        std::swap(lhs.queueMutex, rhs.queueMutex);
+        std::swap(lhs.commandPool, rhs.commandPool);
+        std::swap(lhs.timeline, rhs.timeline);
+        std::swap(lhs.families, rhs.families);
+        std::swap(lhs.recording, rhs.recording);
+        std::swap(lhs.recordingOpen, rhs.recordingOpen);
+        std::swap(lhs.inFlight, rhs.inFlight);
+        std::swap(lhs.submitted, rhs.submitted);
+    }
+}
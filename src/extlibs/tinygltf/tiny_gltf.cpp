@@ -1,4 +1,6 @@
 #define TINYGLTF_IMPLEMENTATION
+// external images are loaded by the renderer, tinygltf doesn't have to read them
+#define TINYGLTF_NO_EXTERNAL_IMAGE
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include <tiny_gltf.h>
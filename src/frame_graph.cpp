@@ -0,0 +1,158 @@
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <frame_graph.hpp>
+
+namespace volchara {
+    void FrameGraph::reset() {
+        resources.clear();
+        passes.clear();
+        culledPasses = 0;
+    }
+
+    FrameGraphResource FrameGraph::importBuffer() {
+        resources.push_back({});
+        return resources.size() - 1;
+    }
+
+    FrameGraphResource FrameGraph::importImage(vk::Image image, vk::ImageAspectFlags aspect, vk::ImageLayout layout, vk::PipelineStageFlags readyStages) {
+        // the first barrier waits on the ready stages as if they wrote the image
+        resources.push_back({.image = image, .aspect = aspect, .layout = layout, .writeStages = readyStages});
+        return resources.size() - 1;
+    }
+
+    void FrameGraph::markOutput(FrameGraphResource resource, vk::ImageLayout layout) {
+        resources[resource].output = true;
+        resources[resource].outputLayout = layout;
+    }
+
+    FrameGraphPass FrameGraph::addPass(std::function<void()> record, bool sideEffects) {
+        passes.push_back({.record = std::move(record), .sideEffects = sideEffects});
+        return passes.size() - 1;
+    }
+
+    void FrameGraph::read(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage) {
+        passes[pass].accesses.push_back({.resource = resource, .usage = usage, .write = false});
+    }
+
+    void FrameGraph::write(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage) {
+        passes[pass].accesses.push_back({.resource = resource, .usage = usage, .write = true});
+    }
+
+    void FrameGraph::cull() {
+        // walked backwards, a pass is needed when something after it reads what it writes
+        std::vector<bool> needed(resources.size());
+        for (size_t i = 0; i < resources.size(); i++) {
+            needed[i] = resources[i].output;
+        }
+        for (size_t i = passes.size(); i-- > 0;) {
+            Pass& pass = passes[i];
+            bool alive = pass.sideEffects;
+            for (const Access& access : pass.accesses) {
+                alive |= access.write && needed[access.resource];
+            }
+            pass.culled = !alive;
+            if (!alive) {
+                culledPasses++;
+                continue;
+            }
+            for (const Access& access : pass.accesses) {
+                if (!access.write) needed[access.resource] = true;
+            }
+        }
+    }
+
+    void FrameGraph::recordBarriers(vk::raii::CommandBuffer& commandBuffer, const Pass& pass) {
+        vk::PipelineStageFlags srcStages;
+        vk::PipelineStageFlags dstStages;
+        vk::MemoryBarrier memoryBarrier;
+        std::vector<vk::ImageMemoryBarrier> imageBarriers;
+        for (const Access& access : pass.accesses) {
+            Resource& resource = resources[access.resource];
+            const FrameGraphUsage& usage = access.usage;
+            bool transition = resource.image && usage.layout != vk::ImageLayout::eUndefined && usage.layout != resource.layout;
+            vk::PipelineStageFlags waitStages;
+            vk::AccessFlags waitAccess;
+            if (access.write || transition) {
+                // after the previous write and every read of it, the reads only need an execution dependency
+                waitStages = resource.writeStages | resource.readStages;
+                waitAccess = resource.writeAccess;
+            } else if ((usage.stages & ~resource.readStages) || (usage.access & ~resource.readAccess)) {
+                // reads in stages that have already seen the write need nothing more
+                waitStages = resource.writeStages;
+                waitAccess = resource.writeAccess;
+            }
+            if (waitStages || transition) {
+                if (transition) {
+                    imageBarriers.push_back({
+                        .srcAccessMask = waitAccess,
+                        .dstAccessMask = usage.access,
+                        .oldLayout = resource.layout,
+                        .newLayout = usage.layout,
+                        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+                        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+                        .image = resource.image,
+                        .subresourceRange = {.aspectMask = resource.aspect, .baseMipLevel = 0, .levelCount = vk::RemainingMipLevels, .baseArrayLayer = 0, .layerCount = vk::RemainingArrayLayers},
+                    });
+                } else if (waitAccess) {
+                    memoryBarrier.srcAccessMask |= waitAccess;
+                    memoryBarrier.dstAccessMask |= usage.access;
+                }
+                srcStages |= waitStages;
+                dstStages |= usage.stages;
+            }
+
+            if (access.write) {
+                resource.writeStages = usage.stages;
+                resource.writeAccess = usage.access;
+                resource.readStages = {};
+                resource.readAccess = {};
+            } else if (transition) {
+                // the transition is a write of its own, earlier reads are behind it
+                resource.readStages = usage.stages;
+                resource.readAccess = usage.access;
+            } else {
+                resource.readStages |= usage.stages;
+                resource.readAccess |= usage.access;
+            }
+            if (usage.finalLayout != vk::ImageLayout::eUndefined) {
+                resource.layout = usage.finalLayout;
+            } else if (usage.layout != vk::ImageLayout::eUndefined) {
+                resource.layout = usage.layout;
+            }
+        }
+        if (!dstStages) {
+            return;
+        }
+        if (!srcStages) {
+            srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+        }
+        if (memoryBarrier.srcAccessMask) {
+            commandBuffer.pipelineBarrier(srcStages, dstStages, {}, memoryBarrier, nullptr, imageBarriers);
+        } else {
+            commandBuffer.pipelineBarrier(srcStages, dstStages, {}, nullptr, nullptr, imageBarriers);
+        }
+    }
+
+    void FrameGraph::execute(vk::raii::CommandBuffer& commandBuffer) {
+        cull();
+        for (const Pass& pass : passes) {
+            if (pass.culled) continue;
+            recordBarriers(commandBuffer, pass);
+            pass.record();
+        }
+        // outputs are handed over in the layout whoever reads them after the frame expects
+        Pass handover;
+        for (FrameGraphResource i = 0; i < resources.size(); i++) {
+            if (resources[i].output && resources[i].image && resources[i].outputLayout != vk::ImageLayout::eUndefined && resources[i].outputLayout != resources[i].layout) {
+                handover.accesses.push_back({.resource = i, .usage = {.stages = vk::PipelineStageFlagBits::eBottomOfPipe, .layout = resources[i].outputLayout}});
+            }
+        }
+        recordBarriers(commandBuffer, handover);
+    }
+
+    uint32_t FrameGraph::culledPassCount() const {
+        return culledPasses;
+    }
+}
@@ -0,0 +1,60 @@
+#include <chrono>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include <frame_pacer.hpp>
+
+namespace volchara {
+    namespace {
+        // sleeps overshoot by up to the scheduler tick, the rest of the wait is spun
+        const std::chrono::microseconds SPIN_MARGIN{500};
+    }
+
+    FramePacer::FramePacer() {
+        #if defined(_WIN32)
+        // plain timers and Sleep() round up to the 15.6 ms system tick
+        timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        #endif
+    }
+    FramePacer::~FramePacer() {
+        #if defined(_WIN32)
+        if (timer) CloseHandle(timer);
+        #endif
+    }
+    void FramePacer::setFrameCap(float framesPerSecond) {
+        interval = framesPerSecond > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.0f / framesPerSecond)) : std::chrono::steady_clock::duration{0};
+        nextFrame = std::chrono::steady_clock::now();
+    }
+    void FramePacer::sleepUntil(std::chrono::steady_clock::time_point deadline) {
+        std::chrono::steady_clock::duration remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining <= SPIN_MARGIN) return;
+        #if defined(_WIN32)
+        if (timer) {
+            // relative due time in 100 ns units
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - SPIN_MARGIN).count() / 100);
+            if (SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+                return;
+            }
+        }
+        #endif
+        std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+    }
+    void FramePacer::wait() {
+        if (interval.count() == 0) return;
+        sleepUntil(nextFrame);
+        while (std::chrono::steady_clock::now() < nextFrame) {
+            std::this_thread::yield();
+        }
+        // frames keep a steady cadence, after a stall the schedule restarts instead of catching up
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        nextFrame += interval;
+        if (nextFrame < now) nextFrame = now + interval;
+    }
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include <vulkan/vulkan_raii.hpp>
+#include <vk_mem_alloc.hpp>
+#include <tracy/Tracy.hpp>
+
+#include <geometry_pool.hpp>
+
+namespace volchara {
+    FreeList::FreeList(uint32_t size) {
+        capacity = size;
+        if (size > 0) ranges[0] = size;
+    }
+    std::optional<uint32_t> FreeList::allocate(uint32_t count) {
+        for (auto it = ranges.begin(); it != ranges.end(); it++) {
+            if (it->second < count) continue;
+            uint32_t offset = it->first;
+            uint32_t left = it->second - count;
+            ranges.erase(it);
+            if (left > 0) ranges[offset + count] = left;
+            return offset;
+        }
+        return std::nullopt;
+    }
+    void FreeList::release(uint32_t offset, uint32_t count) {
+        if (count == 0) return;
+        auto next = ranges.lower_bound(offset);
+        if (next != ranges.end() && offset + count == next->first) {
+            count += next->second;
+            next = ranges.erase(next);
+        }
+        if (next != ranges.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset) {
+                prev->second += count;
+                return;
+            }
+        }
+        ranges[offset] = count;
+    }
+    void FreeList::grow(uint32_t newCapacity) {
+        release(capacity, newCapacity - capacity);
+        capacity = newCapacity;
+    }
+    uint32_t FreeList::size() const {
+        return capacity;
+    }
+
+    GeometryPool::GeometryPool(RAIIAllocator& fromAllocator, DeviceBufferCopyHandler& handler, std::function<void()> waitForFrames, VertexFormat vertexFormat, uint32_t vertexCount, uint32_t indexCount) {
+        allocator = &fromAllocator;
+        copyHandler = &handler;
+        this->waitForFrames = waitForFrames;
+        format = vertexFormat;
+        vertexBuffer = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexCount * Vertex::stride(format));
+        indexBuffer = createBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexCount * sizeof(uint32_t));
+        freeVertices = FreeList(vertexCount);
+        freeIndices = FreeList(indexCount);
+    }
+    RAIIvmaBuffer GeometryPool::createBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size) {
+        vk::BufferCreateInfo bufferInfo{
+            .size = size,
+            .usage = usage | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        vma::AllocationCreateInfo allocInfo{
+            .usage = vma::MemoryUsage::eAuto,
+        };
+        return allocator->createBuffer(bufferInfo, allocInfo);
+    }
+    void GeometryPool::grow(RAIIvmaBuffer& buffer, FreeList& freeList, vk::BufferUsageFlags usage, vk::DeviceSize elementSize, uint32_t minCount) {
+        uint32_t oldCount = freeList.size();
+        uint32_t newCount = std::max(oldCount * 2, oldCount + minCount);
+        waitForFrames();
+        RAIIvmaBuffer grown = createBuffer(usage, newCount * elementSize);
+        // uploads still pending in the batch have to land before they are copied over
+        copyHandler->barrier();
+        copyHandler->submit(buffer, 0, grown, 0, oldCount * elementSize);
+        copyHandler->barrier();
+        // the old buffer is read by the copy, keep it until the batch is done
+        std::shared_ptr<RAIIvmaBuffer> old = std::make_shared<RAIIvmaBuffer>(std::move(buffer));
+        copyHandler->deferUntilComplete([old]() {});
+        buffer = std::move(grown);
+        freeList.grow(newCount);
+    }
+    GeometryRange GeometryPool::allocate(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, glm::vec4 bounds) {
+        ZoneScoped;
+        GeometryRange range{
+            .vertexCount = static_cast<uint32_t>(vertices.size()),
+            .indexCount = static_cast<uint32_t>(indices.size()),
+        };
+        if (range.vertexCount == 0 || range.indexCount == 0) return range;
+        std::optional<uint32_t> firstVertex = freeVertices.allocate(range.vertexCount);
+        if (!firstVertex) {
+            grow(vertexBuffer, freeVertices, vk::BufferUsageFlagBits::eVertexBuffer, Vertex::stride(format), range.vertexCount);
+            firstVertex = freeVertices.allocate(range.vertexCount);
+        }
+        std::optional<uint32_t> firstIndex = freeIndices.allocate(range.indexCount);
+        if (!firstIndex) {
+            grow(indexBuffer, freeIndices, vk::BufferUsageFlagBits::eIndexBuffer, sizeof(uint32_t), range.indexCount);
+            firstIndex = freeIndices.allocate(range.indexCount);
+        }
+        range.firstVertex = *firstVertex;
+        range.firstIndex = *firstIndex;
+        if (format == VertexFormat::eCompact) {
+            std::vector<CompactVertex> packed;
+            packed.reserve(vertices.size());
+            for (const Vertex& v : vertices) {
+                packed.push_back(CompactVertex::fromVertex(v, bounds));
+            }
+            vertexBuffer.copyFrom(packed.data(), range.vertexCount * sizeof(CompactVertex), range.firstVertex * sizeof(CompactVertex));
+        } else {
+            vertexBuffer.copyFrom(vertices.data(), range.vertexCount * sizeof(Vertex), range.firstVertex * sizeof(Vertex));
+        }
+        indexBuffer.copyFrom(indices.data(), range.indexCount * sizeof(uint32_t), range.firstIndex * sizeof(uint32_t));
+        return range;
+    }
+    void GeometryPool::release(GeometryRange range) {
+        if (range.vertexCount == 0 || range.indexCount == 0) return;
+        freeVertices.release(range.firstVertex, range.vertexCount);
+        freeIndices.release(range.firstIndex, range.indexCount);
+    }
+    vk::Buffer GeometryPool::vertices() const {
+        return vertexBuffer;
+    }
+    vk::Buffer GeometryPool::indices() const {
+        return indexBuffer;
+    }
+    GeometryPool::GeometryPool(GeometryPool&& other) {
+        swap(*this, other);
+    }
+    const GeometryPool& GeometryPool::operator=(GeometryPool&& other) {
+        GeometryPool t(std::move(other));
+        swap(*this, t);
+        return *this;
+    }
+    void GeometryPool::swap(GeometryPool& lhs, GeometryPool& rhs) {
+        std::swap(lhs.allocator, rhs.allocator);
+        std::swap(lhs.copyHandler, rhs.copyHandler);
+        std::swap(lhs.waitForFrames, rhs.waitForFrames);
+        std::swap(lhs.format, rhs.format);
+        RAIIvmaBuffer::swap(lhs.vertexBuffer, rhs.vertexBuffer);
+        RAIIvmaBuffer::swap(lhs.indexBuffer, rhs.indexBuffer);
+        std::swap(lhs.freeVertices, rhs.freeVertices);
+        std::swap(lhs.freeIndices, rhs.freeIndices);
+    }
+}
@@ -0,0 +1,88 @@
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <job_system.hpp>
+
+namespace volchara {
+    JobSystem::JobSystem(uint32_t workerCount) {
+        for (uint32_t i = 0; i < workerCount; i++) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+    JobSystem::~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+    uint32_t JobSystem::threadCount() const {
+        return workers.size() + 1;
+    }
+    bool JobSystem::runNextTask(uint32_t worker) {
+        const std::function<void(uint32_t, uint32_t)>* currentJob;
+        uint32_t task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (job == nullptr || nextTask >= taskCount) return false;
+            currentJob = job;
+            task = nextTask++;
+        }
+        (*currentJob)(task, worker);
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = ++finishedTasks == taskCount;
+        }
+        if (last) batchDone.notify_all();
+        return true;
+    }
+    void JobSystem::workerLoop(uint32_t worker) {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this]() { return stopping || (job != nullptr && nextTask < taskCount) || !background.empty(); });
+                if (stopping) return;
+                if (job == nullptr || nextTask >= taskCount) {
+                    task = std::move(background.front());
+                    background.pop_front();
+                }
+            }
+            if (task) {
+                task();
+                continue;
+            }
+            while (runNextTask(worker)) {}
+        }
+    }
+    void JobSystem::enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            background.push_back(std::move(task));
+        }
+        wakeUp.notify_one();
+    }
+    void JobSystem::run(uint32_t tasks, const std::function<void(uint32_t, uint32_t)>& newJob) {
+        if (tasks == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &newJob;
+            taskCount = tasks;
+            nextTask = 0;
+            finishedTasks = 0;
+        }
+        wakeUp.notify_all();
+        // the caller takes the last slot
+        while (runNextTask(workers.size())) {}
+        std::unique_lock<std::mutex> lock(mutex);
+        batchDone.wait(lock, [this]() { return finishedTasks == taskCount; });
+        job = nullptr;
+    }
+}
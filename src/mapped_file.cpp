@@ -0,0 +1,95 @@
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <mapped_file.hpp>
+
+namespace volchara {
+    MappedFile MappedFile::fromPath(const std::filesystem::path& path) {
+        MappedFile file(nullptr);
+        #if defined(_WIN32)
+        HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("failed to open file " + path.string());
+        }
+        file.fileHandle = handle;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle, &size)) {
+            throw std::runtime_error("failed to stat file " + path.string());
+        }
+        file.length = static_cast<size_t>(size.QuadPart);
+        // empty files can't be mapped, they are returned with an empty view
+        if (file.length == 0) return file;
+        file.mappingHandle = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (file.mappingHandle == nullptr) {
+            throw std::runtime_error("failed to map file " + path.string());
+        }
+        file.mapped = static_cast<const unsigned char*>(MapViewOfFile(file.mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        #else
+        file.fileDescriptor = open(path.c_str(), O_RDONLY);
+        if (file.fileDescriptor < 0) {
+            throw std::runtime_error("failed to open file " + path.string());
+        }
+        struct stat info;
+        if (fstat(file.fileDescriptor, &info) != 0) {
+            throw std::runtime_error("failed to stat file " + path.string());
+        }
+        file.length = static_cast<size_t>(info.st_size);
+        if (file.length == 0) return file;
+        void* view = mmap(nullptr, file.length, PROT_READ, MAP_PRIVATE, file.fileDescriptor, 0);
+        if (view == MAP_FAILED) {
+            file.length = 0;
+            throw std::runtime_error("failed to map file " + path.string());
+        }
+        // files are parsed front to back once, let the kernel read ahead
+        madvise(view, file.length, MADV_SEQUENTIAL);
+        file.mapped = static_cast<const unsigned char*>(view);
+        #endif
+        if (file.mapped == nullptr) {
+            throw std::runtime_error("failed to map file " + path.string());
+        }
+        return file;
+    }
+    MappedFile::~MappedFile() {
+        #if defined(_WIN32)
+        if (mapped) UnmapViewOfFile(mapped);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        if (fileHandle) CloseHandle(fileHandle);
+        #else
+        if (mapped) munmap(const_cast<unsigned char*>(mapped), length);
+        if (fileDescriptor >= 0) close(fileDescriptor);
+        #endif
+    }
+    std::span<const unsigned char> MappedFile::bytes() const {
+        return {mapped, mapped ? length : 0};
+    }
+    MappedFile::MappedFile(MappedFile&& other) {
+        swap(*this, other);
+    }
+    const MappedFile& MappedFile::operator=(MappedFile&& other) {
+        MappedFile t(std::move(other));
+        swap(*this, t);
+        return *this;
+    }
+    void MappedFile::swap(MappedFile& lhs, MappedFile& rhs) {
+        std::swap(lhs.mapped, rhs.mapped);
+        std::swap(lhs.length, rhs.length);
+        #if defined(_WIN32)
+        std::swap(lhs.fileHandle, rhs.fileHandle);
+        std::swap(lhs.mappingHandle, rhs.mappingHandle);
+        #else
+        std::swap(lhs.fileDescriptor, rhs.fileDescriptor);
+        #endif
+    }
+}
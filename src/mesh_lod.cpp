@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tracy/Tracy.hpp>
+
+#include <objects.hpp>
+
+namespace volchara {
+    // post-transform cache the triangle order is tuned for, close to what current GPUs reuse
+    constexpr uint32_t VERTEX_CACHE_SIZE = 32;
+    // a LOD keeping more of the previous one's triangles isn't worth its indices
+    constexpr float MAX_LOD_KEPT_SHARE = 0.8f;
+    constexpr uint32_t MIN_LOD_TRIANGLES = 16;
+
+    // Forsyth's score of a vertex by its place in the cache and the triangles still waiting for it
+    static float vertexScore(int32_t cachePosition, uint32_t remaining) {
+        if (remaining == 0) return -1.0f;
+        float score = 0;
+        if (cachePosition >= 0) {
+            // the last triangle's vertices score the same, whichever order they were emitted in
+            if (cachePosition < 3) {
+                score = 0.75f;
+            } else {
+                score = std::pow(1.0f - float(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+            }
+        }
+        // vertices with few triangles left are finished first, so they drop out of the cache
+        return score + 2.0f / std::sqrt(float(remaining));
+    }
+
+    // Greedy triangle order of Forsyth's linear-speed optimizer, the next triangle is the best scored one around the cache
+    static std::vector<uint32_t> optimizeVertexCache(std::span<const uint32_t> indices, uint32_t vertexCount) {
+        uint32_t triangleCount = indices.size() / 3;
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (uint32_t index : indices) {
+            offsets[index + 1]++;
+        }
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        // triangles of vertex v are adjacency[offsets[v], offsets[v] + remaining[v]), emitted ones are swapped out
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (uint32_t i = 0; i < indices.size(); i++) {
+            uint32_t v = indices[i];
+            adjacency[offsets[v] + remaining[v]++] = i / 3;
+        }
+        std::vector<int32_t> cachePositions(vertexCount, -1);
+        std::vector<float> scores(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            scores[v] = vertexScore(-1, remaining[v]);
+        }
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        std::vector<uint32_t> cache;
+        std::vector<uint32_t> nextCache;
+        std::vector<uint32_t> result;
+        result.reserve(triangleCount * 3);
+        uint32_t scanFrom = 0;
+        int64_t best = -1;
+        while (result.size() < triangleCount * 3) {
+            if (best < 0) {
+                // nothing around the cache is left, the next triangle in the original order starts over
+                while (emitted[scanFrom]) scanFrom++;
+                best = scanFrom;
+            }
+            emitted[best] = 1;
+            nextCache.clear();
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t v = indices[best * 3 + corner];
+                result.push_back(v);
+                nextCache.push_back(v);
+                uint32_t* triangles = &adjacency[offsets[v]];
+                uint32_t* found = std::find(triangles, triangles + remaining[v], static_cast<uint32_t>(best));
+                if (found != triangles + remaining[v]) {
+                    std::swap(*found, triangles[--remaining[v]]);
+                }
+            }
+            for (uint32_t v : cache) {
+                if (std::find(nextCache.begin(), nextCache.begin() + 3, v) == nextCache.begin() + 3) nextCache.push_back(v);
+            }
+            for (size_t i = VERTEX_CACHE_SIZE; i < nextCache.size(); i++) {
+                cachePositions[nextCache[i]] = -1;
+                scores[nextCache[i]] = vertexScore(-1, remaining[nextCache[i]]);
+            }
+            if (nextCache.size() > VERTEX_CACHE_SIZE) nextCache.resize(VERTEX_CACHE_SIZE);
+            std::swap(cache, nextCache);
+            for (uint32_t i = 0; i < cache.size(); i++) {
+                cachePositions[cache[i]] = i;
+                scores[cache[i]] = vertexScore(i, remaining[cache[i]]);
+            }
+            best = -1;
+            float bestScore = 0;
+            for (uint32_t v : cache) {
+                for (uint32_t t = offsets[v]; t < offsets[v] + remaining[v]; t++) {
+                    uint32_t triangle = adjacency[t];
+                    float score = scores[indices[triangle * 3]] + scores[indices[triangle * 3 + 1]] + scores[indices[triangle * 3 + 2]];
+                    if (score > bestScore) {
+                        bestScore = score;
+                        best = triangle;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // Sum of the planes around a vertex, weighted by triangle area
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0;
+        double c = 0;
+        double weight = 0;
+
+        static Quadric fromPlane(glm::dvec3 normal, double distance, double weight) {
+            return {
+                .a00 = weight * normal.x * normal.x, .a01 = weight * normal.x * normal.y, .a02 = weight * normal.x * normal.z,
+                .a11 = weight * normal.y * normal.y, .a12 = weight * normal.y * normal.z, .a22 = weight * normal.z * normal.z,
+                .b0 = weight * normal.x * distance, .b1 = weight * normal.y * distance, .b2 = weight * normal.z * distance,
+                .c = weight * distance * distance,
+                .weight = weight,
+            };
+        }
+        Quadric& operator+=(const Quadric& other) {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+            return *this;
+        }
+        // mean squared distance from the point to the planes, orders the collapses but bounds nothing
+        double error(glm::dvec3 p) const {
+            if (weight == 0) return 0;
+            double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+                + 2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+                + 2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return std::max(e, 0.0) / weight;
+        }
+    };
+
+    struct Collapse {
+        double cost = 0;
+        uint32_t from = 0;
+        uint32_t to = 0;
+    };
+
+    // Collapses edges into their cheaper end until the target is reached or nothing can collapse,
+    // error is the furthest a collapsed vertex ends up from any original triangle merged into it. Borders, texture seams included, are locked
+    static std::vector<uint32_t> simplify(std::span<const Vertex> vertices, std::span<const uint32_t> indices, uint32_t targetIndexCount, float& error) {
+        uint32_t vertexCount = vertices.size();
+        std::vector<Quadric> quadrics(vertexCount);
+        // original triangle planes around each vertex, moved along with the collapses
+        std::vector<glm::dvec4> planes;
+        std::vector<std::vector<uint32_t>> vertexPlanes(vertexCount);
+        std::unordered_map<uint64_t, uint32_t> edgeUse;
+        auto edgeKey = [](uint32_t a, uint32_t b) {
+            return (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+        };
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            glm::dvec3 p0(vertices[indices[i]].pos);
+            glm::dvec3 p1(vertices[indices[i + 1]].pos);
+            glm::dvec3 p2(vertices[indices[i + 2]].pos);
+            glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double doubleArea = glm::length(normal);
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                edgeUse[edgeKey(indices[i + corner], indices[i + (corner + 1) % 3])]++;
+            }
+            if (doubleArea == 0) continue;
+            normal /= doubleArea;
+            Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), doubleArea / 2);
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                quadrics[indices[i + corner]] += plane;
+                vertexPlanes[indices[i + corner]].push_back(planes.size());
+            }
+            planes.push_back(glm::dvec4(normal, -glm::dot(normal, p0)));
+        }
+        // an edge not shared by exactly two triangles is open or split by a seam
+        std::vector<uint8_t> locked(vertexCount, 0);
+        for (auto [key, uses] : edgeUse) {
+            if (uses == 2) continue;
+            locked[key >> 32] = 1;
+            locked[key & 0xffffffff] = 1;
+        }
+
+        std::vector<uint32_t> result(indices.begin(), indices.end());
+        std::vector<uint32_t> offsets(vertexCount + 1);
+        std::vector<uint32_t> adjacency;
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<uint8_t> touched(vertexCount);
+        double maxError = 0;
+        while (result.size() > targetIndexCount) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (uint32_t index : result) {
+                offsets[index + 1]++;
+            }
+            for (uint32_t v = 0; v < vertexCount; v++) {
+                offsets[v + 1] += offsets[v];
+            }
+            adjacency.resize(result.size());
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (uint32_t i = 0; i < result.size(); i++) {
+                adjacency[fill[result[i]]++] = i / 3;
+            }
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3) {
+                for (uint32_t corner = 0; corner < 3; corner++) {
+                    uint32_t a = result[i + corner];
+                    uint32_t b = result[i + (corner + 1) % 3];
+                    Quadric merged = quadrics[a];
+                    merged += quadrics[b];
+                    if (!locked[a]) collapses.push_back({.cost = merged.error(glm::dvec3(vertices[b].pos)), .from = a, .to = b});
+                    if (!locked[b]) collapses.push_back({.cost = merged.error(glm::dvec3(vertices[a].pos)), .from = b, .to = a});
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+            // collapses of one pass don't share triangles, the flip checks see the geometry they change
+            for (uint32_t v = 0; v < vertexCount; v++) {
+                remap[v] = v;
+            }
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t triangleCount = result.size() / 3;
+            uint32_t applied = 0;
+            for (const Collapse& collapse : collapses) {
+                if (triangleCount * 3 <= targetIndexCount) break;
+                if (touched[collapse.from] || touched[collapse.to]) continue;
+                glm::vec3 target = vertices[collapse.to].pos;
+                bool flips = false;
+                uint32_t removed = 0;
+                for (uint32_t t = offsets[collapse.from]; t < offsets[collapse.from + 1] && !flips; t++) {
+                    const uint32_t* triangle = &result[adjacency[t] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        removed++;
+                        continue;
+                    }
+                    glm::vec3 before[3] = {vertices[triangle[0]].pos, vertices[triangle[1]].pos, vertices[triangle[2]].pos};
+                    glm::vec3 after[3] = {before[0], before[1], before[2]};
+                    for (uint32_t corner = 0; corner < 3; corner++) {
+                        if (triangle[corner] == collapse.from) after[corner] = target;
+                    }
+                    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    flips = glm::dot(normalBefore, normalAfter) <= 0;
+                }
+                if (flips) continue;
+                for (uint32_t t = offsets[collapse.from]; t < offsets[collapse.from + 1]; t++) {
+                    for (uint32_t corner = 0; corner < 3; corner++) {
+                        touched[result[adjacency[t] * 3 + corner]] = 1;
+                    }
+                }
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                // the kept end never moves, its own planes were measured when they were merged into it
+                glm::dvec3 kept(target);
+                for (uint32_t plane : vertexPlanes[collapse.from]) {
+                    maxError = std::max(maxError, std::abs(glm::dot(glm::dvec3(planes[plane]), kept) + planes[plane].w));
+                }
+                std::vector<uint32_t>& keptPlanes = vertexPlanes[collapse.to];
+                keptPlanes.insert(keptPlanes.end(), vertexPlanes[collapse.from].begin(), vertexPlanes[collapse.from].end());
+                vertexPlanes[collapse.from].clear();
+                triangleCount -= removed;
+                applied++;
+            }
+            if (applied == 0) break;
+
+            size_t kept = 0;
+            for (size_t i = 0; i < result.size(); i += 3) {
+                uint32_t a = remap[result[i]];
+                uint32_t b = remap[result[i + 1]];
+                uint32_t c = remap[result[i + 2]];
+                if (a == b || b == c || a == c) continue;
+                result[kept++] = a;
+                result[kept++] = b;
+                result[kept++] = c;
+            }
+            result.resize(kept);
+        }
+        error = maxError;
+        return result;
+    }
+
+    void Mesh::buildLods() {
+        ZoneScoped;
+        lods.clear();
+        if (indices.empty()) return;
+        std::vector<uint32_t> full = optimizeVertexCache(indices, vertices.size());
+        std::vector<uint32_t> chain = full;
+        lods.push_back({.firstIndex = 0, .indexCount = static_cast<uint32_t>(full.size())});
+        while (lods.size() < MAX_MESH_LODS) {
+            uint32_t previous = lods.back().indexCount;
+            uint32_t target = previous / 6 * 3;
+            if (target < MIN_LOD_TRIANGLES * 3) break;
+            // every level starts over from the full mesh, its quadrics measure the error against the original surface
+            float error = 0;
+            std::vector<uint32_t> simplified = simplify(vertices, full, target, error);
+            if (simplified.size() > previous * MAX_LOD_KEPT_SHARE) break;
+            simplified = optimizeVertexCache(simplified, vertices.size());
+            lods.push_back({
+                .firstIndex = static_cast<uint32_t>(chain.size()),
+                .indexCount = static_cast<uint32_t>(simplified.size()),
+                .error = std::max(error, lods.back().error),
+            });
+            chain.insert(chain.end(), simplified.begin(), simplified.end());
+        }
+        indices = std::move(chain);
+    }
+}
@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <tiny_gltf.h>
+#include <tracy/Tracy.hpp>
+
+#include <model_data.hpp>
+
+namespace volchara {
+    // sections start aligned for every type stored in them, mappings and allocations are aligned further
+    constexpr size_t VMESH_SECTION_ALIGNMENT = 16;
+
+    struct SourceStamp {
+        uint64_t size = 0;
+        int64_t time = 0;
+    };
+
+    static SourceStamp stampOf(const std::filesystem::path& source) {
+        return {
+            .size = static_cast<uint64_t>(std::filesystem::file_size(source)),
+            .time = static_cast<int64_t>(std::filesystem::last_write_time(source).time_since_epoch().count()),
+        };
+    }
+
+    static std::shared_ptr<tinygltf::Model> parseGLTF(const std::filesystem::path& modelPath) {
+        auto model = std::make_shared<tinygltf::Model>();
+        tinygltf::TinyGLTF gltfLoader;
+        std::string err;
+        std::string warn;
+        std::u8string unicodeDirTmp = modelPath.parent_path().u8string();
+        std::string unicodeDir(unicodeDirTmp.begin(), unicodeDirTmp.end());
+        // images are decoded by loadTexture, tinygltf only has to keep their buffer views
+        gltfLoader.SetImageLoader([](tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*) {
+            return true;
+        }, nullptr);
+        bool res;
+        if (modelPath.extension().string() == ".gltf") {
+            MappedFile file = MappedFile::fromPath(modelPath);
+            res = gltfLoader.LoadASCIIFromString(model.get(), &err, &warn, reinterpret_cast<const char*>(file.bytes().data()), file.bytes().size(), unicodeDir);
+        }
+        else if (modelPath.extension().string() == ".glb") {
+            // the BIN chunk is copied into the model's buffers once, straight from the mapping
+            MappedFile file = MappedFile::fromPath(modelPath);
+            res = gltfLoader.LoadBinaryFromMemory(model.get(), &err, &warn, file.bytes().data(), file.bytes().size(), unicodeDir);
+        }
+        else {
+            throw std::runtime_error(std::string("failed to load gltf: unknown extension ") + modelPath.extension().string());
+        }
+        if (!res || !err.empty()) {
+            throw std::runtime_error("failed to load gltf: " + err);
+        }
+        return model;
+    }
+
+    // Collects the sections of a model before they are laid out into one buffer
+    struct VMeshBuilder {
+        std::vector<VMeshNode> nodes;
+        std::vector<uint32_t> childNodes;
+        std::vector<uint32_t> rootNodes;
+        std::vector<VMeshMesh> meshes;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<VMeshMaterial> materials;
+        std::vector<VMeshTexture> textures;
+        std::vector<unsigned char> bytes;
+
+        void addMesh(const tinygltf::Model& model, const tinygltf::Mesh& mesh);
+        void addNode(const tinygltf::Model& model, const tinygltf::Node& node);
+        void addTexture(const tinygltf::Model& model, const tinygltf::Image& image);
+        std::vector<unsigned char> serialize(SourceStamp stamp) const;
+    };
+
+    void VMeshBuilder::addMesh(const tinygltf::Model& model, const tinygltf::Mesh& mesh) {
+        VMeshMesh range{
+            .firstVertex = static_cast<uint32_t>(vertices.size()),
+            .firstIndex = static_cast<uint32_t>(indices.size()),
+        };
+        for (const tinygltf::Primitive& prim : mesh.primitives) {
+            if (prim.mode != TINYGLTF_MODE_TRIANGLES && prim.mode != 0) {
+                throw std::runtime_error("failed to load gltf: currently only triangle load available");
+            }
+
+            auto iterPosition = prim.attributes.find("POSITION");
+            if (iterPosition == prim.attributes.end()) {
+                continue;
+            }
+            const tinygltf::Accessor& accessorPosition = model.accessors[iterPosition->second];
+            if (accessorPosition.type != TINYGLTF_TYPE_VEC3 || accessorPosition.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
+                throw std::runtime_error("failed to load gltf: position not vec3 float");
+            }
+            const tinygltf::BufferView& bufferViewPosition = model.bufferViews[accessorPosition.bufferView];
+            const tinygltf::Buffer& bufferPosition = model.buffers[bufferViewPosition.buffer];
+            const float* positions = reinterpret_cast<const float*>(&bufferPosition.data[bufferViewPosition.byteOffset + accessorPosition.byteOffset]);
+
+            auto iterTexCoord = prim.attributes.find("TEXCOORD_0");
+            if (iterTexCoord == prim.attributes.end()) {
+                continue;
+            }
+            const tinygltf::Accessor& accessorTexCoord = model.accessors[iterTexCoord->second];
+            if (accessorTexCoord.type != TINYGLTF_TYPE_VEC2 || accessorTexCoord.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
+                throw std::runtime_error("failed to load gltf: uv not vec2 float");
+            }
+            const tinygltf::BufferView& bufferViewTexCoord = model.bufferViews[accessorTexCoord.bufferView];
+            const tinygltf::Buffer& bufferTexCoord = model.buffers[bufferViewTexCoord.buffer];
+            const float* texcoords = reinterpret_cast<const float*>(&bufferTexCoord.data[bufferViewTexCoord.byteOffset + accessorTexCoord.byteOffset]);
+
+            uint32_t indexOffset = vertices.size() - range.firstVertex;
+            if (prim.indices >= 0) {
+                const tinygltf::Accessor& accessorIndices = model.accessors[prim.indices];
+                const tinygltf::BufferView& bufferViewIndices = model.bufferViews[accessorIndices.bufferView];
+                const tinygltf::Buffer& bufferIndices = model.buffers[bufferViewIndices.buffer];
+                const char* primIndices = reinterpret_cast<const char*>(&bufferIndices.data[bufferViewIndices.byteOffset + accessorIndices.byteOffset]);
+                for (size_t i = 0; i < accessorIndices.count; i++) {
+                    uint32_t index = 0;
+                    switch (accessorIndices.componentType) {
+                        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                            index = reinterpret_cast<const uint8_t*>(primIndices)[i];
+                            break;
+                        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                            index = reinterpret_cast<const uint16_t*>(primIndices)[i];
+                            break;
+                        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                            index = reinterpret_cast<const uint32_t*>(primIndices)[i];
+                            break;
+                    }
+                    indices.push_back(index + indexOffset);
+                }
+            }
+            for (size_t vertexId = 0; vertexId < accessorPosition.count; vertexId++) {
+                // normals aren't read from GLTF yet, they are zero rather than uninitialized
+                Vertex v{};
+                v.pos = glm::vec3(positions[vertexId*3 + 0], positions[vertexId*3 + 1], positions[vertexId*3 + 2]);
+                v.texCoord = glm::vec2(texcoords[vertexId*2 + 0], texcoords[vertexId*2 + 1]);
+                v.color = glm::vec3(1, 0, 0);
+                if (prim.indices < 0) {
+                    indices.push_back(vertices.size() - range.firstVertex);
+                }
+                vertices.push_back(v);
+            }
+        }
+        range.vertexCount = vertices.size() - range.firstVertex;
+        // simplified once here, a bake loads its LODs without redoing them
+        Mesh lodMesh;
+        lodMesh.vertices.assign(vertices.begin() + range.firstVertex, vertices.end());
+        lodMesh.indices.assign(indices.begin() + range.firstIndex, indices.end());
+        lodMesh.buildLods();
+        indices.resize(range.firstIndex);
+        indices.insert(indices.end(), lodMesh.indices.begin(), lodMesh.indices.end());
+        range.indexCount = indices.size() - range.firstIndex;
+        range.lodCount = lodMesh.lods.size();
+        std::copy(lodMesh.lods.begin(), lodMesh.lods.end(), range.lods.begin());
+        meshes.push_back(range);
+    }
+
+    void VMeshBuilder::addNode(const tinygltf::Model& model, const tinygltf::Node& node) {
+        glm::vec3 translation{0, 0, 0};
+        glm::quat rotation(1, 0, 0, 0);
+        glm::vec3 scale{1, 1, 1};
+        if (node.translation.size() > 0) {
+            translation = {node.translation[0], node.translation[1], node.translation[2]};
+        }
+        if (node.rotation.size() > 0) {
+            rotation = {static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2]), static_cast<float>(node.rotation[3])};
+        }
+        if (node.scale.size() > 0) {
+            scale = {node.scale[0], node.scale[1], node.scale[2]};
+        }
+        if (node.matrix.size() > 0) {
+            glm::mat4 nodeMatrix = glm::mat4(
+                node.matrix[0], node.matrix[1], node.matrix[2], node.matrix[3],
+                node.matrix[4], node.matrix[5], node.matrix[6], node.matrix[7],
+                node.matrix[8], node.matrix[9], node.matrix[10], node.matrix[11],
+                node.matrix[12], node.matrix[13], node.matrix[14], node.matrix[15]
+            );
+            glm::vec3 skew;
+            glm::vec4 perspective;
+            glm::decompose(nodeMatrix, scale, rotation, translation, skew, perspective);
+        }
+        int32_t material = -1;
+        if (node.mesh > -1) {
+            for (const tinygltf::Primitive& prim : model.meshes[node.mesh].primitives) {
+                material = prim.material;
+            }
+        }
+        nodes.push_back({
+            .translation = {translation.x, translation.y, translation.z},
+            .rotation = {rotation.w, rotation.x, rotation.y, rotation.z},
+            .scale = {scale.x, scale.y, scale.z},
+            .mesh = node.mesh,
+            .material = material,
+            .firstChild = static_cast<uint32_t>(childNodes.size()),
+            .childCount = static_cast<uint32_t>(node.children.size()),
+        });
+        childNodes.insert(childNodes.end(), node.children.begin(), node.children.end());
+    }
+
+    void VMeshBuilder::addTexture(const tinygltf::Model& model, const tinygltf::Image& image) {
+        VMeshTexture texture{.offset = bytes.size()};
+        if (!image.uri.empty()) {
+            texture.external = 1;
+            bytes.insert(bytes.end(), image.uri.begin(), image.uri.end());
+        } else if (image.bufferView != -1) {
+            const tinygltf::BufferView& textureView = model.bufferViews[image.bufferView];
+            const tinygltf::Buffer& textureBuffer = model.buffers[textureView.buffer];
+            bytes.insert(bytes.end(), textureBuffer.data.begin() + textureView.byteOffset, textureBuffer.data.begin() + textureView.byteOffset + textureView.byteLength);
+        }
+        texture.size = bytes.size() - texture.offset;
+        textures.push_back(texture);
+    }
+
+    template <typename T>
+    static VMeshSection appendSection(std::vector<unsigned char>& out, const std::vector<T>& data) {
+        out.resize((out.size() + VMESH_SECTION_ALIGNMENT - 1) / VMESH_SECTION_ALIGNMENT * VMESH_SECTION_ALIGNMENT, 0);
+        VMeshSection section{.offset = out.size(), .count = data.size()};
+        const unsigned char* raw = reinterpret_cast<const unsigned char*>(data.data());
+        out.insert(out.end(), raw, raw + data.size() * sizeof(T));
+        return section;
+    }
+
+    std::vector<unsigned char> VMeshBuilder::serialize(SourceStamp stamp) const {
+        VMeshHeader header{
+            .sourceSize = stamp.size,
+            .sourceTime = stamp.time,
+        };
+        std::vector<unsigned char> out(sizeof(VMeshHeader), 0);
+        header.nodes = appendSection(out, nodes);
+        header.childNodes = appendSection(out, childNodes);
+        header.rootNodes = appendSection(out, rootNodes);
+        header.meshes = appendSection(out, meshes);
+        header.vertices = appendSection(out, vertices);
+        header.indices = appendSection(out, indices);
+        header.materials = appendSection(out, materials);
+        header.textures = appendSection(out, textures);
+        header.bytes = appendSection(out, bytes);
+        std::memcpy(out.data(), &header, sizeof(header));
+        return out;
+    }
+
+    std::filesystem::path ModelData::bakePath(const std::filesystem::path& source) {
+        std::filesystem::path bake = source;
+        bake += ".vmesh";
+        return bake;
+    }
+
+    std::shared_ptr<ModelData> ModelData::load(const std::filesystem::path& source) {
+        ZoneScoped;
+        std::filesystem::path bake = bakePath(source);
+        std::error_code error;
+        if (std::filesystem::exists(bake, error)) {
+            // a bake that can't be opened or mapped is rebuilt like a stale one
+            try {
+                std::shared_ptr<ModelData> mapped = fromVMesh(bake, source);
+                if (mapped) return mapped;
+            } catch (const std::runtime_error&) {}
+        }
+        std::shared_ptr<ModelData> parsed = fromGLTF(source);
+        // a read-only resource directory just parses the GLTF on every start
+        if (parsed->bakeable) {
+            parsed->write(bake);
+        }
+        return parsed;
+    }
+
+    std::shared_ptr<ModelData> ModelData::fromGLTF(const std::filesystem::path& source) {
+        ZoneScoped;
+        std::shared_ptr<tinygltf::Model> model = parseGLTF(source);
+        VMeshBuilder builder;
+        for (const tinygltf::Mesh& mesh : model->meshes) {
+            builder.addMesh(*model, mesh);
+        }
+        for (const tinygltf::Node& node : model->nodes) {
+            builder.addNode(*model, node);
+        }
+        const tinygltf::Scene& defScene = model->scenes[model->defaultScene];
+        builder.rootNodes.assign(defScene.nodes.begin(), defScene.nodes.end());
+        // materials point at images, the texture indirection of GLTF is resolved here
+        for (const tinygltf::Material& baseMat : model->materials) {
+            auto imageOf = [&](int textureIndex) {
+                return textureIndex > -1 ? model->textures[textureIndex].source : -1;
+            };
+            VMeshMaterial material{
+                .baseColorTexture = imageOf(baseMat.pbrMetallicRoughness.baseColorTexture.index),
+                .normalTexture = imageOf(baseMat.normalTexture.index),
+                .emissiveTexture = imageOf(baseMat.emissiveTexture.index),
+            };
+            if (baseMat.alphaMode == "MASK") {
+                material.alphaCutoff = baseMat.alphaCutoff;
+            }
+            if (baseMat.alphaMode == "BLEND") {
+                material.transparent = 1;
+            }
+            builder.materials.push_back(material);
+        }
+        for (const tinygltf::Image& image : model->images) {
+            builder.addTexture(*model, image);
+        }
+        auto data = std::make_shared<ModelData>();
+        data->baked = builder.serialize(stampOf(source));
+        // the stamp only covers the model file, edits to a separate .bin would go unnoticed by the bake
+        data->bakeable = std::none_of(model->buffers.begin(), model->buffers.end(), [](const tinygltf::Buffer& buffer) {
+            return !buffer.uri.empty() && !tinygltf::IsDataURI(buffer.uri);
+        });
+        return data;
+    }
+
+    std::shared_ptr<ModelData> ModelData::fromVMesh(const std::filesystem::path& bake, const std::filesystem::path& source) {
+        ZoneScoped;
+        auto data = std::make_shared<ModelData>();
+        data->file = MappedFile::fromPath(bake);
+        std::span<const unsigned char> bytes = data->file.bytes();
+        if (bytes.size() < sizeof(VMeshHeader)) return nullptr;
+        const VMeshHeader& header = data->header();
+        VMeshHeader expected{};
+        if (header.magic != expected.magic || header.version != VMESH_VERSION || header.vertexSize != sizeof(Vertex)) return nullptr;
+        SourceStamp stamp = stampOf(source);
+        if (header.sourceSize != stamp.size || header.sourceTime != stamp.time) return nullptr;
+        // a truncated bake is stale as well
+        auto fits = [&](const VMeshSection& range, size_t elementSize) {
+            return range.offset % VMESH_SECTION_ALIGNMENT == 0 && range.offset <= bytes.size() && range.count <= (bytes.size() - range.offset) / elementSize;
+        };
+        if (!fits(header.nodes, sizeof(VMeshNode)) || !fits(header.childNodes, sizeof(uint32_t)) || !fits(header.rootNodes, sizeof(uint32_t))
+            || !fits(header.meshes, sizeof(VMeshMesh)) || !fits(header.vertices, sizeof(Vertex)) || !fits(header.indices, sizeof(uint32_t))
+            || !fits(header.materials, sizeof(VMeshMaterial)) || !fits(header.textures, sizeof(VMeshTexture)) || !fits(header.bytes, 1)) {
+            return nullptr;
+        }
+        for (const VMeshMesh& mesh : data->meshes()) {
+            if (uint64_t(mesh.firstVertex) + mesh.vertexCount > header.vertices.count || uint64_t(mesh.firstIndex) + mesh.indexCount > header.indices.count) return nullptr;
+            if (mesh.lodCount > MAX_MESH_LODS) return nullptr;
+            for (uint32_t lod = 0; lod < mesh.lodCount; lod++) {
+                if (uint64_t(mesh.lods[lod].firstIndex) + mesh.lods[lod].indexCount > mesh.indexCount) return nullptr;
+            }
+        }
+        for (const VMeshNode& node : data->nodes()) {
+            if (node.mesh >= int64_t(header.meshes.count) || node.material >= int64_t(header.materials.count) || uint64_t(node.firstChild) + node.childCount > header.childNodes.count) return nullptr;
+        }
+        for (std::span<const uint32_t> nodeList : {data->childNodes(), data->rootNodes()}) {
+            for (uint32_t node : nodeList) {
+                if (node >= header.nodes.count) return nullptr;
+            }
+        }
+        for (const VMeshTexture& texture : data->textures()) {
+            if (texture.offset > header.bytes.count || texture.size > header.bytes.count - texture.offset) return nullptr;
+        }
+        return data;
+    }
+
+    bool ModelData::write(const std::filesystem::path& bake) const {
+        // written next to the final name and renamed, a reader never maps half a file
+        std::filesystem::path partial = bake;
+        partial += ".partial";
+        {
+            std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) return false;
+            std::span<const unsigned char> data = bytes();
+            out.write(reinterpret_cast<const char*>(data.data()), data.size());
+            if (!out) return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(partial, bake, error);
+        return !error;
+    }
+
+    std::span<const unsigned char> ModelData::bytes() const {
+        if (!baked.empty()) return baked;
+        return file.bytes();
+    }
+
+    const VMeshHeader& ModelData::header() const {
+        return *reinterpret_cast<const VMeshHeader*>(bytes().data());
+    }
+
+    template <typename T>
+    std::span<const T> ModelData::section(const VMeshSection& range) const {
+        return {reinterpret_cast<const T*>(bytes().data() + range.offset), static_cast<size_t>(range.count)};
+    }
+
+    std::span<const VMeshNode> ModelData::nodes() const {
+        return section<VMeshNode>(header().nodes);
+    }
+    std::span<const uint32_t> ModelData::childNodes() const {
+        return section<uint32_t>(header().childNodes);
+    }
+    std::span<const uint32_t> ModelData::rootNodes() const {
+        return section<uint32_t>(header().rootNodes);
+    }
+    std::span<const VMeshMesh> ModelData::meshes() const {
+        return section<VMeshMesh>(header().meshes);
+    }
+    std::span<const Vertex> ModelData::vertices() const {
+        return section<Vertex>(header().vertices);
+    }
+    std::span<const uint32_t> ModelData::indices() const {
+        return section<uint32_t>(header().indices);
+    }
+    std::span<const VMeshMaterial> ModelData::materials() const {
+        return section<VMeshMaterial>(header().materials);
+    }
+    std::span<const VMeshTexture> ModelData::textures() const {
+        return section<VMeshTexture>(header().textures);
+    }
+    std::span<const unsigned char> ModelData::textureBytes(const VMeshTexture& texture) const {
+        return section<unsigned char>(header().bytes).subspan(texture.offset, texture.size);
+    }
+}
@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <filesystem>
+#include <memory>
 #include <numeric>
+#include <span>
 #include <unordered_map>
 #include <vector>
 
@@ -8,11 +12,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/gtx/hash.hpp>
-#include <glm/gtx/matrix_decompose.hpp>
 #include <stb_image.h>
-#include <tiny_gltf.h>
 
+#include <model_data.hpp>
 #include <objects.hpp>
 #include <renderer.hpp>
 
@@ -35,22 +39,48 @@ namespace volchara {
     };
 
     bool Vertex::operator==(const Vertex& other) const {
-        return ((pos == other.pos) && (color == other.color) && (texCoord == other.texCoord));
+        return ((pos == other.pos) && (normal == other.normal) && (color == other.color) && (texCoord == other.texCoord));
     }
 
-    vk::VertexInputBindingDescription Vertex::getBindingDescription() {
+    uint32_t Vertex::stride(VertexFormat format) {
+        return format == VertexFormat::eCompact ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    vk::VertexInputBindingDescription Vertex::getBindingDescription(VertexFormat format) {
         vk::VertexInputBindingDescription bindingDescription{
             .binding = 0,
-            .stride = sizeof(Vertex),
+            .stride = stride(format),
             .inputRate = vk::VertexInputRate::eVertex,
         };
 
         return bindingDescription;
     }
 
-    std::vector<vk::VertexInputAttributeDescription> Vertex::getAttributeDescriptions() {
+    std::vector<vk::VertexInputAttributeDescription> Vertex::getAttributeDescriptions(VertexFormat format) {
         std::vector<vk::VertexInputAttributeDescription> attributeDescriptions{};
 
+        if (format == VertexFormat::eCompact) {
+            attributeDescriptions.push_back({
+                .location = 0,
+                .binding = 0,
+                .format = vk::Format::eR16G16B16A16Snorm,
+                .offset = offsetof(CompactVertex, pos),
+            });
+            attributeDescriptions.push_back({
+                .location = 1,
+                .binding = 0,
+                .format = vk::Format::eR16G16Snorm,
+                .offset = offsetof(CompactVertex, normal),
+            });
+            attributeDescriptions.push_back({
+                .location = 3,
+                .binding = 0,
+                .format = vk::Format::eR16G16Sfloat,
+                .offset = offsetof(CompactVertex, texCoord),
+            });
+            return attributeDescriptions;
+        }
+
         vk::VertexInputAttributeDescription positionDescription{
             .location = 0,
             .binding = 0,
@@ -92,6 +122,7 @@ namespace volchara {
         } else {
             parent->translation += parent->rotationQuat * glm::vec3(0, 0, -distance);
         }
+        parent->invalidate();
     }
     void Transform::Position::backward(float distance, bool world) {
         forward(-distance, world);
@@ -102,6 +133,7 @@ namespace volchara {
         } else {
             parent->translation += parent->rotationQuat * glm::vec3(-distance, 0, 0);
         }
+        parent->invalidate();
     }
     void Transform::Position::right(float distance, bool world) {
         left(-distance, world);
@@ -112,6 +144,7 @@ namespace volchara {
         } else {
             parent->translation += parent->rotationQuat * glm::vec3(0, distance, 0);
         }
+        parent->invalidate();
     }
     void Transform::Position::down(float distance, bool world) {
         up(-distance, world);
@@ -126,6 +159,7 @@ namespace volchara {
         } else {
             parent->rotationQuat = glm::normalize(parent->rotationQuat * glm::quat({degrees * glm::pi<float>() / 180, 0, 0}));
         }
+        parent->invalidate();
     }
     void Transform::Rotation::down(float degrees, bool world) {
         up(-degrees, world);
@@ -136,6 +170,7 @@ namespace volchara {
         } else {
             parent->rotationQuat = glm::normalize(parent->rotationQuat * glm::quat({0, degrees * glm::pi<float>() / 180, 0}));
         }
+        parent->invalidate();
     }
     void Transform::Rotation::right(float degrees, bool world) {
         left(-degrees, world);
@@ -146,41 +181,132 @@ namespace volchara {
         } else {
             parent->rotationQuat = glm::normalize(parent->rotationQuat * glm::quat({0, 0, -degrees * glm::pi<float>() / 180}));
         }
+        parent->invalidate();
     }
     void Transform::Rotation::ccw(float degrees, bool world) {
         cw(-degrees, world);
     }
 
-    glm::mat4 multiplyHelper(Object* current, Object* upTo) {
-        glm::mat4 translationMatrix = glm::translate(current->transform.translation);
-        glm::mat4 rotationMatrix = glm::toMat4(current->transform.rotationQuat);
-        glm::mat4 scaleMatrix = glm::scale(current->transform.scaling);
-        glm::mat4 result = translationMatrix * rotationMatrix * scaleMatrix;
-        if (current->parent == nullptr || current->parent == upTo) {
-            return result;
-        } else {
-            return multiplyHelper(current->parent, upTo) * result;
+    const glm::vec3& Transform::getTranslation() const {
+        return translation;
+    }
+    const glm::vec3& Transform::getScaling() const {
+        return scaling;
+    }
+    const glm::quat& Transform::getRotation() const {
+        return rotationQuat;
+    }
+    void Transform::setTranslation(glm::vec3 newTranslation) {
+        translation = newTranslation;
+        invalidate();
+    }
+    void Transform::setScaling(glm::vec3 newScaling) {
+        scaling = newScaling;
+        invalidate();
+    }
+    void Transform::setRotation(glm::quat newRotation) {
+        rotationQuat = newRotation;
+        invalidate();
+    }
+    void Transform::invalidate() {
+        // no early out on already dirty children, objects can be reparented under a dirty one
+        std::vector<Transform*> pending = {this};
+        while (!pending.empty()) {
+            Transform* current = pending.back();
+            pending.pop_back();
+            current->dirty = true;
+            if (current->parent == nullptr) continue;
+            if (current->parent->scene) current->parent->scene->markTransformChanged(current->parent->sceneIndex);
+            for (Object* child : current->parent->children) {
+                pending.push_back(&child->transform);
+            }
+        }
+    }
+
+    const glm::mat4& Transform::modelMatrix() {
+        Object* owner = parent;
+        Object* ownerParent = owner == nullptr ? nullptr : owner->parent;
+        if (!dirty && worldParent == ownerParent) {
+            return worldMatrix;
+        }
+        glm::mat4 translationMatrix = glm::translate(translation);
+        glm::mat4 rotationMatrix = glm::toMat4(rotationQuat);
+        glm::mat4 scaleMatrix = glm::scale(scaling);
+        worldMatrix = translationMatrix * rotationMatrix * scaleMatrix;
+        if (ownerParent != nullptr) {
+            worldMatrix = ownerParent->transform.modelMatrix() * worldMatrix;
+        }
+        worldParent = ownerParent;
+        dirty = false;
+        return worldMatrix;
+    }
+
+    static int16_t toSnorm16(float value) {
+        return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    CompactVertex CompactVertex::fromVertex(const Vertex& v, glm::vec4 bounds) {
+        float radius = bounds.w > 0 ? bounds.w : 1.0f;
+        glm::vec3 local = (v.pos - glm::vec3(bounds)) / radius;
+        bool hasNormal = v.normal != glm::vec3(0, 0, 0);
+        glm::vec2 octNormal{0, 0};
+        if (hasNormal) {
+            glm::vec3 n = v.normal / (std::abs(v.normal.x) + std::abs(v.normal.y) + std::abs(v.normal.z));
+            octNormal = glm::vec2(n);
+            if (n.z < 0) {
+                octNormal = {
+                    (1.0f - std::abs(n.y)) * (n.x >= 0 ? 1.0f : -1.0f),
+                    (1.0f - std::abs(n.x)) * (n.y >= 0 ? 1.0f : -1.0f),
+                };
+            }
         }
+        return {
+            .pos = {toSnorm16(local.x), toSnorm16(local.y), toSnorm16(local.z), toSnorm16(hasNormal ? 1.0f : 0.0f)},
+            .normal = {toSnorm16(octNormal.x), toSnorm16(octNormal.y)},
+            .texCoord = {static_cast<uint16_t>(glm::packHalf1x16(v.texCoord.x)), static_cast<uint16_t>(glm::packHalf1x16(v.texCoord.y))},
+        };
     }
 
-    glm::mat4 Transform::modelMatrix() {
-        glm::mat4 result = multiplyHelper(this->parent, nullptr);
-        return result;
+    void Mesh::computeBounds() {
+        if (vertices.empty()) {
+            bounds = {0, 0, 0, 0};
+            return;
+        }
+        glm::vec3 minPos = vertices[0].pos;
+        glm::vec3 maxPos = vertices[0].pos;
+        for (const Vertex& v : vertices) {
+            minPos = glm::min(minPos, v.pos);
+            maxPos = glm::max(maxPos, v.pos);
+        }
+        glm::vec3 center = (minPos + maxPos) / 2.0f;
+        float radius = 0;
+        for (const Vertex& v : vertices) {
+            radius = std::max(radius, glm::distance(center, v.pos));
+        }
+        bounds = glm::vec4(center, radius);
+    }
+    uint32_t Mesh::lodCount() const {
+        return lods.empty() ? 1 : lods.size();
+    }
+    MeshLod Mesh::lod(uint32_t level) const {
+        if (lods.empty()) return {.firstIndex = 0, .indexCount = static_cast<uint32_t>(indices.size())};
+        return lods[std::min<size_t>(level, lods.size() - 1)];
     }
 
     Object::Object(Renderer& renderer, std::vector<Vertex> initVertices, std::vector<uint32_t> initIndices, glm::vec3 translation, glm::vec3 scaling, glm::quat rotation) {
         this->renderer = &renderer;
-        vertices = initVertices;
+        mesh = std::make_shared<Mesh>();
+        mesh->vertices = initVertices;
         if (initIndices.empty()) {
-            indices = std::vector<uint32_t>(vertices.size());
-            std::iota(indices.begin(), indices.end(), 0);
+            mesh->indices = std::vector<uint32_t>(initVertices.size());
+            std::iota(mesh->indices.begin(), mesh->indices.end(), 0);
         }
         else {
-            indices = initIndices;
+            mesh->indices = initIndices;
         }
-        transform.translation = translation;
-        transform.scaling = scaling;
-        transform.rotationQuat = rotation;
+        transform.setTranslation(translation);
+        transform.setScaling(scaling);
+        transform.setRotation(rotation);
     }
     Object::Object(Object&& other) {
         std::swap(parent, other.parent);
@@ -188,8 +314,12 @@ namespace volchara {
         for (Object* ptr : children) {
             ptr->parent = this;
         }
-        std::swap(vertices, other.vertices);
-        std::swap(indices, other.indices);
+        std::swap(mesh, other.mesh);
+        std::swap(resident, other.resident);
+        std::swap(scene, other.scene);
+        std::swap(sceneIndex, other.sceneIndex);
+        // the scene still points at the old address
+        if (scene) scene->markLayoutChanged();
         std::swap(frameCallbacks, other.frameCallbacks);
         std::swap(transform, other.transform);
         transform.parent = this;
@@ -202,37 +332,76 @@ namespace volchara {
         std::swap(alphaCutoff, other.alphaCutoff);
         std::swap(transparent, other.transparent);
     }
+    Object::~Object() {
+        if (renderer) setTextures(0, 0, 0);
+    }
     void Object::runFrameCallbacks(FrameCallbackData cbData) {
         for (auto callback : frameCallbacks) {
             callback(this, cbData);
         }
         return;
     }
+    void Object::addChild(Object* child) {
+        if (child->parent) child->parent->removeChild(child);
+        child->parent = this;
+        children.push_back(child);
+        child->transform.invalidate();
+        if (scene) scene->markLayoutChanged();
+        if (child->scene) child->scene->markLayoutChanged();
+    }
+    void Object::removeChild(Object* child) {
+        auto childPos = std::find(children.begin(), children.end(), child);
+        if (childPos == children.end()) return;
+        children.erase(childPos);
+        child->parent = nullptr;
+        child->transform.invalidate();
+        if (scene) scene->markLayoutChanged();
+    }
     void Object::setColor(std::array<float, 3> color) {
-        for (Vertex& v : vertices) {
+        // copy on write, instances sharing the mesh keep their color
+        std::shared_ptr<Mesh> colored = std::make_shared<Mesh>();
+        colored->vertices = mesh->vertices;
+        colored->indices = mesh->indices;
+        colored->lods = mesh->lods;
+        for (Vertex& v : colored->vertices) {
             v.color.r = color[0];
             v.color.g = color[1];
             v.color.b = color[2];
         }
+        replaceMesh(colored);
     }
     void Object::replaceTextures(const std::filesystem::path path) {
-        int newTextureIndex;
-        if (renderer->textureNameToId.contains(path.filename().string())) {
-            newTextureIndex = renderer->textureNameToId[path.filename().string()];
-        } else {
-            std::vector<unsigned char> textureData = renderer->readFile(path);
-            newTextureIndex = renderer->createTextureImage(textureData);
-            renderer->textureNameToId[path.filename().string()] = newTextureIndex;
-            renderer->loadTextureToDescriptors(newTextureIndex);
-        }
+        uint32_t newTextureIndex = renderer->loadTexture(path);
         std::vector<Object*> toReplace = {this};
         for (int i = 0; i < toReplace.size(); i++) {
             for (Object* ptr : toReplace[i]->children) {
                 toReplace.push_back(ptr);
             }
-            toReplace[i]->textureIndex = newTextureIndex;
+            toReplace[i]->setTextures(newTextureIndex, toReplace[i]->getNormalIndex(), toReplace[i]->getEmissiveIndex());
         }
     }
+    void Object::setTextures(uint32_t newTextureIndex, uint32_t newNormalIndex, uint32_t newEmissiveIndex) {
+        // retained before releasing, so a texture kept across the call never drops to zero
+        for (uint32_t index : {newTextureIndex, newNormalIndex, newEmissiveIndex}) {
+            renderer->retainTexture(index);
+        }
+        for (uint32_t index : {textureIndex, normalIndex, emissiveIndex}) {
+            renderer->releaseTextureReference(index);
+        }
+        textureIndex = newTextureIndex;
+        normalIndex = newNormalIndex;
+        emissiveIndex = newEmissiveIndex;
+        if (scene) scene->markRenderDataChanged(sceneIndex);
+    }
+    uint32_t Object::getTextureIndex() const {
+        return textureIndex;
+    }
+    uint32_t Object::getNormalIndex() const {
+        return normalIndex;
+    }
+    uint32_t Object::getEmissiveIndex() const {
+        return emissiveIndex;
+    }
     void Object::generateIndices(std::vector<Vertex> fromVertices) {
         std::vector<Vertex> newVertices;
         std::vector<uint32_t> newIndices;
@@ -247,8 +416,33 @@ namespace volchara {
                 newIndices.push_back(pos->second);
             }
         }
-        vertices = newVertices;
-        indices = newIndices;
+        std::shared_ptr<Mesh> indexed = std::make_shared<Mesh>();
+        indexed->vertices = newVertices;
+        indexed->indices = newIndices;
+        replaceMesh(indexed);
+    }
+    const std::shared_ptr<Mesh>& Object::getMesh() const {
+        return mesh;
+    }
+    void Object::replaceMesh(std::shared_ptr<Mesh> newMesh) {
+        bool wasResident = resident;
+        if (wasResident) renderer->releaseGeometry(this);
+        mesh = newMesh;
+        if (wasResident) renderer->acquireGeometry(this);
+    }
+    float Object::getAlphaCutoff() const {
+        return alphaCutoff;
+    }
+    bool Object::isTransparent() const {
+        return transparent;
+    }
+    void Object::setAlphaCutoff(float newAlphaCutoff) {
+        alphaCutoff = newAlphaCutoff;
+        if (scene) scene->markRenderDataChanged(sceneIndex);
+    }
+    void Object::setTransparent(bool newTransparent) {
+        transparent = newTransparent;
+        if (scene) scene->markRenderDataChanged(sceneIndex);
     }
 
     Plane Plane::fromWorldCoordinates(Renderer& renderer, InitDataPlane initVertices, bool wIndices) {
@@ -277,213 +471,79 @@ namespace volchara {
         return obj;
     }
 
-    Object* GLTFModel::traverseNode(Renderer &renderer, tinygltf::Model& model, int nodeId, std::map<int, int>& textureMapping) {
-        tinygltf::Node& node = model.nodes[nodeId];
-        Object* rootObject;
-        std::vector<Vertex> resVertices;
-        std::vector<uint32_t> resIndices;
-        glm::vec3 translation{0, 0, 0};
-        glm::quat rotation(1, 0, 0, 0);
-        glm::vec3 scale{1, 1, 1};
-        int materialIndex = -1;
+    Object* GLTFModel::traverseNode(Renderer &renderer, const ModelData& model, const std::string& modelName, uint32_t nodeId, const std::vector<uint32_t>& textureMapping) {
+        const VMeshNode& node = model.nodes()[nodeId];
+        glm::vec3 translation(node.translation[0], node.translation[1], node.translation[2]);
+        glm::quat rotation(node.rotation[0], node.rotation[1], node.rotation[2], node.rotation[3]);
+        glm::vec3 scale(node.scale[0], node.scale[1], node.scale[2]);
+        Object* rootObject = new Object(renderer, {}, {}, translation, scale, rotation);
         if (node.mesh > -1) {
-            tinygltf::Mesh& mesh = model.meshes[node.mesh];
-            for (const tinygltf::Primitive prim : mesh.primitives) {
-                materialIndex = prim.material;
-                if (prim.mode != TINYGLTF_MODE_TRIANGLES && prim.mode != 0) {
-                    throw std::runtime_error("failed to load gltf: currently only triangle load available");
-                }
-
-                auto iterPosition = prim.attributes.find("POSITION");
-                if (iterPosition == prim.attributes.end()) {
-                    continue;
-                }
-                tinygltf::Accessor accessorPosition = model.accessors[iterPosition->second];
-                if (accessorPosition.type != TINYGLTF_TYPE_VEC3 || accessorPosition.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
-                    throw std::runtime_error("failed to load gltf: position not vec3 float");
-                }
-                tinygltf::BufferView& bufferViewPosition = model.bufferViews[accessorPosition.bufferView];
-                tinygltf::Buffer& bufferPosition = model.buffers[bufferViewPosition.buffer];
-                const float* positions = reinterpret_cast<const float*>(&bufferPosition.data[bufferViewPosition.byteOffset + accessorPosition.byteOffset]);
-
-                auto iterTexCoord = prim.attributes.find("TEXCOORD_0");
-                if (iterTexCoord == prim.attributes.end()) {
-                    continue;
-                }
-                tinygltf::Accessor accessorTexCoord = model.accessors[iterTexCoord->second];
-                if (accessorTexCoord.type != TINYGLTF_TYPE_VEC2 || accessorTexCoord.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
-                    throw std::runtime_error("failed to load gltf: uv not vec2 float");
-                }
-                tinygltf::BufferView& bufferViewTexCoord = model.bufferViews[accessorTexCoord.bufferView];
-                tinygltf::Buffer& bufferTexCoord = model.buffers[bufferViewTexCoord.buffer];
-                const float* texcoords = reinterpret_cast<const float*>(&bufferTexCoord.data[bufferViewTexCoord.byteOffset + accessorTexCoord.byteOffset]);
-
-                if (prim.indices >= 0) {
-                    uint32_t indexOffset = resVertices.size();
-                    tinygltf::Accessor accessorIndices = model.accessors[prim.indices];
-                    tinygltf::BufferView& bufferViewIndices = model.bufferViews[accessorIndices.bufferView];
-                    tinygltf::Buffer& bufferIndices = model.buffers[bufferViewIndices.buffer];
-                    const char* indices = reinterpret_cast<const char*>(&bufferIndices.data[bufferViewIndices.byteOffset + accessorIndices.byteOffset]);
-                    for (size_t i = 0; i < accessorIndices.count; i++) {
-                        uint32_t index;
-                        switch (accessorIndices.componentType) {
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                                index = reinterpret_cast<const uint8_t*>(indices)[i];
-                                break;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                                index = reinterpret_cast<const uint16_t*>(indices)[i];
-                                break;
-                            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                                index = reinterpret_cast<const uint32_t*>(indices)[i];
-                                break;
-                        }
-                        resIndices.push_back(index + indexOffset);
-                    }
-                    for (size_t vertexId = 0; vertexId < accessorPosition.count; vertexId++) {
-                        Vertex v;
-                        v.pos = glm::vec3(positions[vertexId*3 + 0], positions[vertexId*3 + 1], positions[vertexId*3 + 2]);
-                        v.texCoord = glm::vec2(texcoords[vertexId*2 + 0], texcoords[vertexId*2 + 1]);
-                        v.color = glm::vec3(1, 0, 0);
-                        resVertices.push_back(v);
-                    }
-                }
-                else {
-                    for (size_t i = 0; i < accessorPosition.count; i++) {
-                        Vertex v;
-                        v.pos = glm::vec3(positions[i*3 + 0], positions[i*3 + 1], positions[i*3 + 2]);
-                        v.texCoord = glm::vec2(texcoords[i*2 + 0], texcoords[i*2 + 1]);
-                        v.color = glm::vec3(1, 0, 0);
-                        resIndices.push_back(resVertices.size());
-                        resVertices.push_back(v);
-                    }
-                }
+            std::string meshName = std::format("{}:{}", modelName, node.mesh);
+            if (!renderer.meshCache.contains(meshName)) {
+                // the only copy of the baked geometry, the upload reads it from the mesh
+                const VMeshMesh& range = model.meshes()[node.mesh];
+                std::span<const Vertex> vertices = model.vertices().subspan(range.firstVertex, range.vertexCount);
+                std::span<const uint32_t> indices = model.indices().subspan(range.firstIndex, range.indexCount);
+                std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+                mesh->vertices.assign(vertices.begin(), vertices.end());
+                mesh->indices.assign(indices.begin(), indices.end());
+                mesh->lods.assign(range.lods.begin(), range.lods.begin() + range.lodCount);
+                renderer.meshCache[meshName] = mesh;
             }
+            rootObject->replaceMesh(renderer.meshCache[meshName]);
         }
-        if (node.translation.size() > 0) {
-            translation = {node.translation[0], node.translation[1], node.translation[2]};
-        }
-        if (node.rotation.size() > 0) {
-            rotation = {static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2]), static_cast<float>(node.rotation[3])};
-        }
-        if (node.scale.size() > 0) {
-            scale = {node.scale[0], node.scale[1], node.scale[2]};
-        }
-        if (node.matrix.size() > 0) {
-            glm::mat4 nodeMatrix = glm::mat4(
-                node.matrix[0], node.matrix[1], node.matrix[2], node.matrix[3],
-                node.matrix[4], node.matrix[5], node.matrix[6], node.matrix[7],
-                node.matrix[8], node.matrix[9], node.matrix[10], node.matrix[11],
-                node.matrix[12], node.matrix[13], node.matrix[14], node.matrix[15]
-            );
-            glm::vec3 skew;
-            glm::vec4 perspective;
-            glm::decompose(nodeMatrix, scale, rotation, translation, skew, perspective);
-        }
-        rootObject = new Object(renderer, resVertices, resIndices, translation, scale, rotation);
-        if (materialIndex > -1) {
-            tinygltf::Material& baseMat = model.materials[materialIndex];
-            if (baseMat.pbrMetallicRoughness.baseColorTexture.index > -1) {
-                rootObject->textureIndex = textureMapping[baseMat.pbrMetallicRoughness.baseColorTexture.index];
+        if (node.material > -1) {
+            const VMeshMaterial& baseMat = model.materials()[node.material];
+            uint32_t baseColor = 0, normal = 0, emissive = 0;
+            if (baseMat.baseColorTexture > -1) {
+                baseColor = textureMapping[baseMat.baseColorTexture];
             }
-            if (baseMat.normalTexture.index > -1) {
-                rootObject->normalIndex = textureMapping[baseMat.normalTexture.index];
+            if (baseMat.normalTexture > -1) {
+                normal = textureMapping[baseMat.normalTexture];
             }
-            if (baseMat.emissiveTexture.index > -1) {
-                rootObject->emissiveIndex = textureMapping[baseMat.emissiveTexture.index];
-            }
-            if (baseMat.alphaMode == "MASK") {
-                rootObject->alphaCutoff = baseMat.alphaCutoff;
-            }
-            if (baseMat.alphaMode == "BLEND") {
-                rootObject->transparent = true;
+            if (baseMat.emissiveTexture > -1) {
+                emissive = textureMapping[baseMat.emissiveTexture];
             }
+            rootObject->setTextures(baseColor, normal, emissive);
+            rootObject->setAlphaCutoff(baseMat.alphaCutoff);
+            rootObject->setTransparent(baseMat.transparent);
         }
-        for (int child : node.children) {
-            Object* object = traverseNode(renderer, model, child, textureMapping);
-            object->parent = rootObject;
-            rootObject->children.push_back(object);
+        for (uint32_t child : model.childNodes().subspan(node.firstChild, node.childCount)) {
+            Object* object = traverseNode(renderer, model, modelName, child, textureMapping);
+            rootObject->addChild(object);
         }
         return rootObject;
     }
     
     Object GLTFModel::fromFile(Renderer &renderer, std::filesystem::path modelPath) {
-        tinygltf::Model model;
-        if (renderer.modelCache.contains(modelPath.filename().string())) {
-            model = renderer.modelCache[modelPath.filename().string()];
-        } else {
-            tinygltf::TinyGLTF gltfLoader;
-            std::string err;
-            std::string warn;
-            std::u8string unicodePathTmp = modelPath.u8string();
-            std::string unicodePath(unicodePathTmp.begin(), unicodePathTmp.end());
-            bool res;
-            if (modelPath.extension().string() == ".gltf") {
-                res = gltfLoader.LoadASCIIFromFile(&model, &err, &warn, unicodePath);
-            }
-            else if (modelPath.extension().string() == ".glb") {
-                res = gltfLoader.LoadBinaryFromFile(&model, &err, &warn, unicodePath);
-            }
-            else {
-                throw std::runtime_error(std::string("failed to load gltf: unknown extension ") + modelPath.extension().string());
-            }
-            if (!res || !err.empty()) {
-                throw std::runtime_error("failed to load gltf: " + err);
-            }
-            renderer.modelCache[modelPath.filename().string()] = model;
-        }
+        // instances use the cached model in place, a fresh bake is read straight from its mapping
+        const ModelData& model = renderer.loadModel(modelPath);
+        std::string modelName = modelPath.filename().string();
 
-        bool solid_color;
-        if (model.textures.size() < 1) {
-            solid_color = true;
-        }
-        else {
-            solid_color = false;
-        }
-        std::map<int, int> textureMapping;
-        for (tinygltf::Texture& texture : model.textures) {
-            int modelTextureId = texture.source;
-            if (!model.images[modelTextureId].uri.empty()) {
-                // external
-                std::filesystem::path texturePath = modelPath.parent_path() / model.images[modelTextureId].uri;
-                int rendererTextureId;
-                if (renderer.textureNameToId.contains(texturePath.filename().string())) {
-                    rendererTextureId = renderer.textureNameToId[texturePath.filename().string()];
-                } else {
-                    std::vector<unsigned char> textureData = renderer.readFile(texturePath);
-                    rendererTextureId = renderer.createTextureImage(textureData);
-                    renderer.textureNameToId[texturePath.filename().string()] = rendererTextureId;
-                    renderer.loadTextureToDescriptors(rendererTextureId);
-                }
-                textureMapping[modelTextureId] = rendererTextureId;
+        std::vector<uint32_t> textureMapping;
+        for (uint32_t imageId = 0; imageId < model.textures().size(); imageId++) {
+            const VMeshTexture& texture = model.textures()[imageId];
+            std::span<const unsigned char> textureData = model.textureBytes(texture);
+            if (texture.external) {
+                std::filesystem::path texturePath = modelPath.parent_path() / std::string(textureData.begin(), textureData.end());
+                textureMapping.push_back(renderer.loadTexture(texturePath));
+                continue;
+            }
+            std::string textureName = std::format("{}:{}", modelName, imageId);
+            if (renderer.textureNameToId.contains(textureName)) {
+                textureMapping.push_back(renderer.textureNameToId[textureName]);
+            } else if (!textureData.empty()) {
+                // the cached model outlives the load, so the decoder reads the bytes in place
+                textureMapping.push_back(renderer.loadTexture(textureName, textureData));
             } else {
-                // internal
-                std::string textureName = std::format("{}:{}", modelPath.filename().string(), modelTextureId);
-                if (renderer.textureNameToId.contains(textureName)) {
-                    textureMapping[modelTextureId] = renderer.textureNameToId[textureName];
-                } else {
-                    int targetBufferView = model.images[modelTextureId].bufferView;
-                    if (targetBufferView != -1) {
-                        tinygltf::BufferView& textureView = model.bufferViews[targetBufferView];
-                        tinygltf::Buffer& texturePosition = model.buffers[textureView.buffer];
-                        std::vector<unsigned char> textureData = std::vector<unsigned char>(texturePosition.data.begin() + textureView.byteOffset, texturePosition.data.begin() + textureView.byteOffset + textureView.byteLength);
-                        int rendererTextureId = renderer.createTextureImage(textureData);
-                        renderer.textureNameToId[textureName] = rendererTextureId;
-                        renderer.loadTextureToDescriptors(rendererTextureId);
-                        textureMapping[modelTextureId] = rendererTextureId;
-                    } else {
-                        textureMapping[modelTextureId] = 0;
-                    }
-                }
+                textureMapping.push_back(0);
             }
         }
-        
-        tinygltf::Scene& defScene = model.scenes[model.defaultScene];
+
         Object* rootObject = new Object(renderer, {});
-        std::vector<int> nodes(defScene.nodes.begin(), defScene.nodes.end());
-        for (int nodeId : nodes) {
-            Object* object = traverseNode(renderer, model, nodeId, textureMapping);
-            object->parent = rootObject;
-            rootObject->children.push_back(object);
+        for (uint32_t nodeId : model.rootNodes()) {
+            Object* object = traverseNode(renderer, model, modelName, nodeId, textureMapping);
+            rootObject->addChild(object);
         }
         return std::move(*rootObject);
     }
@@ -568,7 +628,7 @@ namespace volchara {
         DirectionalLight light(renderer);
         light.brightness = initData.brightness;
         light.color = color;
-        light.transform.translation = position;
+        light.transform.setTranslation(position);
         return light;
     }
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include <algorithm>
+#include <cstring>
+#include <optional>
 #include <utility>
+#include <vector>
 
 #include <vulkan/vulkan_raii.hpp>
 #include <vk_mem_alloc.hpp>
@@ -8,7 +11,83 @@
 #include <device_buffer_copy_handler.hpp>
 
 namespace volchara {
-    RAIIvmaBuffer::RAIIvmaBuffer(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::BufferCreateInfo bufferInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler) {
+    StagingRing::StagingRing(vma::Allocator fromAllocator, DeviceBufferCopyHandler& handler, vk::DeviceSize size) {
+        allocator = fromAllocator;
+        copyHandler = &handler;
+        capacity = size;
+        vk::BufferCreateInfo bufInfo{
+            .size = size,
+            .usage = vk::BufferUsageFlagBits::eTransferSrc,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        vma::AllocationCreateInfo allocInfo{
+            .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+            .usage = vma::MemoryUsage::eAuto,
+        };
+        std::pair<vk::Buffer, vma::Allocation> p = allocator.createBuffer(bufInfo, allocInfo);
+        buf = p.first;
+        alloc = p.second;
+        mapped = static_cast<unsigned char*>(allocator.getAllocationInfo(alloc).pMappedData);
+    }
+    StagingRing::~StagingRing() {
+        if (buf)
+            allocator.destroyBuffer(buf, alloc);
+        buf = nullptr;
+        alloc = nullptr;
+    }
+    void StagingRing::reclaim() {
+        while (!regions.empty() && copyHandler->isComplete(regions.front().ticket)) {
+            regions.pop_front();
+        }
+    }
+    std::optional<vk::DeviceSize> StagingRing::findSpace(vk::DeviceSize size, vk::DeviceSize alignment) {
+        if (regions.empty()) return 0;
+        vk::DeviceSize head = (regions.back().end + alignment - 1) / alignment * alignment;
+        vk::DeviceSize tail = regions.front().begin;
+        bool wrapped = regions.back().begin < regions.front().begin;
+        if (!wrapped) {
+            if (head + size <= capacity) return head;
+            if (size <= tail) return 0;
+        } else if (head + size <= tail) {
+            return head;
+        }
+        return std::nullopt;
+    }
+    StagingAllocation StagingRing::stageDedicated(const void* data, vk::DeviceSize size) {
+        vk::BufferCreateInfo bufInfo{
+            .size = size,
+            .usage = vk::BufferUsageFlagBits::eTransferSrc,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        vma::AllocationCreateInfo allocInfo{
+            .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+            .usage = vma::MemoryUsage::eAuto,
+        };
+        std::pair<vk::Buffer, vma::Allocation> p = allocator.createBuffer(bufInfo, allocInfo);
+        allocator.copyMemoryToAllocation(data, p.second, 0, size);
+        copyHandler->deferUntilComplete([allocator = allocator, p]() { allocator.destroyBuffer(p.first, p.second); });
+        return {.buffer = p.first, .offset = 0};
+    }
+    StagingAllocation StagingRing::stage(const void* data, vk::DeviceSize size, vk::DeviceSize alignment) {
+        if (size > capacity) {
+            // doesn't fit even into an empty ring
+            return stageDedicated(data, size);
+        }
+        reclaim();
+        std::optional<vk::DeviceSize> offset = findSpace(size, alignment);
+        while (!offset) {
+            // ring is full: wait for the oldest batch still reading from it
+            copyHandler->wait(regions.front().ticket);
+            reclaim();
+            offset = findSpace(size, alignment);
+        }
+        std::memcpy(mapped + *offset, data, size);
+        allocator.flushAllocation(alloc, *offset, size);
+        regions.push_back({.begin = *offset, .end = *offset + size, .ticket = copyHandler->pendingTicket()});
+        return {.buffer = buf, .offset = *offset};
+    }
+
+    RAIIvmaBuffer::RAIIvmaBuffer(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::BufferCreateInfo bufferInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler, StagingRing& stagingRing) {
         this->dev = &dev;
         allocator = &fromAllocator;
         std::pair<vk::Buffer, vma::Allocation> p = allocator->createBuffer(bufferInfo, allocInfo);
@@ -16,6 +95,7 @@ namespace volchara {
         alloc = p.second;
         if (allocInfo.flags & vma::AllocationCreateFlagBits::eHostAccessSequentialWrite) mappable = true;
         copyHandler = &handler;
+        staging = &stagingRing;
     }
     RAIIvmaBuffer::~RAIIvmaBuffer() {
         if (buf)
@@ -37,24 +117,13 @@ namespace volchara {
     RAIIvmaBuffer::operator vma::Allocation() const {
         return alloc;
     }
-    void RAIIvmaBuffer::copyFrom(void* buffer, uint32_t size) {
+    void RAIIvmaBuffer::copyFrom(const void* buffer, uint32_t size, vk::DeviceSize dstOffset) {
         if (mappable) {
-            allocator->copyMemoryToAllocation(buffer, alloc, 0, size);
+            allocator->copyMemoryToAllocation(buffer, alloc, dstOffset, size);
         }
         else {
-            vk::BufferCreateInfo bufInfo{
-                .size = size,
-                .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                .sharingMode = vk::SharingMode::eExclusive,
-            };
-            vma::AllocationCreateInfo allocInfo{
-                .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-                .usage = vma::MemoryUsage::eAuto,
-            };
-            std::pair<vk::Buffer, vma::Allocation> p = allocator->createBuffer(bufInfo, allocInfo);
-            allocator->copyMemoryToAllocation(buffer, p.second, 0, size);
-            copyHandler->submit(p.first, buf, size);
-            allocator->destroyBuffer(p.first, p.second);
+            StagingAllocation src = staging->stage(buffer, size);
+            copyHandler->submit(src.buffer, src.offset, buf, dstOffset, size);
         }
     }
     vma::AllocationInfo RAIIvmaBuffer::allocInfo() {
@@ -67,9 +136,10 @@ namespace volchara {
         std::swap(lhs.alloc, rhs.alloc);
         std::swap(lhs.mappable, rhs.mappable);
         std::swap(lhs.copyHandler, rhs.copyHandler);
+        std::swap(lhs.staging, rhs.staging);
     }
 
-    RAIIvmaImage::RAIIvmaImage(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::ImageCreateInfo imageInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler, vk::ImageAspectFlags aspectFlags) {
+    RAIIvmaImage::RAIIvmaImage(vk::raii::Device& dev, vma::Allocator& fromAllocator, vk::ImageCreateInfo imageInfo, vma::AllocationCreateInfo allocInfo, DeviceBufferCopyHandler& handler, StagingRing& stagingRing, vk::ImageAspectFlags aspectFlags) {
         this->dev = &dev;
         allocator = &fromAllocator;
         std::pair<vk::Image, vma::Allocation> p = allocator->createImage(imageInfo, allocInfo);
@@ -83,14 +153,16 @@ namespace volchara {
             .subresourceRange = {
                 .aspectMask = aspectFlags,
                 .baseMipLevel = 0,
-                .levelCount = 1,
+                .levelCount = imageInfo.mipLevels,
                 .baseArrayLayer = 0,
                 .layerCount = 1,
             },
         };
         imgView = this->dev->createImageView(viewInfo);
         copyHandler = &handler;
+        staging = &stagingRing;
         imageExtent = imageInfo.extent;
+        mipLevels = imageInfo.mipLevels;
     }
     RAIIvmaImage::~RAIIvmaImage() {
         if (img)
@@ -112,26 +184,28 @@ namespace volchara {
     RAIIvmaImage::operator vma::Allocation() const {
         return alloc;
     }
-    void RAIIvmaImage::copyFrom(void* buffer, uint32_t size) {
+    void RAIIvmaImage::copyFrom(const void* buffer, uint32_t size) {
         if (mappable) {
             allocator->copyMemoryToAllocation(buffer, alloc, 0, size);
         }
         else {
-            vk::BufferCreateInfo bufInfo{
-                .size = size,
-                .usage = vk::BufferUsageFlagBits::eTransferSrc,
-                .sharingMode = vk::SharingMode::eExclusive,
-            };
-            vma::AllocationCreateInfo allocInfo{
-                .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-                .usage = vma::MemoryUsage::eAuto,
-            };
-            std::pair<vk::Buffer, vma::Allocation> p = allocator->createBuffer(bufInfo, allocInfo);
-            allocator->copyMemoryToAllocation(buffer, p.second, 0, size);
-            copyHandler->submit(p.first, img, imageExtent);
-            allocator->destroyBuffer(p.first, p.second);
+            StagingAllocation src = staging->stage(buffer, size);
+            copyHandler->submit(src.buffer, src.offset, img, imageExtent);
         }
     }
+    void RAIIvmaImage::copyLevels(const void* buffer, uint32_t size, std::vector<vk::BufferImageCopy> regions, vk::ImageLayout finalLayout) {
+        StagingAllocation src = staging->stage(buffer, size);
+        for (vk::BufferImageCopy& region : regions) {
+            region.bufferOffset += src.offset;
+        }
+        copyHandler->submit(src.buffer, img, regions, mipLevels, finalLayout);
+    }
+    uint32_t RAIIvmaImage::levels() const {
+        return mipLevels;
+    }
+    vk::DeviceSize RAIIvmaImage::memorySize() {
+        return allocator->getAllocationInfo(alloc).size;
+    }
     const vk::ImageView RAIIvmaImage::imageView() {
         return *imgView;
     }
@@ -143,6 +217,9 @@ namespace volchara {
         std::swap(lhs.alloc, rhs.alloc);
         std::swap(lhs.mappable, rhs.mappable);
         std::swap(lhs.copyHandler, rhs.copyHandler);
+        std::swap(lhs.staging, rhs.staging);
+        std::swap(lhs.imageExtent, rhs.imageExtent);
+        std::swap(lhs.mipLevels, rhs.mipLevels);
     }
 
     RAIIAllocator::RAIIAllocator(vk::raii::Instance& inst, vk::raii::PhysicalDevice& physDev, vk::raii::Device& device, DeviceBufferCopyHandler& handler) {
@@ -155,27 +232,58 @@ namespace volchara {
         };
         vmaAlloc = vma::createAllocator(allocInfo);
         copyHandler = &handler;
+        staging = std::make_unique<StagingRing>(vmaAlloc, handler, STAGING_RING_SIZE);
     }
     RAIIAllocator::~RAIIAllocator() {
+        staging.reset();
         vmaAlloc.destroy();
     }
     RAIIAllocator::RAIIAllocator(RAIIAllocator&& other) {
         std::swap(vmaAlloc, other.vmaAlloc);
         std::swap(dev, other.dev);
         std::swap(copyHandler, other.copyHandler);
+        std::swap(staging, other.staging);
     }
     const RAIIAllocator& RAIIAllocator::operator=(RAIIAllocator&& other) {
         RAIIAllocator t(std::move(other));
         std::swap(vmaAlloc, t.vmaAlloc);
         std::swap(dev, t.dev);
         std::swap(copyHandler, t.copyHandler);
+        std::swap(staging, t.staging);
         return *this;
     }
 
     RAIIvmaBuffer RAIIAllocator::createBuffer(vk::BufferCreateInfo bufferInfo, vma::AllocationCreateInfo allocInfo) {
-        return RAIIvmaBuffer(*dev, vmaAlloc, bufferInfo, allocInfo, *copyHandler);
+        // upload destinations are written by the transfer queue and read by the graphics one
+        const std::vector<uint32_t>& families = copyHandler->queueFamilies();
+        if ((bufferInfo.usage & vk::BufferUsageFlagBits::eTransferDst) && families.size() > 1) {
+            bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+            bufferInfo.pQueueFamilyIndices = families.data();
+        }
+        return RAIIvmaBuffer(*dev, vmaAlloc, bufferInfo, allocInfo, *copyHandler, *staging);
     }
     RAIIvmaImage RAIIAllocator::createImage(vk::ImageCreateInfo imageInfo, vma::AllocationCreateInfo allocInfo, vk::ImageAspectFlags aspectFlags) {
-        return RAIIvmaImage(*dev, vmaAlloc, imageInfo, allocInfo, *copyHandler, aspectFlags);
+        const std::vector<uint32_t>& families = copyHandler->queueFamilies();
+        if ((imageInfo.usage & vk::ImageUsageFlagBits::eTransferDst) && families.size() > 1) {
+            imageInfo.sharingMode = vk::SharingMode::eConcurrent;
+            imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+            imageInfo.pQueueFamilyIndices = families.data();
+        }
+        return RAIIvmaImage(*dev, vmaAlloc, imageInfo, allocInfo, *copyHandler, *staging, aspectFlags);
+    }
+    MemoryBudget RAIIAllocator::deviceLocalBudget() {
+        const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+        vmaGetMemoryProperties(static_cast<VmaAllocator>(vmaAlloc), &memoryProperties);
+        std::vector<VmaBudget> budgets(memoryProperties->memoryHeapCount);
+        vmaGetHeapBudgets(static_cast<VmaAllocator>(vmaAlloc), budgets.data());
+        MemoryBudget total;
+        for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; heap++) {
+            if (memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                total.usage += budgets[heap].usage;
+                total.budget += budgets[heap].budget;
+            }
+        }
+        return total;
     }
 }
\ No newline at end of file
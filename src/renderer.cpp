@@ -7,13 +7,19 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <stb_image.h>
 
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <limits>
@@ -22,6 +28,8 @@
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -29,8 +37,10 @@
 
 #include <renderer.hpp>
 #include <device_buffer_copy_handler.hpp>
+#include <geometry_pool.hpp>
 #include <objects.hpp>
 #include <raii_wrappers.hpp>
+#include <texture_data.hpp>
 #include <resource_path.hpp>
 
 
@@ -41,7 +51,8 @@ namespace volchara {
         return p;
     }
 
-    Renderer::Renderer() : camera(*this) {
+    Renderer::Renderer(RendererSettings initSettings) : camera(*this), settings(initSettings) {
+        framePacer.setFrameCap(settings.frameCap);
         init();
     }
 
@@ -50,25 +61,74 @@ namespace volchara {
         initVulkan();
     }
 
+    Renderer::~Renderer() {
+        stopSimulation();
+        // a headless renderer never runs mainLoop, its last frames may still be in flight
+        if (*device) {
+            device.waitIdle();
+        }
+        if (tracyContext) {
+            TracyVkDestroy(tracyContext);
+        }
+    }
+
+    void Renderer::renderFrame(float tickSeconds) {
+        {
+            std::lock_guard<std::mutex> simulationLock(simulationMutex);
+            runSimulationTick(tickSeconds);
+        }
+        drawFrame();
+    }
+
     void Renderer::run() {
+        if (settings.headless) {
+            throw std::runtime_error("headless renderers are driven through renderFrame");
+        }
+        startSimulation();
         mainLoop();
         cleanup();
     }
 
+    void Renderer::applySettings(RendererSettings newSettings) {
+        // the geometry pool, the pipelines and the presentation target are built once
+        newSettings.vertexFormat = settings.vertexFormat;
+        newSettings.gBufferFormat = settings.gBufferFormat;
+        newSettings.headless = settings.headless;
+        newSettings.dynamicResolution = settings.dynamicResolution;
+        if (newSettings.presentMode != settings.presentMode) {
+            framebufferResized = true;
+        }
+        if (newSettings.frameCap != settings.frameCap) {
+            framePacer.setFrameCap(newSettings.frameCap);
+        }
+        settings = newSettings;
+    }
+
+    const RendererSettings& Renderer::getSettings() const {
+        return settings;
+    }
+
+    RendererStats Renderer::getStats() const {
+        return stats;
+    }
+
     void Renderer::addObject(volchara::Object* obj) {
         objects.push_back(obj);
-        putObjectsToBuffer();
+        putObjectToBuffer(obj);
+        scene.markLayoutChanged();
     }
 
     void Renderer::delObject(volchara::Object* obj) {
         objects.erase(std::find(objects.begin(), objects.end(), obj));
-        putObjectsToBuffer();
+        removeObjectFromBuffer(obj);
     }
 
     void Renderer::addLight(volchara::DirectionalLight* l) {
-        lights.lights[lights.header.lightCount].color = glm::vec4(l->color, l->brightness);
-        lights.lights[lights.header.lightCount].position = glm::vec4(l->transform.translation, 0);
-        lights.header.lightCount++;
+        lights.push_back({
+            .position = glm::vec4(l->transform.getTranslation(), 0),
+            .color = glm::vec4(l->color, l->brightness),
+        });
+        lightsHeader.lightCount = lights.size();
         putLightsToBuffer();
     }
 
@@ -86,7 +146,7 @@ namespace volchara {
 
     void Renderer::setAmbientLight(InitDataLight data) {
         AmbientLight ambientLight = AmbientLight::fromData(*this, data);
-        lights.header.ambient = glm::vec4(ambientLight.color, ambientLight.brightness);
+        lightsHeader.ambient = glm::vec4(ambientLight.color, ambientLight.brightness);
         putLightsToBuffer();
     }
 
@@ -94,55 +154,323 @@ namespace volchara {
         return DirectionalLight::fromWorldCoordinates(*this, data);
     }
 
-    void Renderer::preloadTexture(std::filesystem::path texturePath) {
-        int newTextureIndex;
-        if (this->textureNameToId.contains(texturePath.filename().string())) {
-            newTextureIndex = this->textureNameToId[texturePath.filename().string()];
+    uint32_t Renderer::preloadTexture(std::filesystem::path texturePath) {
+        return loadTexture(texturePath);
+    }
+
+    void Renderer::preloadModel(std::filesystem::path modelPath) {
+        std::string modelName = modelPath.filename().string();
+        if (modelCache.contains(modelName) || pendingModels.contains(modelName)) {
+            return;
+        }
+        auto parse = std::make_shared<std::packaged_task<std::shared_ptr<ModelData>()>>([modelPath]() {
+            return ModelData::load(modelPath);
+        });
+        pendingModels[modelName] = parse->get_future().share();
+        loadingJobs->enqueue([parse]() { (*parse)(); });
+    }
+
+    const ModelData& Renderer::loadModel(std::filesystem::path modelPath) {
+        std::string modelName = modelPath.filename().string();
+        if (!modelCache.contains(modelName)) {
+            if (pendingModels.contains(modelName)) {
+                // blocks only for the rest of a load started by preloadModel, rethrows its error
+                std::shared_future<std::shared_ptr<ModelData>> pending = pendingModels[modelName];
+                pendingModels.erase(modelName);
+                modelCache[modelName] = pending.get();
+            } else {
+                modelCache[modelName] = ModelData::load(modelPath);
+            }
+        }
+        return *modelCache[modelName];
+    }
+
+    uint32_t Renderer::loadTexture(std::filesystem::path texturePath) {
+        // two files with the same name in different directories are different textures
+        std::string key = std::filesystem::absolute(texturePath).lexically_normal().string();
+        return reserveTexture(key, [texturePath]() {
+            // decoders read straight from the page cache instead of a copy of the file
+            MappedFile file = MappedFile::fromPath(texturePath);
+            std::span<const unsigned char> bytes = file.bytes();
+            return TextureSource{.file = std::move(file), .bytes = bytes};
+        });
+    }
+
+    uint32_t Renderer::loadTexture(const std::string& name, std::span<const unsigned char> textureData) {
+        // the bytes are at hand, so a request for content already loading gets that slot instead of a second upload
+        TextureHash hash = TextureData::contentHash(textureData);
+        auto known = textureHashToId.find(hash);
+        if (known != textureHashToId.end()) {
+            return known->second;
+        }
+        uint32_t textureIndex = reserveTexture(name, [textureData]() {
+            return TextureSource{.bytes = textureData};
+        });
+        if (textureHashToId.emplace(hash, textureIndex).second) {
+            textureHashes[textureIndex] = hash;
+        }
+        return textureIndex;
+    }
+
+    uint32_t Renderer::reserveTexture(const std::string& key, std::function<TextureSource()> open) {
+        if (textureNameToId.contains(key)) {
+            return textureNameToId[key];
+        }
+        // the slot is handed out right away, draws fall back to texture 0 until the upload lands
+        uint32_t textureIndex = allocateTextureSlot();
+        uint32_t generation = textureGenerations[textureIndex];
+        textureNameToId[key] = textureIndex;
+        textureKeys[textureIndex] = key;
+        // cached without users until an object retains it
+        unusedTextures.push_back(textureIndex);
+        loadingJobs->enqueue([this, textureIndex, generation, open = std::move(open)]() {
+            LoadedTexture loaded{.textureIndex = textureIndex, .generation = generation};
+            try {
+                TextureSource source = open();
+                loaded.contentHash = TextureData::contentHash(source.bytes);
+                loaded.data = TextureData::fromMemory(source.bytes);
+            } catch (...) {
+                loaded.error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(loadedTexturesMutex);
+            loadedTextures.push_back(std::move(loaded));
+        });
+        return textureIndex;
+    }
+
+    void Renderer::processLoadedTextures() {
+        ZoneScoped;
+        std::vector<LoadedTexture> loaded;
+        {
+            std::lock_guard<std::mutex> lock(loadedTexturesMutex);
+            std::swap(loaded, loadedTextures);
+        }
+        for (LoadedTexture& texture : loaded) {
+            if (texture.generation != textureGenerations[texture.textureIndex]) {
+                continue;
+            }
+            if (texture.error) {
+                std::rethrow_exception(texture.error);
+            }
+            auto duplicate = textureHashToId.find(texture.contentHash);
+            if (duplicate != textureHashToId.end() && duplicate->second != texture.textureIndex && textureResident[duplicate->second]) {
+                // same bytes under another name, the slot shares the image instead of a second upload
+                textures[texture.textureIndex] = textures[duplicate->second];
+            } else {
+                // uploads join the frame's transfer batch, the frame waits for it before sampling
+                uploadTexture(texture.textureIndex, texture.data);
+                textureHashToId[texture.contentHash] = texture.textureIndex;
+            }
+            textureHashes[texture.textureIndex] = texture.contentHash;
+            loadTextureToDescriptors(texture.textureIndex);
+            textureResident[texture.textureIndex] = true;
+            textureResidencyVersion++;
+        }
+    }
+
+    uint32_t Renderer::allocateTextureSlot() {
+        uint32_t textureIndex;
+        if (!freeTextureSlots.empty()) {
+            textureIndex = freeTextureSlots.back();
+            freeTextureSlots.pop_back();
         } else {
-            std::vector<unsigned char> textureData = this->readFile(texturePath);
-            newTextureIndex = this->createTextureImage(textureData);
-            this->textureNameToId[texturePath.filename().string()] = newTextureIndex;
-            this->loadTextureToDescriptors(newTextureIndex);
+            if (textures.size() >= maxTextures) {
+                throw std::runtime_error("bindless texture table is full");
+            }
+            textureIndex = textures.size();
+            textures.push_back(nullptr);
+            textureResident.push_back(false);
+            textureGenerations.push_back(0);
+            textureRefs.push_back(0);
+            textureKeys.push_back({});
+            textureHashes.push_back({});
         }
+        return textureIndex;
     }
 
-    void Renderer::preloadModel(std::filesystem::path modelPath) {
-        Object obj = GLTFModel::fromFile(*this, modelPath);
+    void Renderer::unloadTexture(std::filesystem::path texturePath) {
+        std::string key = std::filesystem::absolute(texturePath).lexically_normal().string();
+        if (textureNameToId.contains(key) && textureRefs[textureNameToId[key]] == 0) {
+            evictTexture(textureNameToId[key]);
+        }
+    }
+
+    void Renderer::setTextureBudget(vk::DeviceSize bytes) {
+        textureBudget = bytes;
+    }
+
+    void Renderer::retainTexture(uint32_t textureIndex) {
+        if (textureIndex == 0) {
+            return;
+        }
+        if (textureRefs[textureIndex]++ == 0) {
+            unusedTextures.erase(std::find(unusedTextures.begin(), unusedTextures.end(), textureIndex));
+        }
+    }
+
+    void Renderer::releaseTextureReference(uint32_t textureIndex) {
+        if (textureIndex == 0) {
+            return;
+        }
+        // kept until memory runs short, reusing it later costs nothing
+        if (--textureRefs[textureIndex] == 0) {
+            unusedTextures.push_back(textureIndex);
+        }
+    }
+
+    void Renderer::evictUnusedTextures() {
+        ZoneScoped;
+        if (unusedTextures.empty()) {
+            return;
+        }
+        MemoryBudget memory = allocator.deviceLocalBudget();
+        vk::DeviceSize budget = textureBudget ? textureBudget : memory.budget / 10 * 9;
+        // freed images stay allocated until their frames are done, they don't count twice
+        vk::DeviceSize usage = memory.usage - std::min(memory.usage, evictingBytes);
+        while (usage > budget && !unusedTextures.empty()) {
+            uint32_t textureIndex = unusedTextures.front();
+            vk::DeviceSize freed = textures[textureIndex] && textures[textureIndex].use_count() == 1 ? textures[textureIndex]->memorySize() : 0;
+            usage -= std::min(usage, freed);
+            evictTexture(textureIndex);
+        }
+    }
+
+    void Renderer::evictTexture(uint32_t textureIndex) {
+        auto unused = std::find(unusedTextures.begin(), unusedTextures.end(), textureIndex);
+        if (unused != unusedTextures.end()) {
+            unusedTextures.erase(unused);
+        }
+        textureNameToId.erase(textureKeys[textureIndex]);
+        auto owner = textureHashToId.find(textureHashes[textureIndex]);
+        if (owner != textureHashToId.end() && owner->second == textureIndex) {
+            textureHashToId.erase(owner);
+        }
+        textureKeys[textureIndex].clear();
+        textureHashes[textureIndex] = {};
+        releaseTexture(textureIndex);
+    }
+
+    void Renderer::releaseTexture(uint32_t textureIndex) {
+        // texture 0 is the fallback of every slot that isn't resident
+        if (textureIndex == 0) {
+            return;
+        }
+        textureGenerations[textureIndex]++;
+        if (textureResident[textureIndex]) {
+            textureResident[textureIndex] = false;
+            textureResidencyVersion++;
+        }
+        vk::DeviceSize freed = textures[textureIndex] && textures[textureIndex].use_count() == 1 ? textures[textureIndex]->memorySize() : 0;
+        evictingBytes += freed;
+        // frames in flight may still sample the slot, it is rewritten only after they are done
+        deferUntilFrameComplete([this, textureIndex, freed]() {
+            textures[textureIndex] = nullptr;
+            evictingBytes -= freed;
+            freeTextureSlots.push_back(textureIndex);
+        });
+    }
+
+    uint32_t Renderer::resolveTexture(uint32_t textureIndex) const {
+        return textureResident[textureIndex] ? textureIndex : 0;
     }
 
-    void Renderer::putObjectsToBuffer() {
-        std::vector<volchara::Vertex> vertices;
-        std::vector<uint32_t> indices;
-        uint32_t indexOffset = 0;
-        std::vector<Object*> allObjects = objects;
+    void Renderer::putObjectToBuffer(volchara::Object* obj) {
+        std::vector<Object*> allObjects = {obj};
         for (int i = 0; i < allObjects.size(); i++) {
-            if (allObjects[i]->children.size() > 0) {
-                for (Object* child : allObjects[i]->children) {
-                    allObjects.push_back(child);
-                }
+            for (Object* child : allObjects[i]->children) {
+                allObjects.push_back(child);
+            }
+            acquireGeometry(allObjects[i]);
+        }
+    }
+
+    void Renderer::removeObjectFromBuffer(volchara::Object* obj) {
+        std::vector<Object*> allObjects = {obj};
+        for (int i = 0; i < allObjects.size(); i++) {
+            for (Object* child : allObjects[i]->children) {
+                allObjects.push_back(child);
             }
+            releaseGeometry(allObjects[i]);
+            scene.remove(allObjects[i]);
+        }
+    }
+
+    void Renderer::acquireGeometry(volchara::Object* obj) {
+        const std::shared_ptr<Mesh>& mesh = obj->getMesh();
+        if (obj->resident || !mesh || mesh->vertices.empty()) return;
+        obj->resident = true;
+        // instances of a mesh share one upload
+        if (mesh->residentObjects++ == 0) {
+            mesh->computeBounds();
+            mesh->geometry = geometryPool.allocate(mesh->vertices, mesh->indices, mesh->bounds);
+        }
+        if (obj->scene) obj->scene->markRenderDataChanged(obj->sceneIndex);
+    }
+
+    void Renderer::releaseGeometry(volchara::Object* obj) {
+        if (!obj->resident) return;
+        obj->resident = false;
+        const std::shared_ptr<Mesh>& mesh = obj->getMesh();
+        if (--mesh->residentObjects == 0) {
+            GeometryRange range = mesh->geometry.value();
+            deferUntilFrameComplete([this, range]() { geometryPool.release(range); });
+            mesh->geometry.reset();
+        }
+        if (obj->scene) obj->scene->markRenderDataChanged(obj->sceneIndex);
+    }
+
+    void Renderer::waitForFramesInFlight() {
+        std::vector<vk::Fence> frameFences;
+        for (vk::raii::Fence& fence : inFlightFences) {
+            frameFences.push_back(fence);
         }
-        for (volchara::Object* obj : allObjects) {
-            if (!obj->vertices.empty()) {
-                vertices.insert(vertices.end(), obj->vertices.begin(), obj->vertices.end());
-                std::transform(obj->indices.begin(), obj->indices.end(), std::back_inserter(indices), [indexOffset](uint32_t index){return index + indexOffset;});
-                indexOffset += obj->vertices.size();
+        if (!frameFences.empty()) {
+            (void)device.waitForFences(frameFences, true, UINT64_MAX);
+        }
+    }
+
+    void Renderer::deferUntilFrameComplete(std::function<void()> release) {
+        // frames recorded from now on no longer reference what is released
+        std::lock_guard<std::mutex> deletionLock(deletionMutex);
+        deletionQueue.push_back({submittedFrames, std::move(release)});
+    }
+
+    void Renderer::runDeletionQueue() {
+        // tags only grow, the front is always the oldest release
+        while (true) {
+            std::function<void()> release;
+            {
+                std::lock_guard<std::mutex> deletionLock(deletionMutex);
+                if (deletionQueue.empty() || deletionQueue.front().first > completedFrames) {
+                    return;
+                }
+                release = std::move(deletionQueue.front().second);
+                deletionQueue.pop_front();
             }
+            release();
         }
-        createStagingBuffer((size_t)(indices.size() * sizeof(uint32_t)));
-        createVertexBuffer((size_t)(vertices.size() * sizeof(volchara::Vertex)));
-        createIndexBuffer((size_t)(indices.size() * sizeof(uint32_t)));
-        stagingBuffer.copyFrom(vertices.data(), (size_t)(vertices.size() * sizeof(volchara::Vertex)));
-        vertexBuffer.copyFrom(stagingBuffer.allocInfo().pMappedData, (size_t)(vertices.size() * sizeof(volchara::Vertex)));
-        stagingBuffer.copyFrom(indices.data(), (size_t)(indices.size() * sizeof(uint32_t)));
-        indexBuffer.copyFrom(stagingBuffer.allocInfo().pMappedData, (size_t)(indices.size() * sizeof(uint32_t)));
     }
 
     void Renderer::putLightsToBuffer() {
-        ssboBuffer.copyFrom(&lights, sizeof(lights));
+        if (lights.size() > lightCapacity) {
+            // lights are added while the scene is set up, so growing may stall on the frames in flight
+            uint32_t capacity = lightCapacity;
+            while (capacity < lights.size()) {
+                capacity *= 2;
+            }
+            waitForFramesInFlight();
+            deviceBufferCopyHandler.waitIdle();
+            createSSBOBuffer(capacity);
+            writeLightsDescriptors();
+        }
+        ssboBuffer.copyFrom(&lightsHeader, sizeof(lightsHeader));
+        if (!lights.empty()) {
+            ssboBuffer.copyFrom(lights.data(), lights.size() * sizeof(GPULight), sizeof(GPULightHeader));
+        }
     }
 
     void Renderer::initWindow() {
+        if (settings.headless) return;
         glfwInit();
         
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -160,46 +488,64 @@ namespace volchara {
     void Renderer::initVulkan() {
         createInstance();
         setupDebugMessenger();
-        createSurface();
+        if (!settings.headless) createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
         createBufferCopyHandler();
         createMemoryAllocator();
         createTextureSampler();
-        createSwapChain();
+        if (settings.headless) {
+            createOffscreenImages();
+        } else {
+            createSwapChain();
+        }
         createImageViews();
         createRenderPass();
         createDescriptorSetLayout();
+        createPipelineCache();
         createGraphicsPipeline();
+        createCullPipeline();
+        createLightCullPipeline();
         createCommandPool();
-        createStagingBuffer(8388608);
-        createVertexBuffer(8388608);
-        createIndexBuffer(8388608);
+        createGeometryPool(8388608 / Vertex::stride(settings.vertexFormat), 8388608 / sizeof(uint32_t));
         createUniformBuffers();
-        createSSBOBuffer(8388608 * maxTextures);
+        createInstanceBuffers();
+        createSSBOBuffer(INITIAL_LIGHT_CAPACITY);
+        createLightClusterBuffers();
         createDepthResources();
         createEmissiveResources();
         createNormalResources();
         createIntermediateColorResources();
+        createTransparencyResources();
+        createSceneColorResources();
         createFramebuffers();
-        uint32_t uv = createTextureImage(readFile(getResourceDir() / "textures/uv.png"));
+        createLoadingJobs();
+        uint32_t uv = createTextureImage(MappedFile::fromPath(getResourceDir() / "textures/uv.png").bytes());
         createDescriptorPool();
         createDescriptorSets();
+        putLightsToBuffer();
         loadTextureToDescriptors(uv);
         createCommandBuffers();
+        createTimestampQueries();
+        createRecordingPools();
         createSyncObjects();
     }
 
     void Renderer::mainLoop() {
+        // events are polled inside drawFrame, as late as possible before they are used
         while (!glfwWindowShouldClose(window) && !shouldExit) {
-            glfwPollEvents();
             drawFrame();
         }
+        stopSimulation();
         device.waitIdle();
+        savePipelineCache();
+        completedFrames = submittedFrames;
+        runDeletionQueue();
+        deviceBufferCopyHandler.waitIdle();
     }
 
     void Renderer::cleanup() {
-        glfwDestroyWindow(window);
+        if (window) glfwDestroyWindow(window);
         glfwTerminate();
     }
 
@@ -226,8 +572,10 @@ namespace volchara {
 
     std::vector<const char*> Renderer::getRequiredExtensions() {
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        const char** glfwExtensions = nullptr;
+        if (!settings.headless) {
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        }
 
         std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
 
@@ -289,32 +637,49 @@ namespace volchara {
         QueueFamilyIndices indices {};
         std::vector<vk::QueueFamilyProperties> q = device.getQueueFamilyProperties();
 
-        auto bothIter = std::find_if(q.begin(), q.end(), [&device, &surface = surface](vk::QueueFamilyProperties const &qfp) { return qfp.queueFlags & vk::QueueFlagBits::eGraphics && device.getSurfaceSupportKHR(0, surface); });
+        // without a surface the graphics queue stands in for presentation
+        auto bothIter = std::find_if(q.begin(), q.end(), [&device, &surface = surface, headless = settings.headless](vk::QueueFamilyProperties const &qfp) { return qfp.queueFlags & vk::QueueFlagBits::eGraphics && (headless || device.getSurfaceSupportKHR(0, surface)); });
         if (bothIter != q.end()) {
             uint32_t ind = static_cast<uint32_t>(std::distance(q.begin(), bothIter));
             indices.graphicsFamily = ind;
             indices.presentFamily = ind;
-            return indices;
-        }
-
-        auto graphicsIter = std::find_if(q.begin(), q.end(), [&device, &surface = surface](vk::QueueFamilyProperties const &qfp) { return qfp.queueFlags & vk::QueueFlagBits::eGraphics; });
-        if (graphicsIter != q.end()) {
-            uint32_t ind = static_cast<uint32_t>(std::distance(q.begin(), graphicsIter));
-            indices.graphicsFamily = ind;
-        }
-        auto presentIter = std::find_if(q.begin(), q.end(), [&device, &surface = surface](vk::QueueFamilyProperties const &qfp) { return device.getSurfaceSupportKHR(0, surface); });
-        if (presentIter != q.end()) {
-            uint32_t ind = static_cast<uint32_t>(std::distance(q.begin(), presentIter));
-            indices.presentFamily = ind;
+        } else {
+            auto graphicsIter = std::find_if(q.begin(), q.end(), [&device, &surface = surface](vk::QueueFamilyProperties const &qfp) { return qfp.queueFlags & vk::QueueFlagBits::eGraphics; });
+            if (graphicsIter != q.end()) {
+                uint32_t ind = static_cast<uint32_t>(std::distance(q.begin(), graphicsIter));
+                indices.graphicsFamily = ind;
+            }
+            auto presentIter = std::find_if(q.begin(), q.end(), [&device, &surface = surface](vk::QueueFamilyProperties const &qfp) { return device.getSurfaceSupportKHR(0, surface); });
+            if (presentIter != q.end()) {
+                uint32_t ind = static_cast<uint32_t>(std::distance(q.begin(), presentIter));
+                indices.presentFamily = ind;
+            }
         }
 
         if (!indices.isComplete()) throw std::runtime_error("Suitable queues not found");
+
+        // dedicated DMA queue lets uploads run without stalling graphics work
+        auto transferIter = std::find_if(q.begin(), q.end(), [](vk::QueueFamilyProperties const &qfp) { return (qfp.queueFlags & vk::QueueFlagBits::eTransfer) && !(qfp.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)); });
+        if (transferIter != q.end()) {
+            indices.transferFamily = static_cast<uint32_t>(std::distance(q.begin(), transferIter));
+        } else {
+            indices.transferFamily = indices.graphicsFamily;
+        }
         return indices;
     }
 
+    std::vector<const char*> Renderer::requiredDeviceExtensions() {
+        std::vector<const char*> extensions = deviceExtensions;
+        if (settings.headless) {
+            std::erase_if(extensions, [](const char* extension) { return strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
+        }
+        return extensions;
+    }
+
     bool Renderer::checkDeviceExtensionSupport(vk::raii::PhysicalDevice device) {
         std::vector<vk::ExtensionProperties> availableExtensions(device.enumerateDeviceExtensionProperties());
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+        std::vector<const char*> extensions = requiredDeviceExtensions();
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
         for (const auto& extension : availableExtensions) {
             requiredExtensions.erase(extension.extensionName);
@@ -337,15 +702,15 @@ namespace volchara {
 
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        bool swapChainAdequate = settings.headless;
+        if (extensionsSupported && !settings.headless) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
         }
 
-        vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT> supportedFeatures(device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>());
+        vk::StructureChain<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT, vk::PhysicalDeviceTimelineSemaphoreFeatures> supportedFeatures(device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT, vk::PhysicalDeviceTimelineSemaphoreFeatures>());
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate && hasRequiredPhysicalDeviceFeatures(supportedFeatures.get<vk::PhysicalDeviceFeatures2>()) && hasRequiredPhysicalDeviceDescriptorFeatures(supportedFeatures.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>());
+        return indices.isComplete() && extensionsSupported && swapChainAdequate && hasRequiredPhysicalDeviceFeatures(supportedFeatures.get<vk::PhysicalDeviceFeatures2>()) && hasRequiredPhysicalDeviceDescriptorFeatures(supportedFeatures.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>()) && hasRequiredPhysicalDeviceTimelineFeatures(supportedFeatures.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>());
     }
 
     void Renderer::pickPhysicalDevice() {
@@ -355,6 +720,9 @@ namespace volchara {
             if (isDeviceSuitable(device)) {
                 physicalDevice = device;
                 physicalDeviceProperties = device.getProperties();
+                auto properties = device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+                const vk::PhysicalDeviceDescriptorIndexingPropertiesEXT& indexingProperties = properties.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+                maxTextures = std::min({MAX_BINDLESS_TEXTURES, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages});
                 break;
             }
         }
@@ -368,7 +736,7 @@ namespace volchara {
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(), indices.transferFamily.value()};
         const std::vector<float_t> queuePriorities { 1.0f };
 
         float queuePriority = 1.0f;
@@ -382,12 +750,34 @@ namespace volchara {
         }
 
         const std::vector<const char *> empty;
+        // GPU-driven drawing is optional, without these features draws are issued from the CPU
+        std::vector<const char*> enabledExtensions = requiredDeviceExtensions();
+        std::vector<vk::ExtensionProperties> availableExtensions = physicalDevice.enumerateDeviceExtensionProperties();
+        supportsDrawIndirectCount = std::any_of(availableExtensions.begin(), availableExtensions.end(), [](const vk::ExtensionProperties& extension) { return strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0; });
+        if (supportsDrawIndirectCount) {
+            enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+        vk::PhysicalDeviceFeatures supportedDevFeatures = physicalDevice.getFeatures();
+        supportsMultiDrawIndirect = supportedDevFeatures.multiDrawIndirect;
+        supportsDrawIndirectFirstInstance = supportedDevFeatures.drawIndirectFirstInstance;
+        vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+        supportsLazyAllocation = std::any_of(memoryProperties.memoryTypes.begin(), memoryProperties.memoryTypes.begin() + memoryProperties.memoryTypeCount, [](const vk::MemoryType& type) { return static_cast<bool>(type.propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated); });
+        // KTX2 textures are uploaded in whichever block format they were encoded to
         vk::PhysicalDeviceFeatures reqDevFeatures{
+            .multiDrawIndirect = supportsMultiDrawIndirect,
+            .drawIndirectFirstInstance = supportsDrawIndirectFirstInstance,
             .fillModeNonSolid = true,
             .samplerAnisotropy = true,
+            .textureCompressionASTC_LDR = supportedDevFeatures.textureCompressionASTC_LDR,
+            .textureCompressionBC = supportedDevFeatures.textureCompressionBC,
+        };
+        vk::PhysicalDeviceTimelineSemaphoreFeatures reqDevTimelineFeatures{
+            .timelineSemaphore = true,
         };
         vk::PhysicalDeviceDescriptorIndexingFeaturesEXT reqDevDescrFeatures{
+            .pNext = &reqDevTimelineFeatures,
             .descriptorBindingSampledImageUpdateAfterBind = true,
+            .descriptorBindingUpdateUnusedWhilePending = true,
             .descriptorBindingPartiallyBound = true,
             .descriptorBindingVariableDescriptorCount = true,
             .runtimeDescriptorArray = true,
@@ -406,8 +796,8 @@ namespace volchara {
             .pQueueCreateInfos = queueCreateInfos.data(),
             .enabledLayerCount = static_cast<uint32_t>((enableValidationLayers) ? 1 : 0),
             .ppEnabledLayerNames = (enableValidationLayers) ? validationLayers.data() : nullptr,
-            .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
-            .ppEnabledExtensionNames = deviceExtensions.data(),
+            .enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()),
+            .ppEnabledExtensionNames = enabledExtensions.data(),
             .pEnabledFeatures = &reqDevFeatures,
         };
 
@@ -418,7 +808,7 @@ namespace volchara {
 
     void Renderer::createBufferCopyHandler() {
         QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-        deviceBufferCopyHandler = DeviceBufferCopyHandler(device, queueFamilyIndices.graphicsFamily.value());
+        deviceBufferCopyHandler = DeviceBufferCopyHandler(device, queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.transferFamily.value(), queueMutex);
     }
 
     void Renderer::createMemoryAllocator() {
@@ -433,6 +823,8 @@ namespace volchara {
             .mipLodBias = 0,
             .anisotropyEnable = true,
             .maxAnisotropy = physicalDeviceProperties.limits.maxSamplerAnisotropy,
+            .minLod = 0,
+            .maxLod = vk::LodClampNone,
         };
         textureSampler = device.createSampler(samplerInfo);
     }
@@ -449,7 +841,7 @@ namespace volchara {
 
     vk::PresentModeKHR Renderer::chooseSwapPresentMode(const std::vector<vk::PresentModeKHR>& availablePresentModes) {
         for (const auto& availablePresentMode : availablePresentModes) {
-            if (availablePresentMode == vk::PresentModeKHR::eMailbox) {
+            if (availablePresentMode == settings.presentMode) {
                 return availablePresentMode;
             }
         }
@@ -476,7 +868,7 @@ namespace volchara {
         }
     }
 
-    void Renderer::createSwapChain() {
+    void Renderer::createSwapChain(vk::SwapchainKHR oldSwapChain) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
         vk::SurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -490,6 +882,10 @@ namespace volchara {
 
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
         std::vector<uint32_t> queueIndices {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment;
+        if (settings.dynamicResolution) {
+            usage |= vk::ImageUsageFlagBits::eTransferDst;
+        }
         vk::SwapchainCreateInfoKHR createInfo{
             .surface = surface,
             .minImageCount = imageCount,
@@ -497,7 +893,7 @@ namespace volchara {
             .imageColorSpace = surfaceFormat.colorSpace,
             .imageExtent = extent,
             .imageArrayLayers = 1,
-            .imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment,
+            .imageUsage = usage,
             .imageSharingMode = (indices.graphicsFamily != indices.presentFamily) ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
             .queueFamilyIndexCount = static_cast<uint32_t>(queueIndices.size()),
             .pQueueFamilyIndices = queueIndices.data(),
@@ -505,7 +901,7 @@ namespace volchara {
             .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
             .presentMode = presentMode,
             .clipped = true,
-            .oldSwapchain = swapChain,
+            .oldSwapchain = oldSwapChain,
         };
         swapChain = device.createSwapchainKHR(createInfo);
 
@@ -530,6 +926,21 @@ namespace volchara {
         return device.createImageView(createInfo);
     }
 
+    void Renderer::createOffscreenImages() {
+        swapChainImageFormat = vk::Format::eB8G8R8A8Srgb;
+        swapChainExtent = vk::Extent2D{WIDTH, HEIGHT};
+        offscreenImages.clear();
+        swapChainImages.clear();
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+        if (settings.dynamicResolution) {
+            usage |= vk::ImageUsageFlagBits::eTransferDst;
+        }
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            offscreenImages.push_back(createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, vk::ImageTiling::eOptimal, usage, vk::MemoryPropertyFlagBits::eDeviceLocal));
+            swapChainImages.push_back(offscreenImages.back());
+        }
+    }
+
     void Renderer::createImageViews() {
         swapChainImageViews.clear();
         for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -558,22 +969,39 @@ namespace volchara {
         );
     }
 
+    vk::Format Renderer::findNormalFormat() {
+        // RG16F is a required color attachment format, no fallback needed
+        return settings.gBufferFormat == GBufferFormat::ePacked ? vk::Format::eR16G16Sfloat : vk::Format::eR16G16B16A16Sfloat;
+    }
+
+    vk::Format Renderer::findEmissiveFormat() {
+        if (settings.gBufferFormat == GBufferFormat::eFull) {
+            return vk::Format::eR8G8B8A8Unorm;
+        }
+        return findSupportedFormat(
+            {vk::Format::eB10G11R11UfloatPack32, vk::Format::eR8G8B8A8Unorm},
+            vk::ImageTiling::eOptimal,
+            vk::FormatFeatureFlagBits::eColorAttachment
+        );
+    }
+
     void Renderer::createRenderPass() {
+        // the G-buffer is consumed within the pass, nothing is written back to memory
         vk::AttachmentDescription intermediateColorAttachment{
             .format = vk::Format::eR8G8B8A8Unorm,
             .samples = vk::SampleCountFlagBits::e1,
             .loadOp = vk::AttachmentLoadOp::eClear,
-            .storeOp = vk::AttachmentStoreOp::eStore,
+            .storeOp = vk::AttachmentStoreOp::eDontCare,
             .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
             .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
             .initialLayout = vk::ImageLayout::eUndefined,
             .finalLayout = vk::ImageLayout::eColorAttachmentOptimal,
         };
         vk::AttachmentDescription intermediateEmissiveAttachment{
-            .format = vk::Format::eR8G8B8A8Unorm,
+            .format = findEmissiveFormat(),
             .samples = vk::SampleCountFlagBits::e1,
             .loadOp = vk::AttachmentLoadOp::eClear,
-            .storeOp = vk::AttachmentStoreOp::eStore,
+            .storeOp = vk::AttachmentStoreOp::eDontCare,
             .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
             .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
             .initialLayout = vk::ImageLayout::eUndefined,
@@ -581,10 +1009,10 @@ namespace volchara {
         };
 
         vk::AttachmentDescription normalAttachment{
-            .format = vk::Format::eR16G16B16A16Sfloat,
+            .format = findNormalFormat(),
             .samples = vk::SampleCountFlagBits::e1,
             .loadOp = vk::AttachmentLoadOp::eClear,
-            .storeOp = vk::AttachmentStoreOp::eStore,
+            .storeOp = vk::AttachmentStoreOp::eDontCare,
             .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
             .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
             .initialLayout = vk::ImageLayout::eUndefined,
@@ -608,7 +1036,30 @@ namespace volchara {
             .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
             .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
             .initialLayout = vk::ImageLayout::eUndefined,
-            .finalLayout = vk::ImageLayout::ePresentSrcKHR,
+            // offscreen frames are left ready to be copied out, the frame graph moves a scaled frame on to the upscale blit
+            .finalLayout = settings.dynamicResolution ? vk::ImageLayout::eColorAttachmentOptimal : settings.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR,
+        };
+
+        // weighted-blended transparency, premultiplied color times weight and the product of (1 - alpha)
+        vk::AttachmentDescription accumulationAttachment{
+            .format = vk::Format::eR16G16B16A16Sfloat,
+            .samples = vk::SampleCountFlagBits::e1,
+            .loadOp = vk::AttachmentLoadOp::eClear,
+            .storeOp = vk::AttachmentStoreOp::eDontCare,
+            .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+            .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+            .initialLayout = vk::ImageLayout::eUndefined,
+            .finalLayout = vk::ImageLayout::eColorAttachmentOptimal,
+        };
+        vk::AttachmentDescription revealageAttachment{
+            .format = vk::Format::eR16Sfloat,
+            .samples = vk::SampleCountFlagBits::e1,
+            .loadOp = vk::AttachmentLoadOp::eClear,
+            .storeOp = vk::AttachmentStoreOp::eDontCare,
+            .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+            .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+            .initialLayout = vk::ImageLayout::eUndefined,
+            .finalLayout = vk::ImageLayout::eColorAttachmentOptimal,
         };
 
         std::vector<vk::AttachmentReference> colorAttachments = {
@@ -662,13 +1113,18 @@ namespace volchara {
         };
 
         std::vector<vk::AttachmentReference> transparencyOutAttachments = {
-            {.attachment = 4, .layout = vk::ImageLayout::eColorAttachmentOptimal}
+            {.attachment = 5, .layout = vk::ImageLayout::eColorAttachmentOptimal},
+            {.attachment = 6, .layout = vk::ImageLayout::eColorAttachmentOptimal},
         };
+        // the lit image isn't touched here, the resolve blends over it afterwards
+        std::vector<uint32_t> transparencyPreserveAttachments = {4};
         vk::SubpassDescription transparencySubpass{
             .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
             .colorAttachmentCount = static_cast<uint32_t>(transparencyOutAttachments.size()),
             .pColorAttachments = transparencyOutAttachments.data(),
             .pDepthStencilAttachment = depthAttachments.data(),
+            .preserveAttachmentCount = static_cast<uint32_t>(transparencyPreserveAttachments.size()),
+            .pPreserveAttachments = transparencyPreserveAttachments.data(),
         };
 
         vk::SubpassDependency transparencyDependency{
@@ -680,9 +1136,44 @@ namespace volchara {
             .dstAccessMask = vk::AccessFlagBits::eInputAttachmentRead,
         };
 
-        std::vector<vk::AttachmentDescription> attachmentDescriptions { intermediateColorAttachment, intermediateEmissiveAttachment, normalAttachment, depthAttachment, finalColorAttachment };
-        std::vector<vk::SubpassDescription> subpassVec { colorSubpass, lightSubpass, transparencySubpass };
-        std::vector<vk::SubpassDependency> dependencyVec { startDependency, lightDependency, transparencyDependency };
+        std::vector<vk::AttachmentReference> resolveInAttachments = {
+            {.attachment = 5, .layout = vk::ImageLayout::eShaderReadOnlyOptimal},
+            {.attachment = 6, .layout = vk::ImageLayout::eShaderReadOnlyOptimal},
+        };
+        std::vector<vk::AttachmentReference> resolveOutAttachments = {
+            {.attachment = 4, .layout = vk::ImageLayout::eColorAttachmentOptimal}
+        };
+        vk::SubpassDescription resolveSubpass{
+            .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
+            .inputAttachmentCount = static_cast<uint32_t>(resolveInAttachments.size()),
+            .pInputAttachments = resolveInAttachments.data(),
+            .colorAttachmentCount = static_cast<uint32_t>(resolveOutAttachments.size()),
+            .pColorAttachments = resolveOutAttachments.data(),
+        };
+
+        vk::SubpassDependency resolveDependency{
+            .srcSubpass = 2,
+            .dstSubpass = 3,
+            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .dstStageMask = vk::PipelineStageFlagBits::eFragmentShader,
+            .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eInputAttachmentRead,
+            .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+        };
+        // the resolve blends over the lit image
+        vk::SubpassDependency litColorDependency{
+            .srcSubpass = 1,
+            .dstSubpass = 3,
+            .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+            .dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+            .dependencyFlags = vk::DependencyFlagBits::eByRegion,
+        };
+
+        std::vector<vk::AttachmentDescription> attachmentDescriptions { intermediateColorAttachment, intermediateEmissiveAttachment, normalAttachment, depthAttachment, finalColorAttachment, accumulationAttachment, revealageAttachment };
+        std::vector<vk::SubpassDescription> subpassVec { colorSubpass, lightSubpass, transparencySubpass, resolveSubpass };
+        std::vector<vk::SubpassDependency> dependencyVec { startDependency, lightDependency, transparencyDependency, resolveDependency, litColorDependency };
         vk::RenderPassCreateInfo renderPassInfo{
             .attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size()),
             .pAttachments = attachmentDescriptions.data(),
@@ -700,7 +1191,7 @@ namespace volchara {
             .binding = 0,
             .descriptorType = vk::DescriptorType::eUniformBuffer,
             .descriptorCount = 1,
-            .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+            .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute,
         };
         std::vector<vk::DescriptorSetLayoutBinding> uboBindings{uboLayoutBinding};
         vk::DescriptorSetLayoutCreateInfo ubolayoutInfo{
@@ -722,7 +1213,7 @@ namespace volchara {
             .stageFlags = vk::ShaderStageFlagBits::eFragment,
         };
         std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {samplerLayoutBinding, textureLayoutBinding};
-        std::array<vk::DescriptorBindingFlags, 2> flags{vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind, vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind};
+        std::array<vk::DescriptorBindingFlags, 2> flags{vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind, vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending | vk::DescriptorBindingFlagBits::eVariableDescriptorCount};
         vk::DescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{
             .bindingCount = flags.size(),
             .pBindingFlags = flags.data(),
@@ -739,15 +1230,46 @@ namespace volchara {
             .binding = 0,
             .descriptorType = vk::DescriptorType::eStorageBuffer,
             .descriptorCount = 1,
-            .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+            .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute,
+        };
+        vk::DescriptorSetLayoutBinding clustersLayoutBinding{
+            .binding = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute,
         };
-        std::vector<vk::DescriptorSetLayoutBinding> ssboBindings{ssboLayoutBinding};
+        std::vector<vk::DescriptorSetLayoutBinding> ssboBindings{ssboLayoutBinding, clustersLayoutBinding};
         vk::DescriptorSetLayoutCreateInfo ssbolayoutInfo{
             .bindingCount = static_cast<uint32_t>(ssboBindings.size()),
             .pBindings = ssboBindings.data(),
         };
         descriptorSetLayoutSSBO = device.createDescriptorSetLayout(ssbolayoutInfo);
 
+        vk::DescriptorSetLayoutBinding instancesLayoutBinding{
+            .binding = 0,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
+        };
+        vk::DescriptorSetLayoutBinding indirectLayoutBinding{
+            .binding = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eCompute,
+        };
+        vk::DescriptorSetLayoutBinding visibleLayoutBinding{
+            .binding = 2,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
+        };
+        std::vector<vk::DescriptorSetLayoutBinding> instancesBindings{instancesLayoutBinding, indirectLayoutBinding, visibleLayoutBinding};
+        vk::DescriptorSetLayoutCreateInfo instanceslayoutInfo{
+            .bindingCount = static_cast<uint32_t>(instancesBindings.size()),
+            .pBindings = instancesBindings.data(),
+        };
+        descriptorSetLayoutInstances = device.createDescriptorSetLayout(instanceslayoutInfo);
+
         vk::DescriptorSetLayoutBinding lightSubpassColorLayoutBinding{
             .binding = 0,
             .descriptorType = vk::DescriptorType::eInputAttachment,
@@ -778,6 +1300,25 @@ namespace volchara {
             .pBindings = lightSubpassLayoutBindings.data(),
         };
         descriptorSetLayoutLightSubpass = device.createDescriptorSetLayout(lightSubpassLayoutInfo);
+
+        vk::DescriptorSetLayoutBinding resolveSubpassAccumulationLayoutBinding{
+            .binding = 0,
+            .descriptorType = vk::DescriptorType::eInputAttachment,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eFragment,
+        };
+        vk::DescriptorSetLayoutBinding resolveSubpassRevealageLayoutBinding{
+            .binding = 1,
+            .descriptorType = vk::DescriptorType::eInputAttachment,
+            .descriptorCount = 1,
+            .stageFlags = vk::ShaderStageFlagBits::eFragment,
+        };
+        std::vector<vk::DescriptorSetLayoutBinding> resolveSubpassLayoutBindings{resolveSubpassAccumulationLayoutBinding, resolveSubpassRevealageLayoutBinding};
+        vk::DescriptorSetLayoutCreateInfo resolveSubpassLayoutInfo{
+            .bindingCount = static_cast<uint32_t>(resolveSubpassLayoutBindings.size()),
+            .pBindings = resolveSubpassLayoutBindings.data(),
+        };
+        descriptorSetLayoutResolveSubpass = device.createDescriptorSetLayout(resolveSubpassLayoutInfo);
     }
 
     vk::raii::ShaderModule Renderer::createShaderModule(const std::vector<unsigned char>& code) {
@@ -789,8 +1330,80 @@ namespace volchara {
         return device.createShaderModule(createInfo);
     }
 
+    std::filesystem::path Renderer::pipelineCachePath() {
+        return getResourceDir() / "pipeline_cache.bin";
+    }
+
+    PipelineCachePrefix Renderer::pipelineCachePrefix() {
+        PipelineCachePrefix prefix{
+            .vendorID = physicalDeviceProperties.vendorID,
+            .deviceID = physicalDeviceProperties.deviceID,
+            .driverVersion = physicalDeviceProperties.driverVersion,
+        };
+        std::copy(physicalDeviceProperties.pipelineCacheUUID.begin(), physicalDeviceProperties.pipelineCacheUUID.end(), prefix.pipelineCacheUUID.begin());
+        return prefix;
+    }
+
+    void Renderer::createPipelineCache() {
+        std::vector<unsigned char> cacheData;
+        std::error_code error;
+        if (std::filesystem::exists(pipelineCachePath(), error)) {
+            MappedFile file = MappedFile::fromPath(pipelineCachePath());
+            std::span<const unsigned char> bytes = file.bytes();
+            PipelineCachePrefix stored;
+            PipelineCachePrefix expected = pipelineCachePrefix();
+            if (bytes.size() >= sizeof(stored)) {
+                std::memcpy(&stored, bytes.data(), sizeof(stored));
+            }
+            // drivers validate the data too, but some crash on caches of another driver version
+            bool valid = bytes.size() >= sizeof(stored) && stored.magic == expected.magic && stored.vendorID == expected.vendorID && stored.deviceID == expected.deviceID && stored.driverVersion == expected.driverVersion && stored.pipelineCacheUUID == expected.pipelineCacheUUID && stored.dataSize == bytes.size() - sizeof(stored);
+            if (valid) {
+                cacheData.assign(bytes.begin() + sizeof(stored), bytes.end());
+            }
+        }
+        vk::PipelineCacheCreateInfo cacheInfo{
+            .initialDataSize = cacheData.size(),
+            .pInitialData = cacheData.data(),
+        };
+        pipelineCache = device.createPipelineCache(cacheInfo);
+    }
+
+    void Renderer::savePipelineCache() {
+        std::vector<uint8_t> cacheData = pipelineCache.getData();
+        PipelineCachePrefix prefix = pipelineCachePrefix();
+        prefix.dataSize = cacheData.size();
+        // written aside and renamed, a crash while saving can't leave a torn cache behind
+        std::filesystem::path tempPath = pipelineCachePath();
+        tempPath += ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cerr << "failed to save pipeline cache" << std::endl;
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(&prefix), sizeof(prefix));
+            file.write(reinterpret_cast<const char*>(cacheData.data()), cacheData.size());
+            // closed here so a failed flush shows up in the stream state as well
+            file.close();
+            if (!file) {
+                std::cerr << "failed to save pipeline cache" << std::endl;
+                std::error_code removeError;
+                std::filesystem::remove(tempPath, removeError);
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, pipelineCachePath(), error);
+        if (error) {
+            std::cerr << "failed to save pipeline cache: " << error.message() << std::endl;
+            std::error_code removeError;
+            std::filesystem::remove(tempPath, removeError);
+        }
+    }
+
     void Renderer::createGraphicsPipeline() {
-        auto vertShaderCode = readFile(getResourceDir() / "shaders/base.vert.spv");
+        std::filesystem::path baseVertShader = settings.vertexFormat == VertexFormat::eCompact ? "shaders/base_compact.vert.spv" : "shaders/base.vert.spv";
+        auto vertShaderCode = readFile(getResourceDir() / baseVertShader);
         auto fragShaderCode = readFile(getResourceDir() / "shaders/base.frag.spv");
 
         vk::raii::ShaderModule vertShaderModule = createShaderModule(vertShaderCode);
@@ -802,16 +1415,33 @@ namespace volchara {
             .pName = "main",
         };
 
+        // base.frag and light.frag agree on how the normals are stored
+        GBufferSpecialization gBufferSpecialization{
+            .packedNormals = settings.gBufferFormat == GBufferFormat::ePacked,
+        };
+        vk::SpecializationMapEntry packedNormalsEntry{
+            .constantID = 0,
+            .offset = offsetof(GBufferSpecialization, packedNormals),
+            .size = sizeof(vk::Bool32),
+        };
+        vk::SpecializationInfo gBufferSpecializationInfo{
+            .mapEntryCount = 1,
+            .pMapEntries = &packedNormalsEntry,
+            .dataSize = sizeof(gBufferSpecialization),
+            .pData = &gBufferSpecialization,
+        };
+
         vk::PipelineShaderStageCreateInfo fragShaderStageInfo{
             .stage = vk::ShaderStageFlagBits::eFragment,
             .module = fragShaderModule,
             .pName = "main",
+            .pSpecializationInfo = &gBufferSpecializationInfo,
         };
 
         std::vector<vk::PipelineShaderStageCreateInfo> shaderStages = {vertShaderStageInfo, fragShaderStageInfo};
 
-        std::vector<vk::VertexInputBindingDescription> inputBindings = std::vector{Vertex::getBindingDescription()};
-        std::vector<vk::VertexInputAttributeDescription> inputAttributes = Vertex::getAttributeDescriptions();
+        std::vector<vk::VertexInputBindingDescription> inputBindings = std::vector{Vertex::getBindingDescription(settings.vertexFormat)};
+        std::vector<vk::VertexInputAttributeDescription> inputAttributes = Vertex::getAttributeDescriptions(settings.vertexFormat);
         vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
             .vertexBindingDescriptionCount = static_cast<uint32_t>(inputBindings.size()),
             .pVertexBindingDescriptions = inputBindings.data(),
@@ -875,7 +1505,7 @@ namespace volchara {
         };
         std::vector<vk::PushConstantRange> pushConstantRanges = {pushConstantRange};
 
-        std::vector<vk::DescriptorSetLayout> descriptorSets = {*descriptorSetLayoutUBO, *descriptorSetLayoutTextures, *descriptorSetLayoutSSBO};
+        std::vector<vk::DescriptorSetLayout> descriptorSets = {*descriptorSetLayoutUBO, *descriptorSetLayoutTextures, *descriptorSetLayoutSSBO, *descriptorSetLayoutInstances};
         vk::PipelineLayoutCreateInfo pipelineLayoutInfo{
             .setLayoutCount = static_cast<uint32_t>(descriptorSets.size()),
             .pSetLayouts = descriptorSets.data(),
@@ -901,8 +1531,6 @@ namespace volchara {
             .subpass = 0,
         };
 
-        colorGraphicsPipeline = device.createGraphicsPipeline(nullptr, colorPipelineInfo);
-
         auto lightVertShaderCode = readFile(getResourceDir() / "shaders/light.vert.spv");
         auto lightFragShaderCode = readFile(getResourceDir() / "shaders/light.frag.spv");
         vk::raii::ShaderModule lightVertShaderModule = createShaderModule(lightVertShaderCode);
@@ -916,6 +1544,7 @@ namespace volchara {
             .stage = vk::ShaderStageFlagBits::eFragment,
             .module = lightFragShaderModule,
             .pName = "main",
+            .pSpecializationInfo = &gBufferSpecializationInfo,
         };
         std::vector<vk::PipelineShaderStageCreateInfo> lightShaderStages = {lightVertShaderStageInfo, lightFragShaderStageInfo};
 
@@ -966,9 +1595,7 @@ namespace volchara {
             .subpass = 1,
         };
 
-        lightGraphicsPipeline = device.createGraphicsPipeline(nullptr, lightPipelineInfo);
-
-        auto transparencyVertShaderCode = readFile(getResourceDir() / "shaders/base.vert.spv");
+        auto transparencyVertShaderCode = readFile(getResourceDir() / baseVertShader);
         auto transparencyFragShaderCode = readFile(getResourceDir() / "shaders/transparency.frag.spv");
         vk::raii::ShaderModule transparencyVertShaderModule = createShaderModule(transparencyVertShaderCode);
         vk::raii::ShaderModule transparencyFragShaderModule = createShaderModule(transparencyFragShaderCode);
@@ -990,15 +1617,24 @@ namespace volchara {
             .depthCompareOp = vk::CompareOp::eGreater,
         };
 
+        // both sums commute, the draw order doesn't change the result
         std::vector<vk::PipelineColorBlendAttachmentState> transparencyColorBlendAttachments{
             {
                 .blendEnable = true,
                 .srcColorBlendFactor = vk::BlendFactor::eOne,
-                .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+                .dstColorBlendFactor = vk::BlendFactor::eOne,
                 .srcAlphaBlendFactor = vk::BlendFactor::eOne,
-                .dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+                .dstAlphaBlendFactor = vk::BlendFactor::eOne,
                 .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA
             },
+            {
+                .blendEnable = true,
+                .srcColorBlendFactor = vk::BlendFactor::eZero,
+                .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcColor,
+                .srcAlphaBlendFactor = vk::BlendFactor::eZero,
+                .dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+                .colorWriteMask = vk::ColorComponentFlagBits::eR
+            },
         };
 
         vk::PipelineColorBlendStateCreateInfo transparencyColorBlending{
@@ -1006,7 +1642,7 @@ namespace volchara {
             .pAttachments = transparencyColorBlendAttachments.data(),
         };
 
-        std::vector<vk::DescriptorSetLayout> transparencyDescriptorSets = {*descriptorSetLayoutUBO, *descriptorSetLayoutTextures, *descriptorSetLayoutSSBO};
+        std::vector<vk::DescriptorSetLayout> transparencyDescriptorSets = {*descriptorSetLayoutUBO, *descriptorSetLayoutTextures, *descriptorSetLayoutSSBO, *descriptorSetLayoutInstances};
         vk::PipelineLayoutCreateInfo transparencyPipelineLayoutInfo{
             .setLayoutCount = static_cast<uint32_t>(transparencyDescriptorSets.size()),
             .pSetLayouts = transparencyDescriptorSets.data(),
@@ -1032,55 +1668,128 @@ namespace volchara {
             .subpass = 2,
         };
 
-        transparencyGraphicsPipeline = device.createGraphicsPipeline(nullptr, transparencyPipelineInfo);
-    }
+        auto resolveFragShaderCode = readFile(getResourceDir() / "shaders/resolve.frag.spv");
+        vk::raii::ShaderModule resolveFragShaderModule = createShaderModule(resolveFragShaderCode);
+        vk::PipelineShaderStageCreateInfo resolveFragShaderStageInfo{
+            .stage = vk::ShaderStageFlagBits::eFragment,
+            .module = resolveFragShaderModule,
+            .pName = "main",
+        };
+        // the fullscreen triangle of the light subpass
+        std::vector<vk::PipelineShaderStageCreateInfo> resolveShaderStages = {lightVertShaderStageInfo, resolveFragShaderStageInfo};
+        vk::PipelineVertexInputStateCreateInfo resolveVertexInputInfo{};
 
-    void Renderer::createCommandPool() {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        std::vector<vk::PipelineColorBlendAttachmentState> resolveColorBlendAttachments{
+            {
+                .blendEnable = true,
+                .srcColorBlendFactor = vk::BlendFactor::eSrcAlpha,
+                .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+                .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+                .dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+                .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA
+            },
+        };
+        vk::PipelineColorBlendStateCreateInfo resolveColorBlending{
+            .attachmentCount = static_cast<uint32_t>(resolveColorBlendAttachments.size()),
+            .pAttachments = resolveColorBlendAttachments.data(),
+        };
 
-        vk::CommandPoolCreateInfo poolInfo{
-            .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-            .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(),
+        std::vector<vk::DescriptorSetLayout> resolveDescriptorSets = {*descriptorSetLayoutResolveSubpass};
+        vk::PipelineLayoutCreateInfo resolvePipelineLayoutInfo{
+            .setLayoutCount = static_cast<uint32_t>(resolveDescriptorSets.size()),
+            .pSetLayouts = resolveDescriptorSets.data(),
         };
 
-        commandPool = device.createCommandPool(poolInfo);
-    }
+        resolvePipelineLayout = device.createPipelineLayout(resolvePipelineLayoutInfo);
 
-    void Renderer::createStagingBuffer(uint32_t size) {
-        vk::BufferCreateInfo bufferInfo{
-            .size = size,
-            .usage = vk::BufferUsageFlagBits::eTransferSrc,
-            .sharingMode = vk::SharingMode::eExclusive,
-        };
-        vma::AllocationCreateInfo allocInfo{
-            .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-            .usage = vma::MemoryUsage::eAuto,
+        vk::GraphicsPipelineCreateInfo resolvePipelineInfo{
+            .stageCount = static_cast<uint32_t>(resolveShaderStages.size()),
+            .pStages = resolveShaderStages.data(),
+            .pVertexInputState = &resolveVertexInputInfo,
+            .pInputAssemblyState = &inputAssembly,
+            .pViewportState = &viewportState,
+            .pRasterizationState = &rasterizer,
+            .pMultisampleState = &multisampling,
+            .pDepthStencilState = &lightDepthStencil,
+            .pColorBlendState = &resolveColorBlending,
+            .pDynamicState = &dynamicState,
+            .layout = resolvePipelineLayout,
+            .renderPass = renderPass,
+            .subpass = 3,
         };
-        stagingBuffer = allocator.createBuffer(bufferInfo, allocInfo);
+
+        // one call lets the driver compile the variants in parallel and share the cache lookups
+        std::array<vk::GraphicsPipelineCreateInfo, 4> pipelineInfos{colorPipelineInfo, lightPipelineInfo, transparencyPipelineInfo, resolvePipelineInfo};
+        vk::raii::Pipelines pipelines(device, pipelineCache, pipelineInfos);
+        colorGraphicsPipeline = std::move(pipelines[0]);
+        lightGraphicsPipeline = std::move(pipelines[1]);
+        transparencyGraphicsPipeline = std::move(pipelines[2]);
+        resolveGraphicsPipeline = std::move(pipelines[3]);
     }
 
-    void Renderer::createVertexBuffer(uint32_t size) {
-        vk::BufferCreateInfo bufferInfo{
-            .size = size,
-            .usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-            .sharingMode = vk::SharingMode::eExclusive,
+    void Renderer::createCullPipeline() {
+        auto cullShaderCode = readFile(getResourceDir() / "shaders/cull.comp.spv");
+        vk::raii::ShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+        vk::PushConstantRange pushConstantRange{
+            .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            .size = sizeof(CullPushConstants),
         };
-        vma::AllocationCreateInfo allocInfo{
-            .usage = vma::MemoryUsage::eAuto,
+        std::vector<vk::DescriptorSetLayout> descriptorSets = {*descriptorSetLayoutUBO, *descriptorSetLayoutInstances};
+        vk::PipelineLayoutCreateInfo pipelineLayoutInfo{
+            .setLayoutCount = static_cast<uint32_t>(descriptorSets.size()),
+            .pSetLayouts = descriptorSets.data(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange,
+        };
+        cullPipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+
+        vk::ComputePipelineCreateInfo pipelineInfo{
+            .stage = {
+                .stage = vk::ShaderStageFlagBits::eCompute,
+                .module = cullShaderModule,
+                .pName = "main",
+            },
+            .layout = cullPipelineLayout,
         };
-        vertexBuffer = allocator.createBuffer(bufferInfo, allocInfo);
+        cullPipeline = device.createComputePipeline(pipelineCache, pipelineInfo);
     }
 
-    void Renderer::createIndexBuffer(uint32_t size) {
-        vk::BufferCreateInfo bufferInfo{
-            .size = size,
-            .usage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-            .sharingMode = vk::SharingMode::eExclusive,
+    void Renderer::createLightCullPipeline() {
+        auto lightCullShaderCode = readFile(getResourceDir() / "shaders/light_cull.comp.spv");
+        vk::raii::ShaderModule lightCullShaderModule = createShaderModule(lightCullShaderCode);
+
+        std::vector<vk::DescriptorSetLayout> descriptorSets = {*descriptorSetLayoutUBO, *descriptorSetLayoutSSBO};
+        vk::PipelineLayoutCreateInfo pipelineLayoutInfo{
+            .setLayoutCount = static_cast<uint32_t>(descriptorSets.size()),
+            .pSetLayouts = descriptorSets.data(),
         };
-        vma::AllocationCreateInfo allocInfo{
-            .usage = vma::MemoryUsage::eAuto,
+        lightCullPipelineLayout = device.createPipelineLayout(pipelineLayoutInfo);
+
+        vk::ComputePipelineCreateInfo pipelineInfo{
+            .stage = {
+                .stage = vk::ShaderStageFlagBits::eCompute,
+                .module = lightCullShaderModule,
+                .pName = "main",
+            },
+            .layout = lightCullPipelineLayout,
+        };
+        lightCullPipeline = device.createComputePipeline(pipelineCache, pipelineInfo);
+    }
+
+    void Renderer::createCommandPool() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        vk::CommandPoolCreateInfo poolInfo{
+            .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+            .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(),
         };
-        indexBuffer = allocator.createBuffer(bufferInfo, allocInfo);
+
+        commandPool = device.createCommandPool(poolInfo);
+    }
+
+    void Renderer::createGeometryPool(uint32_t vertexCount, uint32_t indexCount) {
+        geometryPool = GeometryPool(allocator, deviceBufferCopyHandler, [this]() { waitForFramesInFlight(); }, settings.vertexFormat, vertexCount, indexCount);
     }
 
     void Renderer::createUniformBuffers() {
@@ -1098,9 +1807,60 @@ namespace volchara {
         }
     }
 
-    void Renderer::createSSBOBuffer(uint32_t size) {
+    void Renderer::createInstanceBuffers() {
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            instanceBuffers.push_back(nullptr);
+            indirectBuffers.push_back(nullptr);
+            visibleInstanceBuffers.push_back(nullptr);
+            instanceBufferCapacities.push_back(0);
+            allocateInstanceBuffers(i, INITIAL_INSTANCE_CAPACITY);
+        }
+    }
+
+    void Renderer::allocateInstanceBuffers(uint32_t frame, uint32_t capacity) {
+        vk::BufferCreateInfo instanceBufferInfo{
+            .size = capacity * sizeof(GPUInstance),
+            .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        // there is never more draws than instances times their LODs
+        vk::BufferCreateInfo indirectBufferInfo{
+            .size = INDIRECT_COMMANDS_OFFSET + capacity * MAX_MESH_LODS * sizeof(vk::DrawIndexedIndirectCommand),
+            .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        // one slice per LOD
+        vk::BufferCreateInfo visibleBufferInfo{
+            .size = capacity * MAX_MESH_LODS * sizeof(uint32_t),
+            .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        vma::AllocationCreateInfo hostAllocInfo{
+            .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
+            .usage = vma::MemoryUsage::eAuto,
+        };
+        vma::AllocationCreateInfo deviceAllocInfo{
+            .usage = vma::MemoryUsage::eAutoPreferDevice,
+        };
+        instanceBuffers[frame] = allocator.createBuffer(instanceBufferInfo, hostAllocInfo);
+        indirectBuffers[frame] = allocator.createBuffer(indirectBufferInfo, hostAllocInfo);
+        visibleInstanceBuffers[frame] = allocator.createBuffer(visibleBufferInfo, deviceAllocInfo);
+        instanceBufferCapacities[frame] = capacity;
+    }
+
+    void Renderer::growInstanceBuffer(uint32_t frame, uint32_t minCapacity) {
+        // the frame's fence is already waited on, nothing reads the old buffers
+        uint32_t capacity = instanceBufferCapacities[frame];
+        while (capacity < minCapacity) {
+            capacity *= 2;
+        }
+        allocateInstanceBuffers(frame, capacity);
+        writeInstanceDescriptor(frame);
+    }
+
+    void Renderer::createSSBOBuffer(uint32_t capacity) {
         vk::BufferCreateInfo bufferInfo{
-            .size = size,
+            .size = sizeof(GPULightHeader) + capacity * sizeof(GPULight),
             .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
             .sharingMode = vk::SharingMode::eExclusive,
         };
@@ -1108,14 +1868,47 @@ namespace volchara {
             .usage = vma::MemoryUsage::eAuto,
         };
         ssboBuffer = allocator.createBuffer(bufferInfo, allocInfo);
+        lightCapacity = capacity;
+    }
+
+    void Renderer::createLightClusterBuffers() {
+        vk::BufferCreateInfo bufferInfo{
+            .size = LIGHT_CLUSTER_COUNT * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t),
+            .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        vma::AllocationCreateInfo allocInfo{
+            .usage = vma::MemoryUsage::eAutoPreferDevice,
+        };
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            lightClusterBuffers.push_back(allocator.createBuffer(bufferInfo, allocInfo));
+        }
+    }
+
+    void Renderer::writeLightsDescriptors() {
+        // every frame's set points at the one lights buffer, only the clusters are per frame
+        vk::DescriptorBufferInfo ssbobufferInfo{
+            .buffer = ssboBuffer,
+            .range = vk::WholeSize,
+        };
+        for (vk::raii::DescriptorSet& set : descriptorSetsSSBO) {
+            vk::WriteDescriptorSet ssbodescriptorWrite{
+                .dstSet = set,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .pBufferInfo = &ssbobufferInfo,
+            };
+            device.updateDescriptorSets(ssbodescriptorWrite, nullptr);
+        }
     }
 
-    RAIIvmaImage Renderer::createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::ImageAspectFlags aspectFlags) {
+    RAIIvmaImage Renderer::createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels) {
         vk::ImageCreateInfo imageInfo{
             .imageType = vk::ImageType::e2D,
             .format = format,
             .extent = {width, height, 1},
-            .mipLevels = 1,
+            .mipLevels = mipLevels,
             .arrayLayers = 1,
             .tiling = tiling,
             .usage = usage,
@@ -1128,6 +1921,25 @@ namespace volchara {
         return image;
     }
 
+    RAIIvmaImage Renderer::createTransientAttachment(vk::Format format, vk::ImageUsageFlags usage, vk::ImageAspectFlags aspectFlags) {
+        vk::ImageCreateInfo imageInfo{
+            .imageType = vk::ImageType::e2D,
+            .format = format,
+            .extent = {swapChainExtent.width, swapChainExtent.height, 1},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = usage | vk::ImageUsageFlagBits::eTransientAttachment,
+            .sharingMode = vk::SharingMode::eExclusive,
+        };
+        // most desktop GPUs have no lazily allocated memory, the attachments then stay in device memory
+        // the render pass starts them undefined, so they need no layout transition of their own
+        vma::AllocationCreateInfo allocInfo{
+            .usage = supportsLazyAllocation ? vma::MemoryUsage::eGpuLazilyAllocated : vma::MemoryUsage::eAutoPreferDevice,
+        };
+        return allocator.createImage(imageInfo, allocInfo, aspectFlags);
+    }
+
     vk::raii::CommandBuffer Renderer::beginSingleTimeCommands() {
         vk::CommandBufferAllocateInfo allocInfo{
             .commandPool = commandPool,
@@ -1148,6 +1960,7 @@ namespace volchara {
             .commandBufferCount = 1,
             .pCommandBuffers = &*buffer,
         };
+        std::lock_guard<std::mutex> queueLock(queueMutex);
         graphicsQueue.submit(submitInfo);
         graphicsQueue.waitIdle();
     }
@@ -1206,39 +2019,57 @@ namespace volchara {
     void Renderer::createDepthResources() {
         vk::Format depthFormat = findDepthFormat();
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            depthBuffers.push_back(createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eDepth));
-            transitionImageLayout(depthBuffers[i], depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+            depthBuffers.push_back(createTransientAttachment(depthFormat, vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::ImageAspectFlagBits::eDepth));
         }
     }
 
     void Renderer::createEmissiveResources() {
-        vk::Format emissiveFormat = vk::Format::eR8G8B8A8Unorm;
+        vk::Format emissiveFormat = findEmissiveFormat();
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            emissiveBuffers.push_back(createImage(swapChainExtent.width, swapChainExtent.height, emissiveFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal));
-            transitionImageLayout(emissiveBuffers[i], emissiveFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal);
+            emissiveBuffers.push_back(createTransientAttachment(emissiveFormat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment));
         }
     }
 
     void Renderer::createNormalResources() {
-        vk::Format normalFormat = vk::Format::eR16G16B16A16Sfloat;
+        vk::Format normalFormat = findNormalFormat();
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            normalBuffers.push_back(createImage(swapChainExtent.width, swapChainExtent.height, normalFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal));
-            transitionImageLayout(normalBuffers[i], normalFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal);
+            normalBuffers.push_back(createTransientAttachment(normalFormat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment));
         }
     }
 
     void Renderer::createIntermediateColorResources() {
         vk::Format interFormat = vk::Format::eR8G8B8A8Unorm;
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            intermediateColorBuffers.push_back(createImage(swapChainExtent.width, swapChainExtent.height, interFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal));
-            transitionImageLayout(intermediateColorBuffers[i], interFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal);
+            intermediateColorBuffers.push_back(createTransientAttachment(interFormat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment));
+        }
+    }
+
+    void Renderer::createTransparencyResources() {
+        vk::Format accumulationFormat = vk::Format::eR16G16B16A16Sfloat;
+        vk::Format revealageFormat = vk::Format::eR16Sfloat;
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            accumulationBuffers.push_back(createTransientAttachment(accumulationFormat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment));
+            revealageBuffers.push_back(createTransientAttachment(revealageFormat, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eInputAttachment));
+        }
+    }
+
+    void Renderer::createSceneColorResources() {
+        if (!settings.dynamicResolution) {
+            return;
+        }
+        // the whole image is kept so the scale can change without reallocating, only its rendered corner is blitted
+        vk::FormatFeatureFlags features = physicalDevice.getFormatProperties(swapChainImageFormat).optimalTilingFeatures;
+        upscaleFilter = (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) ? vk::Filter::eLinear : vk::Filter::eNearest;
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            sceneColorBuffers.push_back(createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eDeviceLocal));
         }
     }
 
     void Renderer::createFramebuffers() {
         swapChainFramebuffers.clear();
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            std::vector<vk::ImageView> attachments{intermediateColorBuffers[i].imageView(), emissiveBuffers[i].imageView(), normalBuffers[i].imageView(), depthBuffers[i].imageView(), *swapChainImageViews[i]};
+            vk::ImageView finalColor = sceneColorBuffers.empty() ? *swapChainImageViews[i] : sceneColorBuffers[i].imageView();
+            std::vector<vk::ImageView> attachments{intermediateColorBuffers[i].imageView(), emissiveBuffers[i].imageView(), normalBuffers[i].imageView(), depthBuffers[i].imageView(), finalColor, accumulationBuffers[i].imageView(), revealageBuffers[i].imageView()};
             vk::FramebufferCreateInfo framebufferInfo{
                 .renderPass = renderPass,
                 .attachmentCount = static_cast<uint32_t>(attachments.size()),
@@ -1251,38 +2082,103 @@ namespace volchara {
         }
     }
 
-    uint32_t Renderer::createTextureImage(std::vector<unsigned char> textureData) {
-        // TODO: deduplication
-        int width, height, channels;
-        stbi_uc* pixels = stbi_load_from_memory(textureData.data(), textureData.size(), &width, &height, &channels, STBI_rgb_alpha);
-        vk::DeviceSize imageSize = width * height * STBI_rgb_alpha;
-
-        if (!pixels) {
-            throw std::runtime_error("couldn't load texture image");
-        };
+    uint32_t Renderer::createTextureImage(std::span<const unsigned char> textureData) {
+        TextureData texture = TextureData::fromMemory(textureData);
+        uint32_t textureIndex = allocateTextureSlot();
+        uploadTexture(textureIndex, texture);
+        textureResident[textureIndex] = true;
+        return textureIndex;
+    }
 
-        vk::BufferCreateInfo createInfo{
-            .size = imageSize,
-            .usage = vk::BufferUsageFlagBits::eTransferSrc,
-            .sharingMode = vk::SharingMode::eExclusive,
-        };
-        vk::raii::Buffer stagingBuffer = device.createBuffer(createInfo);
-        vma::AllocationCreateInfo allocInfo{
-            .flags = vma::AllocationCreateFlagBits::eHostAccessSequentialWrite | vma::AllocationCreateFlagBits::eMapped,
-            .usage = vma::MemoryUsage::eAuto,
-        };
-        RAIIvmaBuffer textureBuffer = allocator.createBuffer(createInfo, allocInfo);
-        
-        textureBuffer.copyFrom(pixels, imageSize);
-        stbi_image_free(pixels);
+    void Renderer::uploadTexture(uint32_t textureIndex, TextureData& texture) {
+        ZoneScoped;
+        vk::FormatFeatureFlags formatFeatures = physicalDevice.getFormatProperties(texture.format).optimalTilingFeatures;
+        if (!(formatFeatures & vk::FormatFeatureFlagBits::eSampledImage)) {
+            throw std::runtime_error("texture format isn't supported by the device");
+        }
+        // pre-compressed textures bring their own chain, blits only work on uncompressed formats
+        vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        bool generateMips = texture.levels.size() == 1 && (formatFeatures & blitFeatures) == blitFeatures;
+        uint32_t mipLevels = texture.levels.size();
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+        if (generateMips) {
+            mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texture.width, texture.height)))) + 1;
+            usage |= vk::ImageUsageFlagBits::eTransferSrc;
+        }
 
-        RAIIvmaImage image = createImage(width, height, vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        RAIIvmaImage image = createImage(texture.width, texture.height, texture.format, vk::ImageTiling::eOptimal, usage, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor, mipLevels);
+
+        std::vector<vk::BufferImageCopy> regions;
+        for (uint32_t level = 0; level < texture.levels.size(); level++) {
+            regions.push_back({
+                .bufferOffset = texture.levels[level].offset,
+                .imageSubresource = {
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1,
+                },
+                .imageExtent = {texture.levels[level].width, texture.levels[level].height, 1},
+            });
+        }
+        // layout transitions are recorded by the upload queue around the copy
+        image.copyLevels(texture.data.data(), texture.data.size(), regions, generateMips && mipLevels > 1 ? vk::ImageLayout::eTransferDstOptimal : vk::ImageLayout::eShaderReadOnlyOptimal);
+        if (generateMips && mipLevels > 1) {
+            pendingMipmaps.push_back({
+                .image = image,
+                .width = texture.width,
+                .height = texture.height,
+                .mipLevels = mipLevels,
+            });
+        }
+        textures[textureIndex] = std::make_shared<RAIIvmaImage>(std::move(image));
+    }
 
-        transitionImageLayout(image, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-        image.copyFrom(textureBuffer.allocInfo().pMappedData, imageSize);
-        transitionImageLayout(image, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
-        textures.push_back(std::move(image));
-        return textures.size() - 1;
+    void Renderer::recordMipmapGeneration(uint32_t bufferIndex) {
+        // runs after the frame's wait on the upload timeline, which covers the first levels
+        for (const PendingMipmaps& pending : pendingMipmaps) {
+            vk::ImageMemoryBarrier barrier{
+                .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+                .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+                .image = pending.image,
+                .subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1},
+            };
+            int32_t width = pending.width;
+            int32_t height = pending.height;
+            for (uint32_t level = 1; level < pending.mipLevels; level++) {
+                barrier.subresourceRange.baseMipLevel = level - 1;
+                barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+                barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+                barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+                commandBuffers[bufferIndex].pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+
+                int32_t levelWidth = std::max(width / 2, 1);
+                int32_t levelHeight = std::max(height / 2, 1);
+                vk::ImageBlit blit{
+                    .srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level - 1, .baseArrayLayer = 0, .layerCount = 1},
+                    .srcOffsets = std::array<vk::Offset3D, 2>{vk::Offset3D{0, 0, 0}, vk::Offset3D{width, height, 1}},
+                    .dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level, .baseArrayLayer = 0, .layerCount = 1},
+                    .dstOffsets = std::array<vk::Offset3D, 2>{vk::Offset3D{0, 0, 0}, vk::Offset3D{levelWidth, levelHeight, 1}},
+                };
+                commandBuffers[bufferIndex].blitImage(pending.image, vk::ImageLayout::eTransferSrcOptimal, pending.image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+                barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+                barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+                barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+                barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                commandBuffers[bufferIndex].pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
+                width = levelWidth;
+                height = levelHeight;
+            }
+            barrier.subresourceRange.baseMipLevel = pending.mipLevels - 1;
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+            barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+            barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            commandBuffers[bufferIndex].pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, nullptr, nullptr, barrier);
+        }
+        pendingMipmaps.clear();
     }
 
     void Renderer::createDescriptorPool() {
@@ -1292,7 +2188,7 @@ namespace volchara {
         };
         vk::DescriptorPoolSize ssboSize{
             .type = vk::DescriptorType::eStorageBuffer,
-            .descriptorCount = 1,
+            .descriptorCount = 5 * static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
         };
         vk::DescriptorPoolSize imageSize{
             .type = vk::DescriptorType::eSampledImage,
@@ -1320,13 +2216,6 @@ namespace volchara {
             .pSetLayouts = uboLayouts.data(),
         };
         descriptorSetsUBO = device.allocateDescriptorSets(uboallocInfo);
-        std::vector<vk::DescriptorSetLayout> lightSubpassLayouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayoutLightSubpass);
-        vk::DescriptorSetAllocateInfo lightSubpassAllocInfo{
-            .descriptorPool = descriptorPool,
-            .descriptorSetCount = static_cast<uint32_t>(lightSubpassLayouts.size()),
-            .pSetLayouts = lightSubpassLayouts.data(),
-        };
-        descriptorSetsLightSubpass = device.allocateDescriptorSets(lightSubpassAllocInfo);
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
             vk::DescriptorBufferInfo ubobufferInfo{
                 .buffer = uniformBuffers[i],
@@ -1341,6 +2230,94 @@ namespace volchara {
                 .pBufferInfo = &ubobufferInfo,
             };
             device.updateDescriptorSets(ubodescriptorWrite, nullptr);
+        }
+        createAttachmentDescriptorSets();
+
+        vk::DescriptorSetVariableDescriptorCountAllocateInfo texturecountInfo{
+            .descriptorSetCount = 1,
+            .pDescriptorCounts = &maxTextures,
+        };
+        vk::DescriptorSetAllocateInfo textureallocInfo{
+            .pNext = &texturecountInfo,
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &*descriptorSetLayoutTextures,
+        };
+        descriptorSetsTextures = device.allocateDescriptorSets(textureallocInfo);
+        // the table is partially bound, slots without a resident texture stay unwritten
+        for (uint32_t i = 0; i < textures.size(); i++) {
+            if (textureResident[i]) {
+                loadTextureToDescriptors(i);
+            }
+        }
+
+        vk::DescriptorImageInfo samplerInfo{textureSampler};
+        vk::WriteDescriptorSet samplerdescriptorWrite{
+            .dstSet = descriptorSetsTextures[0],
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eSampler,
+            .pImageInfo = &samplerInfo,
+        };
+        device.updateDescriptorSets(samplerdescriptorWrite, nullptr);
+        
+        std::vector<vk::DescriptorSetLayout> ssboLayouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayoutSSBO);
+        vk::DescriptorSetAllocateInfo ssboallocInfo{
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(ssboLayouts.size()),
+            .pSetLayouts = ssboLayouts.data(),
+        };
+        descriptorSetsSSBO = device.allocateDescriptorSets(ssboallocInfo);
+        writeLightsDescriptors();
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            vk::DescriptorBufferInfo clustersBufferInfo{
+                .buffer = lightClusterBuffers[i],
+                .range = vk::WholeSize,
+            };
+            vk::WriteDescriptorSet clustersDescriptorWrite{
+                .dstSet = descriptorSetsSSBO[i],
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .pBufferInfo = &clustersBufferInfo,
+            };
+            device.updateDescriptorSets(clustersDescriptorWrite, nullptr);
+        }
+
+        std::vector<vk::DescriptorSetLayout> instancesLayouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayoutInstances);
+        vk::DescriptorSetAllocateInfo instancesAllocInfo{
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(instancesLayouts.size()),
+            .pSetLayouts = instancesLayouts.data(),
+        };
+        descriptorSetsInstances = device.allocateDescriptorSets(instancesAllocInfo);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            writeInstanceDescriptor(i);
+        }
+    }
+
+    void Renderer::createAttachmentDescriptorSets() {
+        // color, emissive, normal and depth of the light subpass, accumulation and revealage of the resolve
+        vk::DescriptorPoolSize inputAttachmentSize{
+            .type = vk::DescriptorType::eInputAttachment,
+            .descriptorCount = 6 * static_cast<uint32_t>(swapChainImageViews.size()),
+        };
+        vk::DescriptorPoolCreateInfo poolInfo{
+            .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+            .maxSets = 2 * static_cast<uint32_t>(swapChainImageViews.size()),
+            .poolSizeCount = 1,
+            .pPoolSizes = &inputAttachmentSize,
+        };
+        attachmentDescriptorPool = device.createDescriptorPool(poolInfo);
+
+        std::vector<vk::DescriptorSetLayout> lightSubpassLayouts(swapChainImageViews.size(), descriptorSetLayoutLightSubpass);
+        vk::DescriptorSetAllocateInfo lightSubpassAllocInfo{
+            .descriptorPool = attachmentDescriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(lightSubpassLayouts.size()),
+            .pSetLayouts = lightSubpassLayouts.data(),
+        };
+        descriptorSetsLightSubpass = device.allocateDescriptorSets(lightSubpassAllocInfo);
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
             vk::DescriptorImageInfo colorDescriptorImage{
                 .imageView = intermediateColorBuffers[i].imageView(),
                 .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
@@ -1388,67 +2365,81 @@ namespace volchara {
             device.updateDescriptorSets({colorDescriptorWrite, emissiveDescriptorWrite, normalDescriptorWrite, depthDescriptorWrite}, nullptr);
         }
 
-        vk::DescriptorSetVariableDescriptorCountAllocateInfo texturecountInfo{
-            .descriptorSetCount = 1,
-            .pDescriptorCounts = &maxTextures,
+        std::vector<vk::DescriptorSetLayout> resolveSubpassLayouts(swapChainImageViews.size(), descriptorSetLayoutResolveSubpass);
+        vk::DescriptorSetAllocateInfo resolveSubpassAllocInfo{
+            .descriptorPool = attachmentDescriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(resolveSubpassLayouts.size()),
+            .pSetLayouts = resolveSubpassLayouts.data(),
         };
-        vk::DescriptorSetAllocateInfo textureallocInfo{
-            .pNext = &texturecountInfo,
-            .descriptorPool = descriptorPool,
-            .descriptorSetCount = 1,
-            .pSetLayouts = &*descriptorSetLayoutTextures,
-        };
-        descriptorSetsTextures = device.allocateDescriptorSets(textureallocInfo);
-        std::vector<vk::DescriptorImageInfo> imgs;
-        for (uint32_t i = 0; i < textures.size(); i++) {
-            imgs.push_back({
-                .imageView = textures[i].imageView(),
+        descriptorSetsResolveSubpass = device.allocateDescriptorSets(resolveSubpassAllocInfo);
+        for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+            vk::DescriptorImageInfo accumulationDescriptorImage{
+                .imageView = accumulationBuffers[i].imageView(),
                 .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-            });
+            };
+            vk::DescriptorImageInfo revealageDescriptorImage{
+                .imageView = revealageBuffers[i].imageView(),
+                .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+            };
+            vk::WriteDescriptorSet accumulationDescriptorWrite{
+                .dstSet = descriptorSetsResolveSubpass[i],
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eInputAttachment,
+                .pImageInfo = &accumulationDescriptorImage,
+            };
+            vk::WriteDescriptorSet revealageDescriptorWrite{
+                .dstSet = descriptorSetsResolveSubpass[i],
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eInputAttachment,
+                .pImageInfo = &revealageDescriptorImage,
+            };
+            device.updateDescriptorSets({accumulationDescriptorWrite, revealageDescriptorWrite}, nullptr);
         }
-        vk::WriteDescriptorSet texturedescriptorWrite{
-            .dstSet = descriptorSetsTextures[0],
-            .dstBinding = 1,
-            .descriptorCount = static_cast<uint32_t>(imgs.size()),
-            .descriptorType = vk::DescriptorType::eSampledImage,
-            .pImageInfo = imgs.data(),
-        };
-        device.updateDescriptorSets(texturedescriptorWrite, nullptr);
+    }
 
-        vk::DescriptorImageInfo samplerInfo{textureSampler};
-        vk::WriteDescriptorSet samplerdescriptorWrite{
-            .dstSet = descriptorSetsTextures[0],
-            .dstBinding = 0,
-            .descriptorCount = 1,
-            .descriptorType = vk::DescriptorType::eSampler,
-            .pImageInfo = &samplerInfo,
+    void Renderer::writeInstanceDescriptor(uint32_t frame) {
+        vk::DescriptorBufferInfo instancesBufferInfo{
+            .buffer = instanceBuffers[frame],
+            .range = vk::WholeSize,
         };
-        device.updateDescriptorSets(samplerdescriptorWrite, nullptr);
-        
-        vk::DescriptorSetAllocateInfo ssboallocInfo{
-            .descriptorPool = descriptorPool,
-            .descriptorSetCount = 1,
-            .pSetLayouts = &*descriptorSetLayoutSSBO,
+        vk::DescriptorBufferInfo indirectBufferInfo{
+            .buffer = indirectBuffers[frame],
+            .range = vk::WholeSize,
         };
-        descriptorSetsSSBO = device.allocateDescriptorSets(ssboallocInfo);
-        vk::DescriptorBufferInfo ssbobufferInfo{
-            .buffer = ssboBuffer,
+        vk::DescriptorBufferInfo visibleBufferInfo{
+            .buffer = visibleInstanceBuffers[frame],
             .range = vk::WholeSize,
         };
-        vk::WriteDescriptorSet ssbodescriptorWrite{
-            .dstSet = descriptorSetsSSBO[0],
+        vk::WriteDescriptorSet instancesDescriptorWrite{
+            .dstSet = descriptorSetsInstances[frame],
             .dstBinding = 0,
             .descriptorCount = 1,
             .descriptorType = vk::DescriptorType::eStorageBuffer,
-            .pBufferInfo = &ssbobufferInfo,
+            .pBufferInfo = &instancesBufferInfo,
+        };
+        vk::WriteDescriptorSet indirectDescriptorWrite{
+            .dstSet = descriptorSetsInstances[frame],
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &indirectBufferInfo,
         };
-        device.updateDescriptorSets(ssbodescriptorWrite, nullptr);
+        vk::WriteDescriptorSet visibleDescriptorWrite{
+            .dstSet = descriptorSetsInstances[frame],
+            .dstBinding = 2,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo = &visibleBufferInfo,
+        };
+        device.updateDescriptorSets({instancesDescriptorWrite, indirectDescriptorWrite, visibleDescriptorWrite}, nullptr);
     }
 
     uint32_t Renderer::loadTextureToDescriptors(uint32_t textureIndex) {
         vk::DescriptorImageInfo imgInfo{
             .sampler = textureSampler,
-            .imageView = textures[textureIndex].imageView(),
+            .imageView = textures[textureIndex]->imageView(),
             .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
         };
         vk::WriteDescriptorSet setUpdate{
@@ -1473,6 +2464,72 @@ namespace volchara {
         commandBuffers = device.allocateCommandBuffers(allocInfo);
     }
 
+    void Renderer::createTimestampQueries() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndices.graphicsFamily.value()].timestampValidBits;
+        // the culling span is written from compute work on the graphics queue
+        supportsTimestamps = validBits > 0 && physicalDeviceProperties.limits.timestampComputeAndGraphics;
+        if (supportsTimestamps) {
+            timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+            vk::QueryPoolCreateInfo queryPoolInfo{
+                .queryType = vk::QueryType::eTimestamp,
+                .queryCount = FRAME_TIMESTAMP_COUNT * MAX_FRAMES_IN_FLIGHT,
+            };
+            timestampQueryPool = device.createQueryPool(queryPoolInfo);
+        }
+        // calibrates on the first frame's command buffer before it is ever recorded
+        tracyContext = TracyVkContext(*physicalDevice, *device, *graphicsQueue, *commandBuffers[0]);
+    }
+
+    void Renderer::writeFrameTimestamp(uint32_t bufferIndex, FrameTimestamp timestamp) {
+        if (!supportsTimestamps) {
+            return;
+        }
+        vk::PipelineStageFlagBits stage = timestamp == FRAME_BEGIN ? vk::PipelineStageFlagBits::eTopOfPipe : vk::PipelineStageFlagBits::eBottomOfPipe;
+        commandBuffers[bufferIndex].writeTimestamp(stage, timestampQueryPool, bufferIndex * FRAME_TIMESTAMP_COUNT + timestamp);
+    }
+
+    void Renderer::readFrameTimestamps(uint32_t frame) {
+        if (!supportsTimestamps || !timestampsWritten[frame]) {
+            return;
+        }
+        // the frame's fence is waited on, its queries are available
+        std::pair<vk::Result, std::vector<uint64_t>> results = timestampQueryPool.getResults<uint64_t>(frame * FRAME_TIMESTAMP_COUNT, FRAME_TIMESTAMP_COUNT, FRAME_TIMESTAMP_COUNT * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if (results.first != vk::Result::eSuccess) {
+            return;
+        }
+        const std::vector<uint64_t>& ticks = results.second;
+        auto spanMs = [&](FrameTimestamp from, FrameTimestamp to) {
+            return static_cast<float>(((ticks[to] - ticks[from]) & timestampMask) * physicalDeviceProperties.limits.timestampPeriod / 1e6);
+        };
+        stats.cullingMs = spanMs(FRAME_BEGIN, CULLING_END);
+        stats.colorMs = spanMs(CULLING_END, COLOR_END);
+        stats.lightMs = spanMs(COLOR_END, LIGHT_END);
+        stats.transparencyMs = spanMs(LIGHT_END, TRANSPARENCY_END);
+        stats.gpuFrameMs = spanMs(FRAME_BEGIN, TRANSPARENCY_END);
+    }
+
+    void Renderer::createLoadingJobs() {
+        // decoding is mostly waiting on disk and inflating, half the cores leaves the rest for recording
+        loadingJobs = std::make_unique<JobSystem>(std::max(1u, std::thread::hardware_concurrency() / 2));
+    }
+
+    void Renderer::createRecordingPools() {
+        uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        recordingJobs = std::make_unique<JobSystem>(hardwareThreads - 1);
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        // command pools are externally synchronized, every thread records from its own
+        vk::CommandPoolCreateInfo poolInfo{
+            .flags = vk::CommandPoolCreateFlagBits::eTransient,
+            .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(),
+        };
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT * recordingJobs->threadCount(); i++) {
+            RecordingPool recordingPool;
+            recordingPool.pool = device.createCommandPool(poolInfo);
+            recordingPools.push_back(std::move(recordingPool));
+        }
+    }
+
     void Renderer::createSyncObjects() {
         vk::FenceCreateInfo fenceInfo{
             .flags = vk::FenceCreateFlagBits::eSignaled,
@@ -1564,6 +2621,35 @@ namespace volchara {
             pressedKeys.erase(GLFW_KEY_C);
             debugFeatures.culling = !debugFeatures.culling;
         }
+        if (pressedKeys.contains(GLFW_KEY_RIGHT_CONTROL) && pressedKeys.contains(GLFW_KEY_I)) {
+            pressedKeys.erase(GLFW_KEY_I);
+            debugFeatures.instancing = !debugFeatures.instancing;
+        }
+        if (pressedKeys.contains(GLFW_KEY_RIGHT_CONTROL) && pressedKeys.contains(GLFW_KEY_F)) {
+            pressedKeys.erase(GLFW_KEY_F);
+            debugFeatures.gpuCulling = !debugFeatures.gpuCulling;
+        }
+        if (pressedKeys.contains(GLFW_KEY_RIGHT_CONTROL) && pressedKeys.contains(GLFW_KEY_L)) {
+            pressedKeys.erase(GLFW_KEY_L);
+            debugFeatures.lods = !debugFeatures.lods;
+        }
+        if (pressedKeys.contains(GLFW_KEY_RIGHT_CONTROL) && pressedKeys.contains(GLFW_KEY_V)) {
+            pressedKeys.erase(GLFW_KEY_V);
+            RendererSettings newSettings = settings;
+            switch (settings.presentMode) {
+                case vk::PresentModeKHR::eFifo:
+                    newSettings.presentMode = vk::PresentModeKHR::eMailbox;
+                    break;
+                case vk::PresentModeKHR::eMailbox:
+                    newSettings = RendererSettings::uncapped();
+                    break;
+                default:
+                    newSettings.presentMode = vk::PresentModeKHR::eFifo;
+                    newSettings.frameCap = MAX_FRAMERATE;
+                    break;
+            }
+            applySettings(newSettings);
+        }
     }
 
     void Renderer::recreateSwapChain() {
@@ -1574,29 +2660,514 @@ namespace volchara {
             glfwWaitEvents();
         }
 
-        device.waitIdle();
+        // frames in flight keep rendering to the old generation, it's released once every frame submitted so far has completed
+        auto retired = std::make_shared<RetiredSwapChain>();
+        retired->swapChain = std::move(swapChain);
+        retired->imageViews = std::move(swapChainImageViews);
+        retired->framebuffers = std::move(swapChainFramebuffers);
+        for (std::vector<RAIIvmaImage>* images : {&depthBuffers, &emissiveBuffers, &normalBuffers, &intermediateColorBuffers, &accumulationBuffers, &revealageBuffers, &sceneColorBuffers}) {
+            std::move(images->begin(), images->end(), std::back_inserter(retired->attachments));
+            images->clear();
+        }
+        retired->descriptorPool = std::move(attachmentDescriptorPool);
+        for (std::vector<vk::raii::DescriptorSet>* sets : {&descriptorSetsLightSubpass, &descriptorSetsResolveSubpass}) {
+            std::move(sets->begin(), sets->end(), std::back_inserter(retired->descriptorSets));
+            sets->clear();
+        }
+        deferUntilFrameComplete([retired]() {});
 
-        createSwapChain();
+        createSwapChain(*retired->swapChain);
         createImageViews();
         createDepthResources();
+        createEmissiveResources();
+        createNormalResources();
+        createIntermediateColorResources();
+        createTransparencyResources();
+        createSceneColorResources();
         createFramebuffers();
+        createAttachmentDescriptorSets();
+    }
+
+    void Renderer::updateRenderScale() {
+        if (!sceneColorBuffers.empty() && stats.gpuFrameMs > 0) {
+            // the pass cost grows with the pixel count, the square of the scale
+            float budgetScale = renderScale * std::sqrt(settings.gpuFrameBudgetMs / stats.gpuFrameMs);
+            renderScale = std::clamp(renderScale + (budgetScale - renderScale) * RENDER_SCALE_RESPONSE, MIN_RENDER_SCALE, 1.0f);
+        }
+        renderExtent = vk::Extent2D{
+            std::max(1u, static_cast<uint32_t>(swapChainExtent.width * renderScale)),
+            std::max(1u, static_cast<uint32_t>(swapChainExtent.height * renderScale)),
+        };
+        stats.renderScale = renderScale;
+    }
+
+    std::vector<InstancedDraw> Renderer::collectDraws(bool transparent, uint32_t firstDraw) {
+        using InstanceKey = std::tuple<Mesh*, uint32_t, uint32_t, uint32_t, float>;
+        const std::vector<Mesh*>& meshes = scene.meshList();
+        const std::vector<SceneMaterial>& materials = scene.materials();
+        const std::vector<uint8_t>& transparentFlags = scene.transparent();
+        std::vector<std::vector<uint32_t>> groups;
+        std::map<InstanceKey, size_t> groupIds;
+        for (uint32_t i = 0; i < scene.size(); i++) {
+            if (static_cast<bool>(transparentFlags[i]) != transparent || meshes[i] == nullptr) {
+                continue;
+            }
+            InstanceKey key{meshes[i], materials[i].textureIndex, materials[i].normalIndex, materials[i].emissiveIndex, materials[i].alphaCutoff};
+            if (!debugFeatures.instancing || !groupIds.contains(key)) {
+                groupIds[key] = groups.size();
+                groups.push_back({});
+            }
+            groups[groupIds[key]].push_back(i);
+        }
+        std::vector<InstancedDraw> draws;
+        for (std::vector<uint32_t>& group : groups) {
+            const Mesh* mesh = meshes[group[0]];
+            uint32_t drawIndex = firstDraw + draws.size();
+            glm::vec4 lodErrors{0};
+            for (uint32_t lod = 0; lod < mesh->lodCount(); lod++) {
+                MeshLod range = mesh->lod(lod);
+                GeometryRange geometry = mesh->geometry.value();
+                geometry.firstIndex += range.firstIndex;
+                geometry.indexCount = range.indexCount;
+                lodErrors[lod] = range.error;
+                draws.push_back({
+                    .geometry = geometry,
+                    .firstInstance = static_cast<uint32_t>(batchedInstances.size()),
+                    .instanceCount = static_cast<uint32_t>(group.size()),
+                    .lod = lod,
+                });
+            }
+            for (uint32_t entry : group) {
+                batchedEntries.push_back(entry);
+                batchedInstances.push_back({
+                    .bounds = meshes[entry]->bounds,
+                    .lodErrors = lodErrors,
+                    .textureIndex = resolveTexture(materials[entry].textureIndex),
+                    .normalIndex = resolveTexture(materials[entry].normalIndex),
+                    .emissiveIndex = resolveTexture(materials[entry].emissiveIndex),
+                    .alphaCutoff = materials[entry].alphaCutoff,
+                    .drawIndex = drawIndex,
+                    .lodCount = mesh->lodCount(),
+                });
+            }
+        }
+        return draws;
+    }
+
+    void Renderer::rebuildBatches() {
+        ZoneScoped;
+        batchedEntries.clear();
+        batchedInstances.clear();
+        opaqueDraws = collectDraws(false, 0);
+        transparentDraws = collectDraws(true, opaqueDraws.size());
+        // the cull pass counts visible instances up from zero, every LOD has its own copy of the instance slots
+        drawCommands.clear();
+        for (const std::vector<InstancedDraw>* draws : {&opaqueDraws, &transparentDraws}) {
+            for (const InstancedDraw& draw : *draws) {
+                drawCommands.push_back({
+                    .indexCount = draw.geometry.indexCount,
+                    .instanceCount = 0,
+                    .firstIndex = draw.geometry.firstIndex,
+                    .vertexOffset = static_cast<int32_t>(draw.geometry.firstVertex),
+                    .firstInstance = draw.firstInstance + draw.lod * static_cast<uint32_t>(batchedInstances.size()),
+                });
+            }
+        }
+        batchedSceneVersion = scene.version();
+        batchedTextureVersion = textureResidencyVersion;
+        batchedInstancing = debugFeatures.instancing;
+    }
+
+    void Renderer::syncScene() {
+        if (scene.needsRebuild()) {
+            scene.rebuild(objects);
+        }
+        scene.updateTransforms();
+    }
+
+    std::vector<Object*> Renderer::queryRadius(glm::vec3 center, float radius) {
+        syncScene();
+        return scene.queryRadius(center, radius);
+    }
+
+    std::vector<Object*> Renderer::queryBox(glm::vec3 min, glm::vec3 max) {
+        syncScene();
+        return scene.queryBox({.min = min, .max = max});
+    }
+
+    std::optional<std::pair<Object*, float>> Renderer::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+        syncScene();
+        return scene.raycast(origin, direction, maxDistance);
+    }
+
+    void Renderer::updateBatches() {
+        ZoneScoped;
+        syncScene();
+        if (scene.version() != batchedSceneVersion || textureResidencyVersion != batchedTextureVersion || debugFeatures.instancing != batchedInstancing) {
+            rebuildBatches();
+        }
+        const std::vector<glm::mat4>& worlds = scene.worlds();
+        const std::vector<glm::mat3x4>& normals = scene.normals();
+        if (ticksInterpolatable()) {
+            const std::vector<glm::mat4>& previous = tickWorlds[currentTick ^ 1];
+            float blend = tickBlend();
+            // normals use the latest tick's matrix, the rotation within one tick is too small to show
+            for (uint32_t i = 0; i < batchedEntries.size(); i++) {
+                batchedInstances[i].model = interpolateMatrix(previous[batchedEntries[i]], worlds[batchedEntries[i]], blend);
+                batchedInstances[i].normalMatrix = normals[batchedEntries[i]];
+            }
+        } else {
+            for (uint32_t i = 0; i < batchedEntries.size(); i++) {
+                batchedInstances[i].model = worlds[batchedEntries[i]];
+                batchedInstances[i].normalMatrix = normals[batchedEntries[i]];
+            }
+        }
+    }
+
+    void Renderer::startSimulation() {
+        simulationRunning = true;
+        lastTickTime = std::chrono::steady_clock::now();
+        simulationThread = std::thread(&Renderer::simulationLoop, this);
+    }
+
+    void Renderer::stopSimulation() {
+        simulationRunning = false;
+        if (simulationThread.joinable()) {
+            simulationThread.join();
+        }
+    }
+
+    void Renderer::simulationLoop() {
+        tracy::SetThreadName("simulation");
+        const float tickSeconds = 1.0f / SIMULATION_TICK_RATE;
+        const std::chrono::steady_clock::duration tickInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(tickSeconds));
+        std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
+        while (simulationRunning) {
+            std::this_thread::sleep_until(nextTick);
+            {
+                std::lock_guard<std::mutex> lock(simulationMutex);
+                runSimulationTick(tickSeconds);
+            }
+            nextTick += tickInterval;
+            // after a long stall the missed ticks are dropped instead of being run back to back
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now - nextTick > tickInterval * MAX_SIMULATION_CATCHUP_TICKS) {
+                nextTick = now;
+            }
+        }
+    }
+
+    void Renderer::runSimulationTick(float tickSeconds) {
+        ZoneScoped;
+        // every callback of the tick reads the same snapshot of the input
+        FrameCallbackData cbData{
+            .passedSeconds = tickSeconds,
+            .pressedKeys = simulationKeys,
+            .cursorOffset = simulationCursorOffset,
+        };
+        //for (fw::Object* obj : objects) {  // breaks 'cause reallocation
+        for (int i = 0; i < objects.size(); i++) {
+            objects[i]->runFrameCallbacks(cbData);
+        }
+        simulationCursorOffset = {0, 0};
+        syncScene();
+        currentTick ^= 1;
+        tickWorlds[currentTick] = scene.worlds();
+        tickCameras[currentTick] = camera.transform.modelMatrix();
+        tickLayouts[currentTick] = scene.layoutGeneration();
+        lastTickTime = std::chrono::steady_clock::now();
+    }
+
+    bool Renderer::ticksInterpolatable() const {
+        // objects were added, removed or reparented between the ticks, their entries don't match
+        return simulationRunning && tickLayouts[0] == tickLayouts[1] && tickLayouts[currentTick] == scene.layoutGeneration() && tickWorlds[0].size() == scene.size() && tickWorlds[1].size() == scene.size();
+    }
+
+    float Renderer::tickBlend() const {
+        std::chrono::duration<float> sinceTick = std::chrono::steady_clock::now() - lastTickTime;
+        return std::clamp(sinceTick.count() * SIMULATION_TICK_RATE, 0.0f, 1.0f);
+    }
+
+    glm::mat4 Renderer::interpolateMatrix(const glm::mat4& from, const glm::mat4& to, float blend) {
+        // most objects don't move between ticks
+        if (from == to) return to;
+        // blended as translation, rotation and scale, a lerped rotation matrix would shrink and shear on turns
+        auto decompose = [](const glm::mat4& matrix, glm::vec3& scale) {
+            glm::mat3 basis(matrix);
+            scale = glm::vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+            // a mirrored basis keeps its handedness in the scale, the rest is a proper rotation
+            if (glm::determinant(basis) < 0) scale.x = -scale.x;
+            for (int axis = 0; axis < 3; axis++) {
+                if (scale[axis] != 0) basis[axis] /= scale[axis];
+            }
+            return glm::quat_cast(basis);
+        };
+        glm::vec3 fromScale, toScale;
+        glm::quat fromRotation = decompose(from, fromScale);
+        glm::quat toRotation = decompose(to, toScale);
+        glm::mat4 blended = glm::mat4_cast(glm::slerp(fromRotation, toRotation, blend));
+        glm::vec3 scale = glm::mix(fromScale, toScale, blend);
+        for (int axis = 0; axis < 3; axis++) {
+            blended[axis] *= scale[axis];
+        }
+        blended[3] = glm::mix(from[3], to[3], blend);
+        return blended;
+    }
+
+    void Renderer::recordCulling(uint32_t bufferIndex, uint32_t instanceCount, bool indirect) {
+        if (instanceCount == 0) {
+            return;
+        }
+        // without indirect draws the pass only fills the visible instances list of the first LODs, CPU draw counts must match it
+        CullPushConstants cullConstants{
+            .instanceCount = instanceCount,
+            .frustumCulling = indirect ? 1u : 0u,
+        };
+        if (indirect && debugFeatures.lods) {
+            // a LOD is picked while its error covers less than LOD_PIXEL_ERROR pixels of the screen height
+            cullConstants.lodScale = projection()[1][1] * renderExtent.height / 2 / LOD_PIXEL_ERROR;
+        }
+        commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, {*descriptorSetsUBO[bufferIndex], *descriptorSetsInstances[bufferIndex]}, nullptr);
+        commandBuffers[bufferIndex].pushConstants<CullPushConstants>(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, {cullConstants});
+        commandBuffers[bufferIndex].dispatch((instanceCount + 63) / 64, 1, 1);
+    }
+
+    void Renderer::recordLightCulling(uint32_t bufferIndex) {
+        // one invocation per cluster, the lighting shaders only loop over the lights binned into theirs
+        commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eCompute, lightCullPipeline);
+        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eCompute, lightCullPipelineLayout, 0, {*descriptorSetsUBO[bufferIndex], *descriptorSetsSSBO[bufferIndex]}, nullptr);
+        commandBuffers[bufferIndex].dispatch((LIGHT_CLUSTER_COUNT + 63) / 64, 1, 1);
+    }
+
+    void Renderer::recordDraws(vk::raii::CommandBuffer& commandBuffer, uint32_t bufferIndex, const InstancedDraw* draws, uint32_t drawCount, uint32_t firstDraw, uint32_t countIndex, bool indirect) {
+        if (drawCount == 0) {
+            return;
+        }
+        if (!indirect) {
+            for (uint32_t i = 0; i < drawCount; i++) {
+                // coarser LODs are only picked by the cull pass
+                if (draws[i].lod > 0 || (!visibleDraws.empty() && !visibleDraws[firstDraw + i])) continue;
+                commandBuffer.drawIndexed(draws[i].geometry.indexCount, draws[i].instanceCount, draws[i].geometry.firstIndex, draws[i].geometry.firstVertex, draws[i].firstInstance);
+            }
+            return;
+        }
+        uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+        vk::DeviceSize offset = INDIRECT_COMMANDS_OFFSET + firstDraw * stride;
+        if (supportsDrawIndirectCount) {
+            // culled draws stay in the list with zero instances, the count is written by the CPU
+            commandBuffer.drawIndexedIndirectCountKHR(indirectBuffers[bufferIndex], offset, indirectBuffers[bufferIndex], countIndex * sizeof(uint32_t), drawCount, stride);
+        } else if (supportsMultiDrawIndirect) {
+            commandBuffer.drawIndexedIndirect(indirectBuffers[bufferIndex], offset, drawCount, stride);
+        } else {
+            for (uint32_t i = 0; i < drawCount; i++) {
+                commandBuffer.drawIndexedIndirect(indirectBuffers[bufferIndex], offset + i * stride, 1, stride);
+            }
+        }
+    }
+
+    void Renderer::splitRecordingTasks(uint32_t subpass, uint32_t drawCount, bool splittable) {
+        if (drawCount == 0) {
+            return;
+        }
+        uint32_t taskCount = 1;
+        if (splittable) {
+            taskCount = std::clamp(drawCount / MIN_DRAWS_PER_RECORDING_TASK, 1u, recordingJobs->threadCount());
+        }
+        uint32_t drawsPerTask = (drawCount + taskCount - 1) / taskCount;
+        for (uint32_t first = 0; first < drawCount; first += drawsPerTask) {
+            recordingTasks.push_back({
+                .subpass = subpass,
+                .firstDraw = first,
+                .drawCount = std::min(drawsPerTask, drawCount - first),
+            });
+        }
+    }
+
+    vk::CommandBuffer Renderer::recordSubpassDraws(const RecordingTask& task, uint32_t slot, uint32_t imageIndex, uint32_t bufferIndex, bool indirect) {
+        ZoneScoped;
+        RecordingPool& recordingPool = recordingPools[bufferIndex * recordingJobs->threadCount() + slot];
+        if (recordingPool.usedBuffers == recordingPool.buffers.size()) {
+            vk::CommandBufferAllocateInfo allocInfo{
+                .commandPool = recordingPool.pool,
+                .level = vk::CommandBufferLevel::eSecondary,
+                .commandBufferCount = 1,
+            };
+            std::vector<vk::raii::CommandBuffer> allocated = device.allocateCommandBuffers(allocInfo);
+            recordingPool.buffers.push_back(std::move(allocated[0]));
+        }
+        vk::raii::CommandBuffer& commandBuffer = recordingPool.buffers[recordingPool.usedBuffers++];
+
+        bool transparent = task.subpass == 2;
+        vk::PipelineLayout pipelineLayout = transparent ? *transparencyPipelineLayout : *colorPipelineLayout;
+        const std::vector<InstancedDraw>& draws = transparent ? transparentDraws : opaqueDraws;
+        uint32_t firstDraw = (transparent ? opaqueDraws.size() : 0) + task.firstDraw;
+
+        vk::CommandBufferInheritanceInfo inheritanceInfo{
+            .renderPass = renderPass,
+            .subpass = task.subpass,
+            .framebuffer = swapChainFramebuffers[imageIndex],
+        };
+        vk::CommandBufferBeginInfo beginInfo{
+            .flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+            .pInheritanceInfo = &inheritanceInfo,
+        };
+        commandBuffer.begin(beginInfo);
+        // secondary buffers inherit no state from the primary one
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, transparent ? *transparencyGraphicsPipeline : *colorGraphicsPipeline);
+        commandBuffer.bindVertexBuffers(0, {geometryPool.vertices()}, {0});
+        commandBuffer.bindIndexBuffer(geometryPool.indices(), 0, vk::IndexType::eUint32);
+        vk::Viewport viewport{
+            .x = 0,
+            .y = static_cast<float>(renderExtent.height),
+            .width = static_cast<float>(renderExtent.width),
+            .height = -static_cast<float>(renderExtent.height),
+            .maxDepth = 1,
+        };
+        commandBuffer.setViewport(0, viewport);
+        vk::Rect2D scissor{
+            .extent = renderExtent,
+        };
+        commandBuffer.setScissor(0, scissor);
+        commandBuffer.setPolygonModeEXT(debugFeatures.viewMode == DebugViewMode::WIREFRAME ? vk::PolygonMode::eLine : vk::PolygonMode::eFill);
+        commandBuffer.setCullMode(debugFeatures.culling ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, {*descriptorSetsUBO[bufferIndex], *descriptorSetsTextures[0], *descriptorSetsSSBO[bufferIndex], *descriptorSetsInstances[bufferIndex]}, nullptr);
+        commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, {pushConstants});
+        recordDraws(commandBuffer, bufferIndex, draws.data() + task.firstDraw, task.drawCount, firstDraw, transparent ? 1 : 0, indirect);
+        commandBuffer.end();
+        return *commandBuffer;
     }
 
     void Renderer::recordCommandBuffer(uint32_t imageIndex, uint32_t bufferIndex) {
+        ZoneScoped;
+        updateBatches();
+        if (batchedInstances.size() > instanceBufferCapacities[bufferIndex]) {
+            growInstanceBuffer(bufferIndex, batchedInstances.size());
+        }
+        std::array<uint32_t, 4> drawCounts{static_cast<uint32_t>(opaqueDraws.size()), static_cast<uint32_t>(transparentDraws.size()), 0, 0};
+        indirectBuffers[bufferIndex].copyFrom(drawCounts.data(), sizeof(drawCounts));
+        // the light subpass adds its fullscreen triangle
+        stats.drawCount = opaqueDraws.size() + transparentDraws.size() + 1;
+        stats.triangleCount = 1;
+        for (const std::vector<InstancedDraw>* draws : {&opaqueDraws, &transparentDraws}) {
+            for (const InstancedDraw& draw : *draws) {
+                // at full detail, the cull pass may swap distant instances for coarser LODs
+                if (draw.lod > 0) continue;
+                stats.triangleCount += static_cast<uint64_t>(draw.geometry.indexCount / 3) * draw.instanceCount;
+            }
+        }
+        stats.deviceMemory = allocator.deviceLocalBudget();
+        if (!batchedInstances.empty()) {
+            instanceBuffers[bufferIndex].copyFrom(batchedInstances.data(), batchedInstances.size() * sizeof(GPUInstance));
+            indirectBuffers[bufferIndex].copyFrom(drawCommands.data(), drawCommands.size() * sizeof(vk::DrawIndexedIndirectCommand), INDIRECT_COMMANDS_OFFSET);
+        }
+        // indirect draws need firstInstance to locate their slice of the visible instances
+        bool indirect = debugFeatures.gpuCulling && supportsDrawIndirectFirstInstance;
+        visibleDraws.clear();
+        if (!indirect && debugFeatures.gpuCulling) {
+            markVisibleDraws();
+        }
+
+        // the frame's fence is signaled, its secondary buffers can be reused
+        for (uint32_t slot = 0; slot < recordingJobs->threadCount(); slot++) {
+            RecordingPool& recordingPool = recordingPools[bufferIndex * recordingJobs->threadCount() + slot];
+            recordingPool.pool.reset();
+            recordingPool.usedBuffers = 0;
+        }
+        // a single indirect call can't be split between buffers
+        bool splittable = !indirect || (!supportsDrawIndirectCount && !supportsMultiDrawIndirect);
+        recordingTasks.clear();
+        splitRecordingTasks(0, opaqueDraws.size(), splittable);
+        uint32_t opaqueTasks = recordingTasks.size();
+        splitRecordingTasks(2, transparentDraws.size(), splittable);
+        recordedBuffers.resize(recordingTasks.size());
+        recordingJobs->run(recordingTasks.size(), [&](uint32_t task, uint32_t slot) {
+            recordedBuffers[task] = recordSubpassDraws(recordingTasks[task], slot, imageIndex, bufferIndex, indirect);
+        });
+
         commandBuffers[bufferIndex].reset();
 
         vk::CommandBufferBeginInfo beginInfo{};
 
         commandBuffers[bufferIndex].begin(beginInfo);
+        TracyVkCollect(tracyContext, *commandBuffers[bufferIndex]);
+        if (supportsTimestamps) {
+            commandBuffers[bufferIndex].resetQueryPool(timestampQueryPool, bufferIndex * FRAME_TIMESTAMP_COUNT, FRAME_TIMESTAMP_COUNT);
+        }
+        writeFrameTimestamp(bufferIndex, FRAME_BEGIN);
+
+        frameGraph.reset();
+        FrameGraphResource drawBuffers = frameGraph.importBuffer();
+        FrameGraphResource lightClusters = frameGraph.importBuffer();
+        // the image semaphore is waited on at color attachment output, the render pass chains to it on its own, the upscale blit through the graph
+        vk::PipelineStageFlags finalColorReady = sceneColorBuffers.empty() ? vk::PipelineStageFlags{} : vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        FrameGraphResource finalColor = frameGraph.importImage(swapChainImages[imageIndex], vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, finalColorReady);
+        // offscreen frames are left ready to be copied out
+        vk::ImageLayout finalLayout = settings.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+        frameGraph.markOutput(finalColor, finalLayout);
+
+        // the levels are transitioned inside, the last barrier hands them to the fragment shaders
+        frameGraph.addPass([&]() {
+            TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "mipmaps");
+            recordMipmapGeneration(bufferIndex);
+        }, true);
+        if (!batchedInstances.empty()) {
+            FrameGraphPass cullPass = frameGraph.addPass([&]() {
+                TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "culling");
+                recordCulling(bufferIndex, batchedInstances.size(), indirect);
+            });
+            frameGraph.write(cullPass, drawBuffers, {.stages = vk::PipelineStageFlagBits::eComputeShader, .access = vk::AccessFlagBits::eShaderWrite});
+        }
+        FrameGraphPass lightCullPass = frameGraph.addPass([&]() {
+            TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "light culling");
+            recordLightCulling(bufferIndex);
+        });
+        frameGraph.write(lightCullPass, lightClusters, {.stages = vk::PipelineStageFlagBits::eComputeShader, .access = vk::AccessFlagBits::eShaderWrite});
+
+        FrameGraphPass scenePass = frameGraph.addPass([&]() {
+            recordScenePass(imageIndex, bufferIndex, opaqueTasks);
+        });
+        frameGraph.read(scenePass, drawBuffers, {.stages = vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader, .access = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead});
+        // the debug views show the G-buffer unlit, the light binning only runs for the lighting shaders
+        if (debugFeatures.viewMode == DebugViewMode::OFF) {
+            frameGraph.read(scenePass, lightClusters, {.stages = vk::PipelineStageFlagBits::eFragmentShader, .access = vk::AccessFlagBits::eShaderRead});
+        }
+        // the render pass starts its attachments undefined and transitions them itself
+        if (sceneColorBuffers.empty()) {
+            frameGraph.write(scenePass, finalColor, {.stages = vk::PipelineStageFlagBits::eColorAttachmentOutput, .access = vk::AccessFlagBits::eColorAttachmentWrite, .finalLayout = finalLayout});
+        } else {
+            FrameGraphResource sceneColor = frameGraph.importImage(sceneColorBuffers[imageIndex], vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined);
+            frameGraph.write(scenePass, sceneColor, {.stages = vk::PipelineStageFlagBits::eColorAttachmentOutput, .access = vk::AccessFlagBits::eColorAttachmentWrite, .finalLayout = vk::ImageLayout::eColorAttachmentOptimal});
+            FrameGraphPass upscalePass = frameGraph.addPass([&]() {
+                TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "upscale");
+                recordUpscale(imageIndex, bufferIndex);
+            });
+            frameGraph.read(upscalePass, sceneColor, {.stages = vk::PipelineStageFlagBits::eTransfer, .access = vk::AccessFlagBits::eTransferRead, .layout = vk::ImageLayout::eTransferSrcOptimal});
+            frameGraph.write(upscalePass, finalColor, {.stages = vk::PipelineStageFlagBits::eTransfer, .access = vk::AccessFlagBits::eTransferWrite, .layout = vk::ImageLayout::eTransferDstOptimal});
+        }
+        frameGraph.execute(commandBuffers[bufferIndex]);
+        stats.culledPassCount = frameGraph.culledPassCount();
+
+        commandBuffers[bufferIndex].end();
+    }
+
+    void Renderer::recordScenePass(uint32_t imageIndex, uint32_t bufferIndex, uint32_t opaqueTasks) {
+        // written after the graph's barriers, the culling span includes waiting for the compute passes
+        writeFrameTimestamp(bufferIndex, CULLING_END);
 
         vk::Rect2D renderArea{
-            .extent = swapChainExtent,
+            .extent = renderExtent,
         };
         vk::ClearValue clearValueColor({0.0f, 0.0f, 0.0f, 1.0f});
         vk::ClearValue clearValueEmissive({0.0f, 0.0f, 0.0f, 1.0f});
-        vk::ClearValue clearValueNormal({0.0f, 0.0f, 0.0f, 1.0f});
+        // packed normals clear to the zero normal sentinel, (0, 0) would decode to +z
+        float clearNormal = settings.gBufferFormat == GBufferFormat::ePacked ? 2.0f : 0.0f;
+        vk::ClearValue clearValueNormal({clearNormal, clearNormal, 0.0f, 1.0f});
         vk::ClearValue clearValueDepth({0.0f, 0});
-        std::vector<vk::ClearValue> clearValues{clearValueColor, clearValueEmissive, clearValueNormal, clearValueDepth, clearValueColor};
+        vk::ClearValue clearValueAccumulation({0.0f, 0.0f, 0.0f, 0.0f});
+        // nothing covers the pixel yet, the background is fully revealed
+        vk::ClearValue clearValueRevealage({1.0f, 0.0f, 0.0f, 0.0f});
+        std::vector<vk::ClearValue> clearValues{clearValueColor, clearValueEmissive, clearValueNormal, clearValueDepth, clearValueColor, clearValueAccumulation, clearValueRevealage};
         vk::RenderPassBeginInfo renderPassInfo{
             .renderPass = renderPass,
             .framebuffer = swapChainFramebuffers[imageIndex],
@@ -1605,143 +3176,160 @@ namespace volchara {
             .pClearValues = clearValues.data(),
         };
 
-        commandBuffers[bufferIndex].beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-        commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eGraphics, colorGraphicsPipeline);
-        commandBuffers[bufferIndex].bindVertexBuffers(
-            0,
-            {vertexBuffer},
-            {0}
-        );
+        // timestamps can't be written inside the subpasses that execute secondary buffers, zones close in the inline light subpass
+        {
+            TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "color subpass");
+            commandBuffers[bufferIndex].beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+            if (opaqueTasks > 0) {
+                commandBuffers[bufferIndex].executeCommands(vk::ArrayProxy<const vk::CommandBuffer>(opaqueTasks, recordedBuffers.data()));
+            }
+            commandBuffers[bufferIndex].nextSubpass(vk::SubpassContents::eInline);
+        }
+        writeFrameTimestamp(bufferIndex, COLOR_END);
+
+        {
+            TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "light subpass");
+            commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eGraphics, lightGraphicsPipeline);
+            recordFullscreenState(commandBuffers[bufferIndex]);
+            commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightPipelineLayout, 0, *descriptorSetsLightSubpass[imageIndex], nullptr);
+            commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightPipelineLayout, 1, *descriptorSetsUBO[bufferIndex], nullptr);
+            commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightPipelineLayout, 2, *descriptorSetsSSBO[bufferIndex], nullptr);
+            commandBuffers[bufferIndex].pushConstants<PushConstants>(lightPipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, {pushConstants});
+            commandBuffers[bufferIndex].draw(3, 1, 0, 0);
+        }
+        writeFrameTimestamp(bufferIndex, LIGHT_END);
+
+        {
+            TracyVkZone(tracyContext, *commandBuffers[bufferIndex], "transparency subpass");
+            commandBuffers[bufferIndex].nextSubpass(vk::SubpassContents::eSecondaryCommandBuffers);
+            if (recordedBuffers.size() > opaqueTasks) {
+                commandBuffers[bufferIndex].executeCommands(vk::ArrayProxy<const vk::CommandBuffer>(recordedBuffers.size() - opaqueTasks, recordedBuffers.data() + opaqueTasks));
+            }
+            // weighted average of the transparent layers over the lit image, counted into the transparency span
+            commandBuffers[bufferIndex].nextSubpass(vk::SubpassContents::eInline);
+            commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eGraphics, resolveGraphicsPipeline);
+            recordFullscreenState(commandBuffers[bufferIndex]);
+            commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, resolvePipelineLayout, 0, *descriptorSetsResolveSubpass[imageIndex], nullptr);
+            commandBuffers[bufferIndex].draw(3, 1, 0, 0);
+            commandBuffers[bufferIndex].endRenderPass();
+        }
+        writeFrameTimestamp(bufferIndex, TRANSPARENCY_END);
+        timestampsWritten[bufferIndex] = true;
+    }
+
+    void Renderer::recordFullscreenState(vk::raii::CommandBuffer& commandBuffer) {
+        // nothing carries over from the secondary buffers of the previous subpass
         vk::Viewport viewport{
             .x = 0,
-            .y = static_cast<float>(swapChainExtent.height),
-            .width = static_cast<float>(swapChainExtent.width),
-            .height = -static_cast<float>(swapChainExtent.height),
+            .y = static_cast<float>(renderExtent.height),
+            .width = static_cast<float>(renderExtent.width),
+            .height = -static_cast<float>(renderExtent.height),
             .maxDepth = 1,
         };
-        commandBuffers[bufferIndex].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint32);
-        commandBuffers[bufferIndex].setViewport(0, viewport);
+        commandBuffer.setViewport(0, viewport);
         vk::Rect2D scissor{
-            .extent = swapChainExtent,
-        };
-        commandBuffers[bufferIndex].setScissor(0, scissor);
-        commandBuffers[bufferIndex].setPolygonModeEXT(debugFeatures.viewMode == DebugViewMode::WIREFRAME ? vk::PolygonMode::eLine : vk::PolygonMode::eFill);
-        commandBuffers[bufferIndex].setCullMode(debugFeatures.culling ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, colorPipelineLayout, 0, *descriptorSetsUBO[bufferIndex], nullptr);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, colorPipelineLayout, 1, *descriptorSetsTextures[0], nullptr);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, colorPipelineLayout, 2, *descriptorSetsSSBO[0], nullptr);
-        uint32_t alreadyDrawn = 0;
-        std::vector<Object*> allObjects = objects;
-        for (int i = 0; i < allObjects.size(); i++) {
-            if (allObjects[i]->children.size() > 0) {
-                for (Object* child : allObjects[i]->children) {
-                    allObjects.push_back(child);
-                }
-            }
+            .extent = renderExtent,
+        };
+        commandBuffer.setScissor(0, scissor);
+        commandBuffer.setPolygonModeEXT(vk::PolygonMode::eFill);
+        commandBuffer.setCullMode(vk::CullModeFlagBits::eNone);
+    }
+
+    void Renderer::recordUpscale(uint32_t imageIndex, uint32_t bufferIndex) {
+        vk::ImageBlit blit{
+            .srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1},
+            .srcOffsets = std::array<vk::Offset3D, 2>{vk::Offset3D{0, 0, 0}, vk::Offset3D{static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1}},
+            .dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1},
+            .dstOffsets = std::array<vk::Offset3D, 2>{vk::Offset3D{0, 0, 0}, vk::Offset3D{static_cast<int32_t>(swapChainExtent.width), static_cast<int32_t>(swapChainExtent.height), 1}},
+        };
+        commandBuffers[bufferIndex].blitImage(sceneColorBuffers[imageIndex], vk::ImageLayout::eTransferSrcOptimal, swapChainImages[imageIndex], vk::ImageLayout::eTransferDstOptimal, blit, upscaleFilter);
+    }
+
+    void Renderer::markVisibleDraws() {
+        ZoneScoped;
+        // the frustum planes of cull.comp, the entries' bounds may be up to a tick ahead of the drawn matrices
+        glm::mat4 rows = glm::transpose(projection() * glm::inverse(frameCamera()));
+        std::array<glm::vec4, 5> planes{rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] - rows[2]};
+        visibleEntries.clear();
+        scene.queryFrustum(planes, visibleEntries);
+        std::vector<uint8_t> entryVisible(scene.size(), 0);
+        for (uint32_t entry : visibleEntries) {
+            entryVisible[entry] = 1;
         }
-        for (int i = 0; i < allObjects.size(); i++) {
-            if (allObjects[i]->transparent) {
-                alreadyDrawn += allObjects[i]->indices.size();
-                continue;
-            }
-            pushConstants.model = allObjects[i]->transform.modelMatrix();
-            pushConstants.textureIndex = allObjects[i]->textureIndex;
-            pushConstants.normalIndex = allObjects[i]->normalIndex;
-            pushConstants.emissiveIndex = allObjects[i]->emissiveIndex;
-            pushConstants.alphaCutoff = allObjects[i]->alphaCutoff;
-            commandBuffers[bufferIndex].pushConstants<PushConstants>(colorPipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, {pushConstants});
-            commandBuffers[bufferIndex].drawIndexed(allObjects[i]->indices.size(), 1, alreadyDrawn, 0, 0);
-            alreadyDrawn += allObjects[i]->indices.size();
-        }
-
-        commandBuffers[bufferIndex].nextSubpass(vk::SubpassContents::eInline);
-        commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eGraphics, lightGraphicsPipeline);
-        commandBuffers[bufferIndex].setPolygonModeEXT(vk::PolygonMode::eFill);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightPipelineLayout, 0, *descriptorSetsLightSubpass[imageIndex], nullptr);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightPipelineLayout, 1, *descriptorSetsUBO[bufferIndex], nullptr);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, lightPipelineLayout, 2, *descriptorSetsSSBO[0], nullptr);
-        commandBuffers[bufferIndex].pushConstants<PushConstants>(lightPipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, {pushConstants});
-        commandBuffers[bufferIndex].draw(3, 1, 0, 0);
-
-        commandBuffers[bufferIndex].nextSubpass(vk::SubpassContents::eInline);
-        commandBuffers[bufferIndex].bindPipeline(vk::PipelineBindPoint::eGraphics, transparencyGraphicsPipeline);
-        commandBuffers[bufferIndex].setPolygonModeEXT(debugFeatures.viewMode == DebugViewMode::WIREFRAME ? vk::PolygonMode::eLine : vk::PolygonMode::eFill);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, transparencyPipelineLayout, 0, *descriptorSetsUBO[bufferIndex], nullptr);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, transparencyPipelineLayout, 1, *descriptorSetsTextures[0], nullptr);
-        commandBuffers[bufferIndex].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, transparencyPipelineLayout, 2, *descriptorSetsSSBO[0], nullptr);
-        alreadyDrawn = 0;
-        for (int i = 0; i < allObjects.size(); i++) {
-            if (!allObjects[i]->transparent) {
-                alreadyDrawn += allObjects[i]->indices.size();
-                continue;
+        visibleDraws.assign(opaqueDraws.size() + transparentDraws.size(), 0);
+        for (uint32_t i = 0; i < batchedEntries.size(); i++) {
+            if (entryVisible[batchedEntries[i]]) {
+                visibleDraws[batchedInstances[i].drawIndex] = 1;
             }
-            pushConstants.model = allObjects[i]->transform.modelMatrix();
-            pushConstants.textureIndex = allObjects[i]->textureIndex;
-            pushConstants.normalIndex = allObjects[i]->normalIndex;
-            pushConstants.emissiveIndex = allObjects[i]->emissiveIndex;
-            pushConstants.alphaCutoff = allObjects[i]->alphaCutoff;
-            commandBuffers[bufferIndex].pushConstants<PushConstants>(transparencyPipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, {pushConstants});
-            commandBuffers[bufferIndex].drawIndexed(allObjects[i]->indices.size(), 1, alreadyDrawn, 0, 0);
-            alreadyDrawn += allObjects[i]->indices.size();
         }
+    }
 
-        commandBuffers[bufferIndex].endRenderPass();
-
-        commandBuffers[bufferIndex].end();
+    glm::mat4 Renderer::frameCamera() {
+        if (ticksInterpolatable()) {
+            return interpolateMatrix(tickCameras[currentTick ^ 1], tickCameras[currentTick], tickBlend());
+        }
+        return camera.transform.modelMatrix();
     }
 
-    void Renderer::updateUniformBuffer(uint32_t imageIndex) {
-        UniformBufferObject ubo{};
-        ubo.view = glm::inverse(camera.transform.modelMatrix());
+    glm::mat4 Renderer::projection() const {
         float const fovMult = 1.0f / tan(glm::radians(45.0f) / 2.0f);
         float const aspect = swapChainExtent.width / (float)swapChainExtent.height;
-        ubo.proj = glm::mat4(
+        return glm::mat4(
             fovMult / aspect,    0.0f,  0.0f,  0.0f,
                         0.0f, fovMult,  0.0f,  0.0f,
                         0.0f,    0.0f,  0.0f, -1.0f,
                         0.0f,    0.0f, 0.01f,  0.0f
         );
+    }
+
+    void Renderer::updateUniformBuffer(uint32_t imageIndex) {
+        ZoneScoped;
+        UniformBufferObject ubo{};
+        ubo.view = glm::inverse(frameCamera());
+        ubo.proj = projection();
+        ubo.invViewProj = glm::inverse(ubo.proj * ubo.view);
         uniformBuffers[imageIndex].copyFrom(&ubo, sizeof(ubo));
     }
 
     void Renderer::drawFrame() {
+        ZoneScoped;
         device.waitForFences({inFlightFences[currentFrame]}, true, UINT64_MAX);
+        // the queue finishes frames in submission order, everything up to the slot's last frame is done
+        completedFrames = std::max(completedFrames, slotFrames[currentFrame]);
+        framePacer.wait();
+
+        // offscreen images belong to their frame in flight
+        uint32_t imageIndex = currentFrame;
+        if (!settings.headless) {
+            std::pair<vk::Result, uint32_t> nextImagePair{vk::Result::eErrorOutOfDateKHR, 0};
+            try {
+                nextImagePair = swapChain.acquireNextImage(UINT64_MAX, imageAvailableSemaphores[currentFrame], nullptr);
+            } catch (vk::OutOfDateKHRError&) {}
+            // nothing was acquired and the semaphore stays unsignaled, a suboptimal image is still drawn and presented
+            if (nextImagePair.first == vk::Result::eErrorOutOfDateKHR) {
+                framebufferResized = false;
+                glfwPollEvents();
+                recreateSwapChain();
+                return;
+            }
+            imageIndex = nextImagePair.second;
 
-        std::chrono::duration<float, std::ratio<1, MAX_FRAMERATE>> sinceLastFrame{std::chrono::steady_clock::now() - lastFrameTime};
-        if (sinceLastFrame.count() < 1.0f) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            return;
+            // input is sampled after the waits on the fence, the pacer and the swapchain, right before it's used
+            glfwPollEvents();
         }
+        handleDebugModes();
 
-        float passedSeconds = std::chrono::duration_cast<std::chrono::microseconds>(sinceLastFrame).count() / 1000000.0f;
-
-        //for (fw::Object* obj : objects) {  // breaks 'cause reallocation
-        for (int i = 0; i < objects.size(); i++) {
-            volchara::Object* obj = objects[i];
-            obj->runFrameCallbacks(
-                {
-                    .passedSeconds = passedSeconds,
-                    .pressedKeys = pressedKeys,
-                    .cursorOffset = cursorOffset,
-                }
-            );
-        }
+        // the simulation thread waits between ticks while the frame reads and uploads the scene
+        std::unique_lock<std::mutex> simulationLock(simulationMutex);
+        runDeletionQueue();
+        readFrameTimestamps(currentFrame);
+        updateRenderScale();
+        simulationKeys = pressedKeys;
+        simulationCursorOffset += cursorOffset;
         cursorOffset.x = 0;
         cursorOffset.y = 0;
-
-        // updateCameraPosition(passedSeconds);
-        handleDebugModes();
-        
-        std::pair<vk::Result, uint32_t> nextImagePair = swapChain.acquireNextImage(UINT64_MAX, imageAvailableSemaphores[currentFrame], nullptr);
-        if (nextImagePair.first == vk::Result::eErrorOutOfDateKHR || nextImagePair.first == vk::Result::eSuboptimalKHR || framebufferResized) {
-            framebufferResized = false;
-            recreateSwapChain();
-            return;
-        }
-
-        lastFrameTime = std::chrono::steady_clock::now();
-
-        uint32_t imageIndex = nextImagePair.second;
+        processLoadedTextures();
+        evictUnusedTextures();
 
         device.resetFences({inFlightFences[currentFrame]});
         
@@ -1749,27 +3337,58 @@ namespace volchara {
 
         updateUniformBuffer(currentFrame);
 
-        vk::PipelineStageFlags waitStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+        // uploads recorded this frame go out in one batch, the frame waits for them on the GPU only
+        UploadTicket uploads = deviceBufferCopyHandler.flush();
+        // a headless frame has no swapchain image to wait for, only the uploads
+        std::array<vk::Semaphore, 2> waitSemaphores{deviceBufferCopyHandler.timelineSemaphore(), *imageAvailableSemaphores[currentFrame]};
+        std::array<vk::PipelineStageFlags, 2> waitStageMasks{
+            vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        };
+        std::array<uint64_t, 2> waitValues{uploads, 0};
+        uint32_t waitCount = settings.headless ? 1 : 2;
+        vk::TimelineSemaphoreSubmitInfo timelineInfo{
+            .waitSemaphoreValueCount = waitCount,
+            .pWaitSemaphoreValues = waitValues.data(),
+        };
         vk::SubmitInfo submitInfo{
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &*imageAvailableSemaphores[currentFrame],
-            .pWaitDstStageMask = &waitStageMask,
+            .pNext = &timelineInfo,
+            .waitSemaphoreCount = waitCount,
+            .pWaitSemaphores = waitSemaphores.data(),
+            .pWaitDstStageMask = waitStageMasks.data(),
             .commandBufferCount = 1,
             .pCommandBuffers = &*commandBuffers[currentFrame],
-            .signalSemaphoreCount = 1,
+            .signalSemaphoreCount = settings.headless ? 0u : 1u,
             .pSignalSemaphores = &*renderFinishedSemaphores[currentFrame],
         };
-        graphicsQueue.submit(submitInfo, inFlightFences[currentFrame]);
-
-        vk::PresentInfoKHR presentInfo{
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &*renderFinishedSemaphores[currentFrame],
-            .swapchainCount = 1,
-            .pSwapchains = &*swapChain,
-            .pImageIndices = &imageIndex,
-        };
+        {
+            std::lock_guard<std::mutex> queueLock(queueMutex);
+            graphicsQueue.submit(submitInfo, inFlightFences[currentFrame]);
+        }
+        // releases queued by ticks after the unlock wait for this frame
+        slotFrames[currentFrame] = ++submittedFrames;
+        simulationLock.unlock();
+
+        if (!settings.headless) {
+            vk::PresentInfoKHR presentInfo{
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &*renderFinishedSemaphores[currentFrame],
+                .swapchainCount = 1,
+                .pSwapchains = &*swapChain,
+                .pImageIndices = &imageIndex,
+            };
 
-        presentQueue.presentKHR(presentInfo);
+            vk::Result presentResult = vk::Result::eErrorOutOfDateKHR;
+            try {
+                // ticks running after the unlock may be submitting uploads to this same queue
+                std::lock_guard<std::mutex> queueLock(queueMutex);
+                presentResult = presentQueue.presentKHR(presentInfo);
+            } catch (vk::OutOfDateKHRError&) {}
+            if (presentResult != vk::Result::eSuccess || framebufferResized) {
+                framebufferResized = false;
+                recreateSwapChain();
+            }
+        }
 
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 
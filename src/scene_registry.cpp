@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <scene_registry.hpp>
+#include <objects.hpp>
+
+namespace volchara {
+    void SceneRegistry::rebuild(const std::vector<Object*>& roots) {
+        handles.clear();
+        // breadth first, so every parent is stored before its children
+        for (Object* root : roots) {
+            if (root->scene == this && root->sceneIndex < handles.size() && handles[root->sceneIndex] == root) continue;
+            size_t first = handles.size();
+            root->scene = this;
+            root->sceneIndex = handles.size();
+            handles.push_back(root);
+            for (size_t i = first; i < handles.size(); i++) {
+                for (Object* child : handles[i]->children) {
+                    if (child->scene == this && child->sceneIndex < handles.size() && handles[child->sceneIndex] == child) continue;
+                    child->scene = this;
+                    child->sceneIndex = handles.size();
+                    handles.push_back(child);
+                }
+            }
+        }
+        worldMatrices.resize(handles.size());
+        normalMatrices.resize(handles.size());
+        meshes.resize(handles.size());
+        sceneMaterials.resize(handles.size());
+        transparentFlags.resize(handles.size());
+        transformDirty.assign(handles.size(), 0);
+        boundingSpheres.resize(handles.size());
+        std::vector<AABB> bounds(handles.size());
+        for (uint32_t i = 0; i < handles.size(); i++) {
+            readTransform(i);
+            readRenderData(i);
+            readBounds(i);
+            bounds[i] = AABB::fromSphere(boundingSpheres[i]);
+        }
+        spatialIndex.build(bounds);
+        layoutDirty = false;
+        anyTransformDirty = false;
+        renderDataVersion++;
+        layoutVersion++;
+    }
+    bool SceneRegistry::needsRebuild() const {
+        return layoutDirty;
+    }
+    void SceneRegistry::markLayoutChanged() {
+        layoutDirty = true;
+    }
+    void SceneRegistry::markTransformChanged(uint32_t index) {
+        // a rebuild reads every matrix anyway
+        if (layoutDirty || index >= transformDirty.size()) return;
+        transformDirty[index] = 1;
+        anyTransformDirty = true;
+    }
+    void SceneRegistry::markRenderDataChanged(uint32_t index) {
+        if (layoutDirty || index >= handles.size()) return;
+        readRenderData(index);
+        // geometry going resident or away changes the bounds
+        readBounds(index);
+        // only the leaf is marked, updateTransforms refits once for everything changed since
+        spatialIndex.update(index, AABB::fromSphere(boundingSpheres[index]));
+        renderDataVersion++;
+    }
+    void SceneRegistry::readRenderData(uint32_t index) {
+        Object* obj = handles[index];
+        meshes[index] = obj->resident ? obj->getMesh().get() : nullptr;
+        sceneMaterials[index] = {
+            .textureIndex = obj->getTextureIndex(),
+            .normalIndex = obj->getNormalIndex(),
+            .emissiveIndex = obj->getEmissiveIndex(),
+            .alphaCutoff = obj->getAlphaCutoff(),
+        };
+        transparentFlags[index] = obj->isTransparent();
+    }
+    void SceneRegistry::readTransform(uint32_t index) {
+        worldMatrices[index] = handles[index]->transform.modelMatrix();
+        normalMatrices[index] = glm::mat3x4(glm::transpose(glm::inverse(glm::mat3(worldMatrices[index]))));
+    }
+    void SceneRegistry::readBounds(uint32_t index) {
+        const glm::mat4& world = worldMatrices[index];
+        if (meshes[index] == nullptr) {
+            boundingSpheres[index] = glm::vec4(glm::vec3(world[3]), 0);
+            return;
+        }
+        // same sphere the cull pass tests, the largest axis scale covers any rotation
+        glm::vec4 local = meshes[index]->bounds;
+        float scale = std::max({glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))});
+        boundingSpheres[index] = glm::vec4(glm::vec3(world * glm::vec4(glm::vec3(local), 1)), local.w * scale);
+    }
+    std::vector<Object*> SceneRegistry::toObjects(const std::vector<uint32_t>& entries) const {
+        std::vector<Object*> result;
+        result.reserve(entries.size());
+        for (uint32_t entry : entries) {
+            result.push_back(handles[entry]);
+        }
+        return result;
+    }
+    void SceneRegistry::updateTransforms() {
+        if (anyTransformDirty) {
+            // in storage order the parent's cached matrix is always rebuilt first
+            for (uint32_t i = 0; i < transformDirty.size(); i++) {
+                if (!transformDirty[i]) continue;
+                readTransform(i);
+                readBounds(i);
+                spatialIndex.update(i, AABB::fromSphere(boundingSpheres[i]));
+                transformDirty[i] = 0;
+            }
+            anyTransformDirty = false;
+        }
+        // render data changes leave their leaves dirty as well, a clean tree returns right away
+        spatialIndex.refit();
+    }
+    void SceneRegistry::remove(Object* obj) {
+        if (obj->scene != this) return;
+        obj->scene = nullptr;
+        layoutDirty = true;
+    }
+    uint32_t SceneRegistry::size() const {
+        return handles.size();
+    }
+    uint64_t SceneRegistry::layoutGeneration() const {
+        return layoutVersion;
+    }
+    uint64_t SceneRegistry::version() const {
+        return renderDataVersion;
+    }
+    const std::vector<glm::mat4>& SceneRegistry::worlds() const {
+        return worldMatrices;
+    }
+    const std::vector<glm::mat3x4>& SceneRegistry::normals() const {
+        return normalMatrices;
+    }
+    const std::vector<Mesh*>& SceneRegistry::meshList() const {
+        return meshes;
+    }
+    const std::vector<SceneMaterial>& SceneRegistry::materials() const {
+        return sceneMaterials;
+    }
+    const std::vector<uint8_t>& SceneRegistry::transparent() const {
+        return transparentFlags;
+    }
+    const std::vector<glm::vec4>& SceneRegistry::worldBounds() const {
+        return boundingSpheres;
+    }
+    std::vector<Object*> SceneRegistry::queryRadius(glm::vec3 center, float radius) const {
+        std::vector<uint32_t> entries;
+        spatialIndex.querySphere(center, radius, entries);
+        return toObjects(entries);
+    }
+    std::vector<Object*> SceneRegistry::queryBox(const AABB& box) const {
+        std::vector<uint32_t> entries;
+        spatialIndex.queryBox(box, entries);
+        return toObjects(entries);
+    }
+    void SceneRegistry::queryFrustum(const std::array<glm::vec4, 5>& planes, std::vector<uint32_t>& entries) const {
+        spatialIndex.queryFrustum(planes, entries);
+    }
+    std::optional<std::pair<Object*, float>> SceneRegistry::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) const {
+        std::optional<RayHit> hit = spatialIndex.raycast(origin, direction, maxDistance);
+        if (!hit) return std::nullopt;
+        return std::pair{handles[hit->entry], hit->distance};
+    }
+}
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <spatial_index.hpp>
+
+namespace volchara {
+    // entries per leaf, past that a node is split at the median of the longest axis
+    constexpr uint32_t MAX_LEAF_ENTRIES = 4;
+
+    AABB AABB::fromSphere(glm::vec4 sphere) {
+        glm::vec3 extent(sphere.w);
+        return {.min = glm::vec3(sphere) - extent, .max = glm::vec3(sphere) + extent};
+    }
+    bool AABB::overlaps(const AABB& other) const {
+        return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::lessThanEqual(other.min, max));
+    }
+
+    static AABB merge(const AABB& lhs, const AABB& rhs) {
+        return {.min = glm::min(lhs.min, rhs.min), .max = glm::max(lhs.max, rhs.max)};
+    }
+
+    // distance along the ray to the box, nullopt when it misses within maxDistance
+    static std::optional<float> intersect(const AABB& box, glm::vec3 origin, glm::vec3 invDirection, float maxDistance) {
+        glm::vec3 t0 = (box.min - origin) * invDirection;
+        glm::vec3 t1 = (box.max - origin) * invDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+        float exit = std::min({tFar.x, tFar.y, tFar.z, maxDistance});
+        if (enter > exit) return std::nullopt;
+        return enter;
+    }
+
+    void SpatialIndex::build(const std::vector<AABB>& bounds) {
+        entryBounds = bounds;
+        entries.resize(bounds.size());
+        entryLeaves.resize(bounds.size());
+        for (uint32_t i = 0; i < entries.size(); i++) {
+            entries[i] = i;
+        }
+        nodes.clear();
+        refitPending = false;
+        if (entries.empty()) return;
+        nodes.reserve(2 * entries.size());
+        nodes.push_back({});
+        buildNode(0, 0, entries.size());
+    }
+    void SpatialIndex::buildNode(uint32_t node, uint32_t first, uint32_t count) {
+        AABB bounds = entryBounds[entries[first]];
+        AABB centroids{.min = (bounds.min + bounds.max) * 0.5f, .max = (bounds.min + bounds.max) * 0.5f};
+        for (uint32_t i = first + 1; i < first + count; i++) {
+            const AABB& entry = entryBounds[entries[i]];
+            bounds = merge(bounds, entry);
+            glm::vec3 centroid = (entry.min + entry.max) * 0.5f;
+            centroids = merge(centroids, {.min = centroid, .max = centroid});
+        }
+        nodes[node].bounds = bounds;
+        glm::vec3 spread = centroids.max - centroids.min;
+        // entries stacked on one point can't be told apart by splitting
+        if (count <= MAX_LEAF_ENTRIES || std::max({spread.x, spread.y, spread.z}) == 0.0f) {
+            nodes[node].first = first;
+            nodes[node].count = count;
+            for (uint32_t i = first; i < first + count; i++) {
+                entryLeaves[entries[i]] = node;
+            }
+            return;
+        }
+        int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+        uint32_t half = count / 2;
+        std::nth_element(entries.begin() + first, entries.begin() + first + half, entries.begin() + first + count, [&](uint32_t lhs, uint32_t rhs) {
+            return entryBounds[lhs].min[axis] + entryBounds[lhs].max[axis] < entryBounds[rhs].min[axis] + entryBounds[rhs].max[axis];
+        });
+        uint32_t children = nodes.size();
+        nodes[node].first = children;
+        nodes[node].count = 0;
+        nodes.push_back({.parent = node});
+        nodes.push_back({.parent = node});
+        buildNode(children, first, half);
+        buildNode(children + 1, first + half, count - half);
+    }
+    void SpatialIndex::update(uint32_t entry, const AABB& bounds) {
+        if (entry >= entryBounds.size()) return;
+        entryBounds[entry] = bounds;
+        // ancestors of an already dirty node are dirty too
+        for (uint32_t node = entryLeaves[entry]; !nodes[node].dirty; node = nodes[node].parent) {
+            nodes[node].dirty = true;
+            if (node == 0) break;
+        }
+        refitPending = true;
+    }
+    void SpatialIndex::refit() {
+        if (!refitPending) return;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node& node = nodes[i];
+            if (!node.dirty) continue;
+            if (node.count > 0) {
+                node.bounds = entryBounds[entries[node.first]];
+                for (uint32_t e = node.first + 1; e < node.first + node.count; e++) {
+                    node.bounds = merge(node.bounds, entryBounds[entries[e]]);
+                }
+            } else {
+                node.bounds = merge(nodes[node.first].bounds, nodes[node.first + 1].bounds);
+            }
+            node.dirty = false;
+        }
+        refitPending = false;
+    }
+    uint32_t SpatialIndex::size() const {
+        return entryBounds.size();
+    }
+    void SpatialIndex::queryBox(const AABB& box, std::vector<uint32_t>& result) const {
+        if (nodes.empty()) return;
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!node.bounds.overlaps(box)) continue;
+            if (node.count == 0) {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (entryBounds[entries[i]].overlaps(box)) result.push_back(entries[i]);
+            }
+        }
+    }
+    void SpatialIndex::querySphere(glm::vec3 center, float radius, std::vector<uint32_t>& result) const {
+        if (nodes.empty()) return;
+        auto touches = [&](const AABB& box) {
+            glm::vec3 closest = glm::clamp(center, box.min, box.max) - center;
+            return glm::dot(closest, closest) <= radius * radius;
+        };
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!touches(node.bounds)) continue;
+            if (node.count == 0) {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (touches(entryBounds[entries[i]])) result.push_back(entries[i]);
+            }
+        }
+    }
+    void SpatialIndex::queryFrustum(const std::array<glm::vec4, 5>& planes, std::vector<uint32_t>& result) const {
+        if (nodes.empty()) return;
+        auto inside = [&](const AABB& box) {
+            // the corner furthest along each plane normal decides
+            for (const glm::vec4& plane : planes) {
+                glm::vec3 corner = glm::mix(box.min, box.max, glm::greaterThan(glm::vec3(plane), glm::vec3(0)));
+                if (glm::dot(glm::vec3(plane), corner) + plane.w < 0) return false;
+            }
+            return true;
+        };
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!inside(node.bounds)) continue;
+            if (node.count == 0) {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (inside(entryBounds[entries[i]])) result.push_back(entries[i]);
+            }
+        }
+    }
+    std::optional<RayHit> SpatialIndex::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance) const {
+        if (nodes.empty()) return std::nullopt;
+        glm::vec3 invDirection = 1.0f / glm::normalize(direction);
+        std::optional<RayHit> closest;
+        float limit = maxDistance;
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!intersect(node.bounds, origin, invDirection, limit)) continue;
+            if (node.count == 0) {
+                stack.push_back(node.first);
+                stack.push_back(node.first + 1);
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                std::optional<float> distance = intersect(entryBounds[entries[i]], origin, invDirection, limit);
+                if (distance) {
+                    closest = RayHit{.entry = entries[i], .distance = *distance};
+                    limit = *distance;
+                }
+            }
+        }
+        return closest;
+    }
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+#include <stb_image.h>
+
+#include <texture_data.hpp>
+
+namespace volchara {
+    namespace {
+        const std::array<unsigned char, 12> KTX2_IDENTIFIER = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+        // identifier, header and index, the level index follows them
+        const size_t KTX2_LEVEL_INDEX_OFFSET = 80;
+
+        template<class T>
+        T readValue(std::span<const unsigned char> data, size_t offset) {
+            T value;
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            return value;
+        }
+    }
+
+    bool TextureData::isKtx2(std::span<const unsigned char> fileData) {
+        return fileData.size() >= KTX2_IDENTIFIER.size() && std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), fileData.begin());
+    }
+
+    TextureData TextureData::fromKtx2(std::span<const unsigned char> fileData) {
+        if (!isKtx2(fileData) || fileData.size() < KTX2_LEVEL_INDEX_OFFSET) {
+            throw std::runtime_error("not a KTX2 texture");
+        }
+        uint32_t vkFormat = readValue<uint32_t>(fileData, 12);
+        uint32_t pixelWidth = readValue<uint32_t>(fileData, 20);
+        uint32_t pixelHeight = readValue<uint32_t>(fileData, 24);
+        uint32_t pixelDepth = readValue<uint32_t>(fileData, 28);
+        uint32_t layerCount = readValue<uint32_t>(fileData, 32);
+        uint32_t faceCount = readValue<uint32_t>(fileData, 36);
+        uint32_t levelCount = std::max(readValue<uint32_t>(fileData, 40), 1u);
+        uint32_t supercompressionScheme = readValue<uint32_t>(fileData, 44);
+        if (vkFormat == 0 || supercompressionScheme != 0) {
+            throw std::runtime_error("supercompressed KTX2 textures aren't supported, transcode them to BC7 or ASTC");
+        }
+        if (pixelDepth > 1 || layerCount > 1 || faceCount != 1 || pixelHeight == 0) {
+            throw std::runtime_error("only 2D KTX2 textures are supported");
+        }
+        if (fileData.size() < KTX2_LEVEL_INDEX_OFFSET + levelCount * 24) {
+            throw std::runtime_error("truncated KTX2 level index");
+        }
+        TextureData texture;
+        texture.format = static_cast<vk::Format>(vkFormat);
+        texture.width = pixelWidth;
+        texture.height = pixelHeight;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            size_t entry = KTX2_LEVEL_INDEX_OFFSET + level * 24;
+            TextureLevel textureLevel{
+                .offset = readValue<uint64_t>(fileData, entry),
+                .size = readValue<uint64_t>(fileData, entry + 8),
+                .width = std::max(pixelWidth >> level, 1u),
+                .height = std::max(pixelHeight >> level, 1u),
+            };
+            if (textureLevel.offset + textureLevel.size > fileData.size()) {
+                throw std::runtime_error("truncated KTX2 level data");
+            }
+            texture.levels.push_back(textureLevel);
+        }
+        // levels are already aligned to the block size inside the file, only the part after the header is kept
+        vk::DeviceSize payloadBegin = fileData.size();
+        for (const TextureLevel& level : texture.levels) {
+            payloadBegin = std::min(payloadBegin, level.offset);
+        }
+        for (TextureLevel& level : texture.levels) {
+            level.offset -= payloadBegin;
+        }
+        texture.data.assign(fileData.begin() + payloadBegin, fileData.end());
+        return texture;
+    }
+
+    TextureData TextureData::fromImage(std::span<const unsigned char> fileData) {
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load_from_memory(fileData.data(), fileData.size(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            throw std::runtime_error("couldn't load texture image");
+        }
+        vk::DeviceSize imageSize = width * height * STBI_rgb_alpha;
+        TextureData texture;
+        texture.format = vk::Format::eR8G8B8A8Srgb;
+        texture.width = width;
+        texture.height = height;
+        texture.data.assign(pixels, pixels + imageSize);
+        texture.levels.push_back({
+            .offset = 0,
+            .size = imageSize,
+            .width = texture.width,
+            .height = texture.height,
+        });
+        stbi_image_free(pixels);
+        return texture;
+    }
+
+    TextureHash TextureData::contentHash(std::span<const unsigned char> fileData) {
+        // MurmurHash3 x64 128, 16 byte blocks, the tail is zero padded into the last one
+        const uint64_t c1 = 0x87c37b91114253d5ull;
+        const uint64_t c2 = 0x4cf5ad432745937full;
+        uint64_t h1 = 0;
+        uint64_t h2 = 0;
+        auto mixBlock = [&](uint64_t k1, uint64_t k2) {
+            k1 *= c1; k1 = std::rotl(k1, 31); k1 *= c2; h1 ^= k1;
+            k2 *= c2; k2 = std::rotl(k2, 33); k2 *= c1; h2 ^= k2;
+        };
+        size_t offset = 0;
+        for (; offset + 2 * sizeof(uint64_t) <= fileData.size(); offset += 2 * sizeof(uint64_t)) {
+            mixBlock(readValue<uint64_t>(fileData, offset), readValue<uint64_t>(fileData, offset + sizeof(uint64_t)));
+            h1 = std::rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+            h2 = std::rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+        }
+        std::array<unsigned char, 2 * sizeof(uint64_t)> tail{};
+        std::copy(fileData.begin() + offset, fileData.end(), tail.begin());
+        if (offset < fileData.size()) {
+            mixBlock(readValue<uint64_t>(tail, 0), readValue<uint64_t>(tail, sizeof(uint64_t)));
+        }
+        auto finalize = [](uint64_t k) {
+            k ^= k >> 33; k *= 0xff51afd7ed558ccdull;
+            k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ull;
+            return k ^ (k >> 33);
+        };
+        h1 ^= fileData.size(); h2 ^= fileData.size();
+        h1 += h2; h2 += h1;
+        h1 = finalize(h1); h2 = finalize(h2);
+        h1 += h2; h2 += h1;
+        return {.size = fileData.size(), .low = h1, .high = h2};
+    }
+
+    TextureData TextureData::fromMemory(std::span<const unsigned char> fileData) {
+        return isKtx2(fileData) ? fromKtx2(fileData) : fromImage(fileData);
+    }
+}